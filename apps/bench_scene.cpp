@@ -0,0 +1,623 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <glutils.hpp>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "camerapath.hpp"
+#include "fragmentcounter.hpp"
+#include "framestats.hpp"
+#include "glcontext.hpp"
+#include "glhooks.hpp"
+#include "gputimer.hpp"
+#include "housemesh.hpp"
+#include "jobsystem.hpp"
+#include "profiler.hpp"
+#include "rendertarget.hpp"
+#include "scene.hpp"
+#include "shader.hpp"
+#include "shadercache.hpp"
+#include "uploadring.hpp"
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Distance between the houses of the city
+const float HOUSE_SPACING = 2.0f;
+
+const size_t DEFAULT_NUM_HOUSES = 10000;
+const int DEFAULT_WIDTH = 1280;
+const int DEFAULT_HEIGHT = 720;
+// Frames rendered before measuring, to warm up the caches and the driver
+const unsigned long DEFAULT_WARMUP_FRAMES = 30;
+const unsigned long DEFAULT_FRAMES = 300;
+
+// Time that the animation advances per frame, so every run (and every path)
+// renders exactly the same frames regardless of the speed of the machine
+const float FRAME_TIME_STEP = 1.0f / 60.0f;
+
+// Camera Field Of View (the depth range is the one of the Camera)
+const float FOV = 45.0f;
+
+// Ways to submit the houses, from the slowest to the most GPU-driven, and
+// the culled path sorted front to back or with a depth pre-pass
+enum class RenderPath { NAIVE, INSTANCED, CULLED, INDIRECT, SORTED, PREPASS };
+
+const char *path_name(RenderPath path) {
+  switch (path) {
+  case RenderPath::NAIVE:
+    return "naive";
+  case RenderPath::INSTANCED:
+    return "instanced";
+  case RenderPath::CULLED:
+    return "culled";
+  case RenderPath::INDIRECT:
+    return "indirect";
+  case RenderPath::SORTED:
+    return "sorted";
+  case RenderPath::PREPASS:
+    return "prepass";
+  }
+  return "";
+}
+
+// Command read by glDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  // Must be 0 before GL 4.2
+  GLuint base_instance;
+};
+
+// Measures of a path over the measured frames
+struct PathResult {
+  RenderPath path;
+  double seconds = 0.0;
+  unsigned long frames = 0;
+  MeasurePercentiles frame_ms, cpu_ms, gpu_ms;
+  MeasurePercentiles draw_calls, triangles, state_changes;
+  // Average fragments of the textured draws per frame that passed the depth
+  // test, and fragment shader invocations (negative if unknown)
+  double fragments = 0.0;
+  double invocations = -1.0;
+};
+
+// Scripted camera: one orbit around the city over the measured frames, from
+// the middle of the houses and looking at the center, so the view sweeps
+// over dense and empty areas
+glm::mat4 camera_view(unsigned long frame, unsigned long num_frames,
+                      float city_extent) {
+  const float angle = 2.0f * glm::pi<float>() * frame / num_frames;
+  const float radius = 0.35f * city_extent + 4.0f;
+  const glm::vec3 position(radius * std::cos(angle), 2.0f + 0.02f * radius,
+                           radius * std::sin(angle));
+  return glm::lookAt(position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void write_percentiles(std::ostream &out, const char *name,
+                       const MeasurePercentiles &measure) {
+  out << "\"" << name << "\": {\"count\": " << measure.count
+      << ", \"p50\": " << measure.p50 << ", \"p95\": " << measure.p95
+      << ", \"p99\": " << measure.p99 << ", \"max\": " << measure.max << "}";
+}
+
+int main(int argc, char *argv[]) {
+  // Usage: bench_scene [--houses N] [--layout grid|random] [--seed S]
+  //                    [--size WxH] [--warmup N] [--frames N]
+  //                    [--paths naive,instanced,culled,indirect,sorted,
+  //                             prepass]
+  //                    [--camera path.cam] [--output results.json]
+  // Renders the same city with each path headless, moving the camera along
+  // the same scripted path, and writes the frames per second, the CPU and
+  // GPU time, the draw calls and the fragments shaded by the textured draws
+  // of each path as JSON. The camera can follow a path recorded in the house
+  // app instead (the whole path by default)
+  size_t numHouses = DEFAULT_NUM_HOUSES;
+  bool randomLayout = false;
+  uint32_t seed = 1;
+  int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+  unsigned long warmupFrames = DEFAULT_WARMUP_FRAMES;
+  unsigned long numFrames = 0;
+  std::string pathList = "naive,instanced,culled,indirect,sorted,prepass";
+  std::string outputPath = "bench_scene.json";
+  std::string cameraPathFile;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--houses" && i + 1 < argc)
+      numHouses = std::stoul(argv[++i]);
+    else if (arg == "--layout" && i + 1 < argc)
+      randomLayout = std::string(argv[++i]) == "random";
+    else if (arg == "--seed" && i + 1 < argc)
+      seed = std::stoul(argv[++i]);
+    else if (arg == "--size" && i + 1 < argc) {
+      if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 ||
+          width <= 0 || height <= 0) {
+        std::cout << "Invalid size " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (arg == "--warmup" && i + 1 < argc)
+      warmupFrames = std::stoul(argv[++i]);
+    else if (arg == "--frames" && i + 1 < argc)
+      numFrames = std::max(std::stoul(argv[++i]), 1ul);
+    else if (arg == "--paths" && i + 1 < argc)
+      pathList = argv[++i];
+    else if (arg == "--output" && i + 1 < argc)
+      outputPath = argv[++i];
+    else if (arg == "--camera" && i + 1 < argc)
+      cameraPathFile = argv[++i];
+    else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  CameraPath cameraPath;
+  if (!cameraPathFile.empty()) {
+    if (!cameraPath.load(cameraPathFile))
+      return 1;
+    if (numFrames == 0)
+      numFrames = std::ceil(cameraPath.duration() / FRAME_TIME_STEP) + 1;
+  }
+  if (numFrames == 0)
+    numFrames = DEFAULT_FRAMES;
+
+  HeadlessContext context;
+  if (!context.create(3, 3)) {
+    return 1;
+  }
+  RenderTarget renderTarget(width, height);
+  renderTarget.bind();
+  const std::string renderer =
+      reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+
+  std::vector<RenderPath> paths;
+  std::stringstream pathNames(pathList);
+  std::string name;
+  while (std::getline(pathNames, name, ',')) {
+    bool known = false;
+    for (RenderPath path :
+         {RenderPath::NAIVE, RenderPath::INSTANCED, RenderPath::CULLED,
+          RenderPath::INDIRECT, RenderPath::SORTED, RenderPath::PREPASS}) {
+      if (name == path_name(path)) {
+        paths.push_back(path);
+        known = true;
+      }
+    }
+    if (!known) {
+      std::cout << "Unknown path " << name << std::endl;
+      return 1;
+    }
+  }
+  // glDrawElementsIndirect is core since GL 4.0
+  const bool indirectSupported = has_gl_version(4, 0);
+  if (!indirectSupported && std::erase(paths, RenderPath::INDIRECT) > 0) {
+    std::cout << "Skipping the indirect path, it requires OpenGL 4.0"
+              << std::endl;
+  }
+
+  // Set the color to clear the screen
+  glClearColor(0.25f, 0.5f, 0.75f, 1.0f);
+
+  // Enable Z-buffer
+  glEnable(GL_DEPTH_TEST);
+
+  // The naive path sets the model matrix of each house as a uniform, the
+  // others read them as instance attributes. Both are built before the
+  // measures
+  auto shaders =
+      std::make_unique<ShaderCache>("../../src/shaders/common/surface.vert",
+                                    "../../src/shaders/common/surface.frag");
+  const GLuint naiveProgram = shaders->program(SHADER_VERTEX_COLOR);
+  const GLuint instancedProgram =
+      shaders->program(SHADER_VERTEX_COLOR | SHADER_INSTANCED);
+  GLuint naiveModelLoc = glGetUniformLocation(naiveProgram, "model");
+  GLuint naiveViewLoc = glGetUniformLocation(naiveProgram, "view");
+  GLuint naiveProjectionLoc = glGetUniformLocation(naiveProgram, "projection");
+  GLuint naiveTexLoc = glGetUniformLocation(naiveProgram, "baseTexture");
+  GLuint viewLoc = glGetUniformLocation(instancedProgram, "view");
+  GLuint projectionLoc = glGetUniformLocation(instancedProgram, "projection");
+  GLuint texLoc = glGetUniformLocation(instancedProgram, "baseTexture");
+  // The depth pre-pass only writes the depth of the houses
+  Shader depthShader("../../src/shaders/house/depth_instanced.vert",
+                     "../../src/shaders/house/depth.frag");
+  GLuint depthViewLoc = glGetUniformLocation(depthShader.ID, "view");
+  GLuint depthProjectionLoc =
+      glGetUniformLocation(depthShader.ID, "projection");
+
+  // The same city for every path
+  HouseInstances houses =
+      randomLayout ? make_house_random(numHouses, HOUSE_SPACING, seed)
+                   : make_house_grid(numHouses, HOUSE_SPACING);
+  const float cityExtent =
+      std::ceil(std::sqrt(static_cast<double>(numHouses))) * HOUSE_SPACING;
+  JobSystem jobs;
+  VisibleSet visible;
+
+  // Ring buffers to stream the model matrices and the indirect commands
+  auto instanceRing = std::make_unique<UploadRing>(
+      GL_ARRAY_BUFFER, houses.size() * sizeof(glm::mat4));
+  std::unique_ptr<UploadRing> commandRing;
+  if (indirectSupported) {
+    commandRing = std::make_unique<UploadRing>(
+        GL_DRAW_INDIRECT_BUFFER, 2 * sizeof(DrawElementsIndirectCommand));
+  }
+
+  // Prepare the roof and the walls
+  GLuint roof_tex = texture_setup("../../textures/roof.png");
+  GLuint roof_VAO;
+  glGenVertexArrays(1, &roof_VAO);
+  glBindVertexArray(roof_VAO);
+  set_up_roof();
+  set_up_instances(instanceRing->buffer());
+
+  GLuint wall_tex = texture_setup("../../textures/container.jpg");
+  GLuint walls_VAO;
+  glGenVertexArrays(1, &walls_VAO);
+  glBindVertexArray(walls_VAO);
+  set_up_walls();
+  set_up_instances(instanceRing->buffer());
+
+  // Position-only vertex arrays of the depth pre-pass
+  GLuint roof_depth_VAO;
+  glGenVertexArrays(1, &roof_depth_VAO);
+  glBindVertexArray(roof_depth_VAO);
+  set_up_roof_positions();
+  set_up_instances(instanceRing->buffer());
+  GLuint walls_depth_VAO;
+  glGenVertexArrays(1, &walls_depth_VAO);
+  glBindVertexArray(walls_depth_VAO);
+  set_up_walls_positions();
+  set_up_instances(instanceRing->buffer());
+
+  const glm::mat4 projection =
+      glm::perspective(glm::radians(FOV), static_cast<float>(width) / height,
+                       NEAR_PLANE, FAR_PLANE);
+  DrawOrder drawOrder;
+
+  // Draws the houses in `instances` with one instanced draw per part, with
+  // the instance count read from the command buffer if `indirect`
+  auto draw_instanced = [&](const UploadRing::Allocation &instances,
+                            size_t count, bool indirect, FrameSample &sample) {
+    glBindVertexArray(roof_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+    glBindVertexArray(walls_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+
+    GLintptr commandOffset = 0;
+    if (indirect) {
+      commandRing->begin_frame();
+      UploadRing::Allocation commands =
+          commandRing->allocate(2 * sizeof(DrawElementsIndirectCommand));
+      auto *command = static_cast<DrawElementsIndirectCommand *>(commands.data);
+      command[0] = {ROOF_NUM_INDICES, static_cast<GLuint>(count), 0, 0, 0};
+      command[1] = {WALLS_NUM_INDICES, static_cast<GLuint>(count), 0, 0, 0};
+      commandRing->commit();
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandRing->buffer());
+      commandOffset = commands.offset;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, roof_tex);
+    glBindVertexArray(roof_VAO);
+    if (indirect) {
+      glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                             (void *)commandOffset);
+    } else {
+      glDrawElementsInstanced(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT,
+                              0, count);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, wall_tex);
+    glBindVertexArray(walls_VAO);
+    if (indirect) {
+      glDrawElementsIndirect(
+          GL_TRIANGLES, GL_UNSIGNED_INT,
+          (void *)(commandOffset + sizeof(DrawElementsIndirectCommand)));
+      commandRing->end_frame();
+    } else {
+      glDrawElementsInstanced(GL_TRIANGLES, WALLS_NUM_INDICES,
+                              GL_UNSIGNED_INT, 0, count);
+    }
+    sample.triangles += (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3 * count;
+  };
+
+  // Writes the depth of the houses in `instances`, and sets the depth test
+  // so the following draws only shade the fragments that are in front
+  auto draw_depth = [&](const UploadRing::Allocation &instances, size_t count,
+                        const glm::mat4 &view, FrameSample &sample) {
+    depthShader.use();
+    glUniformMatrix4fv(depthViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(depthProjectionLoc, 1, GL_FALSE,
+                       glm::value_ptr(projection));
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glBindVertexArray(roof_depth_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+    glDrawElementsInstanced(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT,
+                            0, count);
+    glBindVertexArray(walls_depth_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+    glDrawElementsInstanced(GL_TRIANGLES, WALLS_NUM_INDICES, GL_UNSIGNED_INT,
+                            0, count);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    sample.triangles += (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3 * count;
+  };
+
+  // Submits a frame of the scripted camera path with the given path, counting
+  // the fragments of the textured draws
+  auto draw_frame = [&](RenderPath path, unsigned long frame,
+                        FragmentCounter &fragments, FrameSample &sample) {
+    glm::mat4 view;
+    if (cameraPath.empty()) {
+      view = camera_view(frame, numFrames, cityExtent);
+    } else {
+      Camera camera;
+      cameraPath.apply(frame * FRAME_TIME_STEP, camera);
+      view = camera.GetViewMatrix();
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    JobCounter transformsDone;
+    update_transforms(jobs, houses, frame * FRAME_TIME_STEP, transformsDone);
+
+    if (path == RenderPath::NAIVE) {
+      glUseProgram(naiveProgram);
+      glUniformMatrix4fv(naiveViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+      glUniformMatrix4fv(naiveProjectionLoc, 1, GL_FALSE,
+                         glm::value_ptr(projection));
+      glUniform1i(naiveTexLoc, 0);
+      glActiveTexture(GL_TEXTURE0);
+      jobs.wait(transformsDone);
+      // One draw per part of each house, as the lighting app does
+      fragments.begin();
+      for (size_t i = 0; i < houses.size(); i++) {
+        glUniformMatrix4fv(naiveModelLoc, 1, GL_FALSE,
+                           glm::value_ptr(houses.models[i]));
+        glBindTexture(GL_TEXTURE_2D, roof_tex);
+        glBindVertexArray(roof_VAO);
+        glDrawElements(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT, 0);
+        glBindTexture(GL_TEXTURE_2D, wall_tex);
+        glBindVertexArray(walls_VAO);
+        glDrawElements(GL_TRIANGLES, WALLS_NUM_INDICES, GL_UNSIGNED_INT, 0);
+      }
+      fragments.end();
+      sample.triangles +=
+          (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3 * houses.size();
+      return;
+    }
+
+    instanceRing->begin_frame();
+    UploadRing::Allocation instances =
+        instanceRing->allocate(houses.size() * sizeof(glm::mat4));
+    size_t count = houses.size();
+    if (path == RenderPath::INSTANCED) {
+      // Every house, copied as computed
+      jobs.wait(transformsDone);
+      std::memcpy(instances.data, houses.models.data(),
+                  houses.size() * sizeof(glm::mat4));
+    } else {
+      // Only the visible houses, written by the jobs straight into the ring
+      // The frustum must outlive the culling jobs
+      JobCounter cullingDone, instancesDone;
+      const Frustum frustum(projection * view);
+      cull_houses(jobs, houses, frustum, visible, cullingDone);
+      jobs.wait(cullingDone);
+      auto *models = static_cast<glm::mat4 *>(instances.data);
+      if (path == RenderPath::SORTED) {
+        // The camera position and direction, from the view matrix
+        const glm::vec3 position = glm::vec3(glm::inverse(view)[3]);
+        const glm::vec3 forward =
+            -glm::vec3(view[0][2], view[1][2], view[2][2]);
+        sort_front_to_back(jobs, houses, visible, position, forward, FAR_PLANE,
+                           drawOrder);
+        fill_sorted_instances(jobs, houses, visible, drawOrder, models,
+                              instancesDone, transformsDone);
+      } else {
+        fill_instances(jobs, houses, visible, models, instancesDone,
+                       transformsDone);
+      }
+      jobs.wait(instancesDone);
+      jobs.wait(transformsDone);
+      count = visible.count;
+    }
+    instanceRing->commit();
+    if (path == RenderPath::PREPASS)
+      draw_depth(instances, count, view, sample);
+
+    glUseProgram(instancedProgram);
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1i(texLoc, 0);
+    fragments.begin();
+    draw_instanced(instances, count, path == RenderPath::INDIRECT, sample);
+    fragments.end();
+    instanceRing->end_frame();
+
+    // Restore the depth writes, also needed to clear the depth
+    if (path == RenderPath::PREPASS) {
+      glDepthFunc(GL_LESS);
+      glDepthMask(GL_TRUE);
+    }
+  };
+
+  // Renders the warm-up and the measured frames with a path
+  auto run_path = [&](RenderPath path) {
+    FrameStats stats(numFrames);
+    FragmentCounter fragments;
+    GpuTimer gpuTimer;
+    gpuTimer.set_frame_callback(
+        [&](unsigned long long frame, double milliseconds) {
+          stats.set_gpu_time(frame, milliseconds);
+        });
+
+    PathResult result;
+    result.path = path;
+    result.frames = numFrames;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t lastFrameStart = profiler_now();
+    // The draw calls and state changes of each frame are counted from here,
+    // without the calls of the setup or of the previous path
+    gl_hooks_frame_mark();
+    for (unsigned long i = 0; i < warmupFrames + numFrames; i++) {
+      const bool measured = i >= warmupFrames;
+      if (i == warmupFrames) {
+        // Start measuring once the GPU is done with the warm-up
+        glFinish();
+        fragments.reset();
+        start = std::chrono::steady_clock::now();
+        lastFrameStart = profiler_now();
+      }
+      const uint64_t frameStart = profiler_now();
+      FrameSample sample;
+      sample.frame = i;
+      sample.frame_ms = (frameStart - lastFrameStart) / 1e6;
+      lastFrameStart = frameStart;
+
+      gpuTimer.begin_frame();
+      gpuTimer.begin_pass(path_name(path));
+      draw_frame(path, measured ? i - warmupFrames : 0, fragments, sample);
+      gpuTimer.end_pass();
+      gpuTimer.end_frame();
+
+      sample.cpu_ms = (profiler_now() - frameStart) / 1e6;
+      gl_hooks_frame_mark();
+      sample.draw_calls = gl_hooks_frame_draw_calls();
+      sample.state_changes = gl_hooks_frame_state_changes();
+      if (measured)
+        stats.record(sample);
+    }
+    glFinish();
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    gpuTimer.finish();
+    fragments.finish();
+    result.fragments = fragments.average_samples();
+    if (fragments.has_invocations())
+      result.invocations = fragments.average_invocations();
+
+    result.frame_ms = stats.percentiles("frame_ms");
+    result.cpu_ms = stats.percentiles("cpu_ms");
+    result.gpu_ms = stats.percentiles("gpu_ms");
+    result.draw_calls = stats.percentiles("draw_calls");
+    result.triangles = stats.percentiles("triangles");
+    result.state_changes = stats.percentiles("state_changes");
+    return result;
+  };
+
+  std::cout << "Rendering " << houses.size() << " houses ("
+            << (randomLayout ? "random" : "grid") << " layout) at " << width
+            << "x" << height << " on " << renderer << std::endl;
+  std::vector<PathResult> results;
+  for (RenderPath path : paths) {
+    results.push_back(run_path(path));
+    const PathResult &result = results.back();
+    std::cout << std::fixed << std::setprecision(2) << "  " << std::setw(9)
+              << path_name(path) << ": " << result.frames / result.seconds
+              << " fps, CPU " << result.cpu_ms.p50 << " ms (p95 "
+              << result.cpu_ms.p95 << "), GPU " << result.gpu_ms.p50
+              << " ms (p95 " << result.gpu_ms.p95 << "), "
+              << std::setprecision(0);
+    // The draw calls are only counted in the builds with the GL hooks
+    if (result.draw_calls.count > 0)
+      std::cout << result.draw_calls.p50 << " draw calls, ";
+    std::cout << result.fragments << " fragments";
+    if (result.invocations >= 0.0)
+      std::cout << " (" << result.invocations << " shader invocations)";
+    std::cout << std::endl << std::defaultfloat;
+  }
+
+  // Fragments that the sort and the depth pre-pass saved from shading,
+  // against the same culled draws without them
+  auto find_result = [&](RenderPath path) -> const PathResult * {
+    for (const PathResult &result : results) {
+      if (result.path == path)
+        return &result;
+    }
+    return nullptr;
+  };
+  const PathResult *culled = find_result(RenderPath::CULLED);
+  for (RenderPath path : {RenderPath::SORTED, RenderPath::PREPASS}) {
+    const PathResult *result = find_result(path);
+    if (!culled || !result || culled->fragments <= 0.0)
+      continue;
+    std::cout << std::fixed << std::setprecision(1) << "  " << std::setw(9)
+              << path_name(path) << ": "
+              << 100.0 * (1.0 - result->fragments / culled->fragments)
+              << "% fewer fragments shaded than culled";
+    if (culled->invocations > 0.0)
+      std::cout << ", "
+                << 100.0 * (1.0 - result->invocations / culled->invocations)
+                << "% fewer shader invocations";
+    std::cout << std::endl << std::defaultfloat;
+  }
+
+  // Release the OpenGL resources while the context is still current
+  instanceRing.reset();
+  commandRing.reset();
+  glDeleteVertexArrays(1, &roof_VAO);
+  glDeleteVertexArrays(1, &walls_VAO);
+  glDeleteVertexArrays(1, &roof_depth_VAO);
+  glDeleteVertexArrays(1, &walls_depth_VAO);
+  glDeleteTextures(1, &roof_tex);
+  glDeleteTextures(1, &wall_tex);
+  shaders.reset();
+  glDeleteProgram(depthShader.ID);
+
+  std::ofstream file(outputPath);
+  if (!file) {
+    std::cout << "Could not open " << outputPath << " for writing"
+              << std::endl;
+    return 1;
+  }
+  file << "{\n  \"renderer\": ";
+  write_json_string(file, renderer);
+  file << ",\n  \"houses\": " << houses.size() << ",\n"
+       << "  \"layout\": \"" << (randomLayout ? "random" : "grid") << "\",\n"
+       << "  \"seed\": " << seed << ",\n"
+       << "  \"width\": " << width << ",\n"
+       << "  \"height\": " << height << ",\n"
+       << "  \"warmup_frames\": " << warmupFrames << ",\n"
+       << "  \"frames\": " << numFrames << ",\n"
+       << "  \"paths\": {";
+  for (size_t i = 0; i < results.size(); i++) {
+    const PathResult &result = results[i];
+    file << (i == 0 ? "\n" : ",\n") << "    \"" << path_name(result.path)
+         << "\": {\n      \"seconds\": " << result.seconds
+         << ",\n      \"fps\": " << result.frames / result.seconds
+         << ",\n      \"fragments\": " << result.fragments << ",\n";
+    if (result.invocations >= 0.0)
+      file << "      \"fragment_invocations\": " << result.invocations
+           << ",\n";
+    const std::pair<const char *, MeasurePercentiles> measures[] = {
+        {"frame_ms", result.frame_ms},
+        {"cpu_ms", result.cpu_ms},
+        {"gpu_ms", result.gpu_ms},
+        {"draw_calls", result.draw_calls},
+        {"triangles", result.triangles},
+        {"state_changes", result.state_changes}};
+    for (size_t m = 0; m < std::size(measures); m++) {
+      file << "      ";
+      write_percentiles(file, measures[m].first, measures[m].second);
+      file << (m + 1 < std::size(measures) ? ",\n" : "\n");
+    }
+    file << "    }";
+  }
+  file << (results.empty() ? "}\n}\n" : "\n  }\n}\n");
+  if (!file.good()) {
+    return 1;
+  }
+  std::cout << "Results written to " << outputPath << std::endl;
+  return 0;
+}
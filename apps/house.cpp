@@ -1,23 +1,63 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <glutils.hpp>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
-#define STB_IMAGE_IMPLEMENTATION
+#include <thread>
+#include <vector>
+
 #include "flycamera.hpp"
+#include "camerapath.hpp"
+#include "capturewriter.hpp"
+#include "dynamicresolution.hpp"
+#include "framestats.hpp"
+#include "glcontext.hpp"
+#include "glhooks.hpp"
+#include "gputimer.hpp"
+#include "housemesh.hpp"
+#include "jobsystem.hpp"
+#include "profiler.hpp"
+#include "readback.hpp"
+#include "rendertarget.hpp"
+#include "scene.hpp"
 #include "shader.hpp"
-#include "stb/stb_image.h"
+#include "shadercache.hpp"
+#include "simulation.hpp"
+#include "triplebuffer.hpp"
+#include "uploadring.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-// Config for the turn animation speed
-const int MIN_SPEED = 2;
-const int MAX_SPEED = 5;
+// Distance between the houses when placing them in a grid
+const float HOUSE_SPACING = 2.0f;
 // Camera movement speed with user input
 const float CAMERA_SPEED = 3.0f;
 
 const float WIN_WIDTH = 800.0f;
 const float WIN_HEIGHT = 600.0f;
 
+// Simulation ticks per second if no other rate is given
+const double DEFAULT_TICK_RATE = 60.0;
+
+// Frames rendered in headless mode if no other count is given
+const unsigned long DEFAULT_HEADLESS_FRAMES = 100;
+
+// Detail added back by the sharp upscale of the scene
+const float UPSCALE_SHARPNESS = 0.5f;
+// Largest scale of the dynamic resolution (drawing at twice the window size)
+const float MAX_RENDER_SCALE = 2.0f;
+
+// Longest time that the main thread waits for the render thread to take the
+// last frame before reading the input again
+const std::chrono::milliseconds MAX_INPUT_INTERVAL(4);
+
 // Auxiliary variables of the mouse controller
 bool firstMouse = true;
 float lastX = WIN_WIDTH / 2.0;
@@ -28,133 +68,110 @@ const glm::vec3 cameraPos = glm::vec3(0.0f, 1.0f, 8.0f);
 const glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 // Create the camera controller
 Camera camera = Camera(cameraPos, cameraUp);
-// Camera Field Of View
-float fov = 45.0f;
-
-GLuint texture_setup(const std::string &filepath) {
-  // Generate the OpenGL texture object
-  GLuint texture;
-  glGenTextures(1, &texture);
-  // Bind the texture to the texture unit 0
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  // Set the texture wrapping/filtering options
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // Load the texture data from file
-  int width, height, nrChannels;
-  unsigned char *data =
-      stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-  if (data) {
-    // Generate the 2D texture by setting the data and format
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, data);
-    // Generate all the Mipmap levels up to 1-pixel-size
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Error during texture data loading" << std::endl;
-  }
-  // Now we can free the source texture data
-  stbi_image_free(data);
-  return texture;
-}
 
-void set_up_roof() {
-  // Triangle vertices data
-  // Format: postion(x, y, z), color(r, g, b), texCoord(x, y)
-  constexpr float vertices[45] = {
-      -0.5f, 0.0f, 0.5f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f, // Left-front, Red
-      0.5f,  0.0f, 0.5f,  0.0f, 1.0f, 0.0f, 1.0f, 0.0f, // Right-front, Green
-      0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f, 0.5f, 1.0f, // Top-center, Blue
-      -0.5f, 0.0f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, // Left-back, Red
-      0.5f,  0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, // Right-back, Green
-  };
-  // Order to draw the unique vertices to form the roof pyramid
-  constexpr GLuint indices[12] = {
-      0, 2, 1, // Front
-      1, 2, 4, // Right
-      4, 2, 3, // Back
-      3, 2, 0  // Left
-  };
-  // Prepare the Element Buffer Object for `index drawing`
-  GLuint EBO;
-  glGenBuffers(1, &EBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // Push the vertex indexes into the buffer
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // Prepare the buffer to sed the vertex data
-  GLuint VBO;
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  // Push the vertex data into the buffer
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  // Prepare the vertex position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-  // Prepare the vertex color attribute
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  // Prepare the texture coordinates attribute
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
+// Camera flythrough recorded from the input, or played back instead of it.
+// Only the simulation ticks access it while they run
+enum class CameraPathMode { NONE, RECORD, PLAY };
+CameraPathMode cameraPathMode = CameraPathMode::NONE;
+CameraPath cameraPath;
+
+// Current framebuffer size, updated from the main thread callbacks. The
+// frames carry it to the render thread, which also reads it when it starts
+std::atomic<int> framebufferWidth = 0;
+std::atomic<int> framebufferHeight = 0;
+
+// Set by the main thread when the screenshot key is pressed, and cleared by
+// the render thread when it captures the next frame
+std::atomic<bool> screenshotRequested = false;
+
+// Set by the main thread when the stats key is pressed, and cleared by the
+// render thread when it reports them
+std::atomic<bool> statsRequested = false;
+
+// Input read by the main thread that is waiting to be consumed by the next
+// simulation tick, which may run in another thread
+struct PendingInput {
+  std::mutex mutex;
+  // Movement keys held, indexed by `CameraMovement`
+  bool moving[4] = {false, false, false, false};
+  // Offsets accumulated since the last tick
+  float mouse_x_offset = 0.0f;
+  float mouse_y_offset = 0.0f;
+  float scroll_offset = 0.0f;
+} pendingInput;
+
+// State advanced by the fixed-timestep simulation
+struct SimState {
+  glm::vec3 camera_position;
+  float camera_yaw;
+  float camera_pitch;
+  float camera_zoom;
+  // Simulated time that drives the houses animation
+  double time = 0.0;
+};
+
+// Everything the render thread needs to draw a frame. It is produced by the
+// main thread after processing the input and updating the scene
+struct FrameSnapshot {
+  glm::mat4 view;
+  glm::mat4 projection;
+  // Model matrices of the visible houses
+  std::vector<glm::mat4> instances;
+  size_t num_instances = 0;
+  int framebuffer_width = 0;
+  int framebuffer_height = 0;
+  // Time when the input used to build the frame was read
+  double input_time = 0.0;
+};
+
+SimState interpolate(const SimState &a, const SimState &b, float alpha) {
+  SimState state;
+  state.camera_position = glm::mix(a.camera_position, b.camera_position, alpha);
+  state.camera_yaw = a.camera_yaw + (b.camera_yaw - a.camera_yaw) * alpha;
+  state.camera_pitch =
+      a.camera_pitch + (b.camera_pitch - a.camera_pitch) * alpha;
+  state.camera_zoom = a.camera_zoom + (b.camera_zoom - a.camera_zoom) * alpha;
+  state.time = a.time + (b.time - a.time) * alpha;
+  return state;
 }
 
-void set_up_walls() {
-  // Rectangle walls unique vertices data
-  // Format: postion(x, y, z), color(r, g, b), texCoord(x, y)
-  constexpr float vertices[64] = {
-      0.5f,  0.0f,  0.5f,  0.0f, 1.0f, 0.0f, 1.0f, 1.0f, // Top-right-front
-      0.5f,  -0.5f, 0.5f,  0.0f, 1.0f, 1.0f, 1.0f, 0.0f, // Bottom-right-front
-      -0.5f, -0.5f, 0.5f,  1.0f, 0.0f, 1.0f, 0.0f, 0.0f, // Bottom-left-front
-      -0.5f, 0.0f,  0.5f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, // Top-left-front
-      0.5f,  0.0f,  -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, // Top-right-back
-      0.5f,  -0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, // Bottom-right-back
-      -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, // Bottom-left-back
-      -0.5f, 0.0f,  -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f  // Top-left-back
-  };
-  // Order to draw the unique vertices to form the walls cube
-  constexpr GLuint indices[24] = {
-      0, 1, 3, // Top-front triangle
-      1, 2, 3, // Bottom-front triangle
-      4, 5, 7, // Top-back triangle
-      5, 6, 7, // Bottom-back triangle
-      0, 4, 1, // Top-right triangle
-      1, 4, 5, // Bottom-right triangle
-      3, 2, 7, // Top-left triangle
-      2, 6, 7  // Bottom-left triangle
-  };
-  // Prepare the Element Buffer Object for `index drawing`
-  GLuint EBO;
-  glGenBuffers(1, &EBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // Push the vertex indexes into the buffer
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // Prepare the vertex buffer for the unique vertices data
-  GLuint VBO;
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  // Push the vertex data into the buffer
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  // Prepare the vertex position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-  // Prepare the vertex color attribute
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  // Prepare the texture coordinates attribute
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
+void simulation_tick(SimState &state, double dt) {
+  // Take the input received since the previous tick
+  bool moving[4];
+  float xoffset, yoffset, scroll;
+  {
+    std::lock_guard<std::mutex> lock(pendingInput.mutex);
+    std::copy(pendingInput.moving, pendingInput.moving + 4, moving);
+    xoffset = pendingInput.mouse_x_offset;
+    yoffset = pendingInput.mouse_y_offset;
+    scroll = pendingInput.scroll_offset;
+    pendingInput.mouse_x_offset = 0.0f;
+    pendingInput.mouse_y_offset = 0.0f;
+    pendingInput.scroll_offset = 0.0f;
+  }
+
+  state.time += dt;
+  if (cameraPathMode == CameraPathMode::PLAY) {
+    // Follow the recorded path, ignoring the input
+    cameraPath.apply(state.time, camera);
+  } else {
+    // Move the camera, which is only accessed by the simulation
+    if (xoffset != 0.0f || yoffset != 0.0f)
+      camera.ProcessMouseMovement(xoffset, yoffset);
+    if (scroll != 0.0f)
+      camera.ProcessMouseScroll(scroll);
+    for (int direction = FORWARD; direction <= RIGHT; direction++) {
+      if (moving[direction])
+        camera.ProcessKeyboard(static_cast<CameraMovement>(direction), dt);
+    }
+    if (cameraPathMode == CameraPathMode::RECORD)
+      cameraPath.record(state.time, camera);
+  }
+
+  state.camera_position = camera.Position;
+  state.camera_yaw = camera.Yaw;
+  state.camera_pitch = camera.Pitch;
+  state.camera_zoom = camera.Zoom;
 }
 
 void mouse_callback(GLFWwindow *window, double xposIn, double yposIn) {
@@ -173,59 +190,260 @@ void mouse_callback(GLFWwindow *window, double xposIn, double yposIn) {
   lastX = xpos;
   lastY = ypos;
 
-  camera.ProcessMouseMovement(xoffset, yoffset);
+  // Accumulate the movement until the next simulation tick
+  std::lock_guard<std::mutex> lock(pendingInput.mutex);
+  pendingInput.mouse_x_offset += xoffset;
+  pendingInput.mouse_y_offset += yoffset;
 }
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
-  camera.ProcessMouseScroll(static_cast<float>(yoffset));
+  std::lock_guard<std::mutex> lock(pendingInput.mutex);
+  pendingInput.scroll_offset += static_cast<float>(yoffset);
+}
+
+void framebuffer_resize_callback(GLFWwindow *window, int width, int height) {
+  // The main thread doesn't own the OpenGL context, so the viewport is
+  // updated by the render thread with the size stored in the next frame
+  framebufferWidth = width;
+  framebufferHeight = height;
 }
 
-int main() {
-  // Initialize the window manager
-  if (!glfwInit()) {
-    std::cout << "GLFW could not be initialized" << std::endl;
-    exit(EXIT_FAILURE);
+int main(int argc, char *argv[]) {
+  // Usage: house [num_houses] [--tick-rate HZ] [--sim-thread]
+  //              [--headless WxH [--frames N] [--output file.ppm]]
+  //              [--capture out.ppm|out.png|out.y4m] [--profile trace.json]
+  //              [--stats stats.json] [--gl-check]
+  //              [--record-camera path.cam | --play-camera path.cam]
+  //              [--dynamic-res TARGET_MS [--min-scale S] [--max-scale S]]
+  //              [--upscale linear|sharp] [--depth-prepass] [--unsorted]
+  //              [--shader-cache DIR]
+  // The number of houses can be increased to stress the CPU side. The
+  // headless mode renders N frames offscreen without a window, for batch
+  // runs and CI machines without display. In the window, F12 saves a
+  // screenshot of the current frame. The capture saves every rendered frame
+  // as an image sequence or a video, and the profile writes the CPU zones of
+  // each thread as a Chrome trace. The stats of the last frames are reported
+  // at exit (and with F9), also as JSON and CSV files if requested. In builds
+  // with GLUTILS_GL_HOOKS the GL calls per frame are reported at exit, and
+  // --gl-check reports the GL errors after each call. The camera path can be
+  // recorded while flying, and played back instead of the input to render
+  // the same frames again (in headless mode, the whole path by default). In
+  // the window, dynamic resolution lowers the scale the scene is drawn at
+  // (0.5 to 1 of the window size by default) when the GPU time of a frame is
+  // over the target, and the scene is upscaled to the window with a bilinear
+  // or a sharpened filter. The depth pre-pass draws the depth of the houses
+  // first, so the textured pass only shades the visible fragments. The
+  // houses are drawn front to back unless unsorted. The program binaries of
+  // the shaders are kept in DIR (shader_cache by default, none if empty) to
+  // be loaded instead of compiled by the next runs
+  size_t num_houses = 0;
+  double tickRate = DEFAULT_TICK_RATE;
+  bool simThread = false;
+  bool headless = false;
+  int headlessWidth = 0, headlessHeight = 0;
+  unsigned long numFrames = 0;
+  std::string outputPath;
+  std::string capturePath;
+  std::string profilePath;
+  std::string statsPath;
+  bool glCheck = false;
+  std::string cameraPathFile;
+  bool dynamicRes = false;
+  DynamicResolutionSettings resolutionSettings;
+  bool sharpUpscale = false;
+  bool depthPrepass = false;
+  bool sortHouses = true;
+  std::string shaderCacheDir = "shader_cache";
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--tick-rate" && i + 1 < argc)
+      tickRate = std::stod(argv[++i]);
+    else if (arg == "--sim-thread")
+      simThread = true;
+    else if (arg == "--headless" && i + 1 < argc) {
+      headless = std::sscanf(argv[++i], "%dx%d", &headlessWidth,
+                             &headlessHeight) == 2 &&
+                 headlessWidth > 0 && headlessHeight > 0;
+      if (!headless) {
+        std::cout << "Invalid headless size " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (arg == "--frames" && i + 1 < argc)
+      numFrames = std::stoul(argv[++i]);
+    else if (arg == "--output" && i + 1 < argc)
+      outputPath = argv[++i];
+    else if (arg == "--capture" && i + 1 < argc)
+      capturePath = argv[++i];
+    else if (arg == "--profile" && i + 1 < argc)
+      profilePath = argv[++i];
+    else if (arg == "--stats" && i + 1 < argc)
+      statsPath = argv[++i];
+    else if (arg == "--gl-check")
+      glCheck = true;
+    else if (arg == "--record-camera" && i + 1 < argc) {
+      cameraPathMode = CameraPathMode::RECORD;
+      cameraPathFile = argv[++i];
+    } else if (arg == "--play-camera" && i + 1 < argc) {
+      cameraPathMode = CameraPathMode::PLAY;
+      cameraPathFile = argv[++i];
+    } else if (arg == "--dynamic-res" && i + 1 < argc) {
+      dynamicRes = true;
+      resolutionSettings.target_ms = std::stod(argv[++i]);
+    } else if (arg == "--min-scale" && i + 1 < argc)
+      resolutionSettings.min_scale = std::stof(argv[++i]);
+    else if (arg == "--max-scale" && i + 1 < argc)
+      resolutionSettings.max_scale = std::stof(argv[++i]);
+    else if (arg == "--upscale" && i + 1 < argc) {
+      const std::string filter = argv[++i];
+      sharpUpscale = filter == "sharp";
+      if (!sharpUpscale && filter != "linear") {
+        std::cout << "Unknown upscale filter " << filter << std::endl;
+        return 1;
+      }
+    } else if (arg == "--depth-prepass")
+      depthPrepass = true;
+    else if (arg == "--shader-cache" && i + 1 < argc)
+      shaderCacheDir = argv[++i];
+    else if (arg == "--unsorted")
+      sortHouses = false;
+    else if (!arg.empty() &&
+             arg.find_first_not_of("0123456789") == std::string::npos)
+      num_houses = std::stoul(arg);
+    else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return 1;
+    }
   }
-  // Set the OpenGL version to 3.3 with core-profile
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-
-  // Initialize the window
-  GLFWwindow *window =
-      glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "OpenGL Sandbox", NULL, NULL);
-  if (!window) {
-    glfwTerminate();
-    exit(EXIT_FAILURE);
+  if (resolutionSettings.min_scale <= 0.0f ||
+      resolutionSettings.min_scale > resolutionSettings.max_scale ||
+      resolutionSettings.max_scale > MAX_RENDER_SCALE ||
+      resolutionSettings.target_ms <= 0.0) {
+    std::cout << "Invalid dynamic resolution settings" << std::endl;
+    return 1;
   }
-  // Capture the mouse when focusing the window
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-  // Set the window as the OpenGL context
-  glfwMakeContextCurrent(window);
+  profiler_enable(!profilePath.empty());
+  gl_hooks_check_errors(glCheck);
 
-  // Load OpenGL
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    glfwTerminate();
-    return 1;
+  if (cameraPathMode == CameraPathMode::PLAY) {
+    if (!cameraPath.load(cameraPathFile))
+      return 1;
+    cameraPath.apply(0.0f, camera);
+    // Render up to the end of the path
+    if (numFrames == 0)
+      numFrames = std::ceil(cameraPath.duration() * tickRate) + 1;
+  } else if (cameraPathMode == CameraPathMode::RECORD) {
+    cameraPath.record(0.0f, camera);
   }
+  if (numFrames == 0)
+    numFrames = DEFAULT_HEADLESS_FRAMES;
+  profiler_thread_name("Main");
 
-  // Ensure that the OpenGL viewport is adjusted to the window size
-  int frameWidth, frameHeight;
-  glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
-  glViewport(0, 0, frameWidth, frameHeight);
-  // Set a callback to adjust the viewport when resizing the window
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  // The captured frames are read back asynchronously and written to disk by
+  // background threads. The video plays at the simulation rate
+  std::unique_ptr<CaptureWriter> captureWriter;
+  if (!capturePath.empty()) {
+    captureWriter = std::make_unique<CaptureWriter>(
+        capturePath, static_cast<int>(std::round(tickRate)));
+    if (!captureWriter->valid())
+      return 1;
+  }
+  auto make_capture_readback = [&](int width, int height) {
+    return std::make_unique<FrameReadback>(
+        width, height,
+        [&](const unsigned char *rgba, int width, int height,
+            unsigned long long frame) {
+          captureWriter->submit(rgba, width, height, frame);
+        });
+  };
+
+  GLFWwindow *window = NULL;
+  HeadlessContext headlessContext;
+  // Offscreen framebuffer that replaces the window in headless mode
+  std::unique_ptr<RenderTarget> renderTarget;
+  if (headless) {
+    if (!headlessContext.create(3, 3)) {
+      return 1;
+    }
+    framebufferWidth = headlessWidth;
+    framebufferHeight = headlessHeight;
+    renderTarget =
+        std::make_unique<RenderTarget>(framebufferWidth, framebufferHeight);
+    renderTarget->bind();
+  } else {
+    // Initialize the window manager
+    if (!glfwInit()) {
+      std::cout << "GLFW could not be initialized" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    // Set the OpenGL version to 3.3 with core-profile
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    // Initialize the window
+    window =
+        glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "OpenGL Sandbox", NULL, NULL);
+    if (!window) {
+      glfwTerminate();
+      exit(EXIT_FAILURE);
+    }
+    // Capture the mouse when focusing the window
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+    // Set the window as the OpenGL context
+    glfwMakeContextCurrent(window);
+
+    // Load OpenGL
+    if (!load_gl((GLADloadproc)glfwGetProcAddress)) {
+      glfwTerminate();
+      return 1;
+    }
+
+    // Ensure that the OpenGL viewport is adjusted to the window size
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    framebufferWidth = width;
+    framebufferHeight = height;
+    glViewport(0, 0, width, height);
+    // Set a callback to adjust the viewport when resizing the window
+    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+  }
   // Set the color to clear the screen
   glClearColor(0.25f, 0.5f, 0.75f, 1.0f);
 
   // Enable Z-buffer
   glEnable(GL_DEPTH_TEST);
 
-  Shader shader = Shader("../../src/shaders/house/house.vert",
-                         "../../src/shaders/house/house.frag");
+  // The houses are tinted by their vertex colors, and their model matrices
+  // are instance attributes
+  auto shaders = std::make_unique<ShaderCache>(
+      "../../src/shaders/common/surface.vert",
+      "../../src/shaders/common/surface.frag", shaderCacheDir);
+  const GLuint houseProgram =
+      shaders->program(SHADER_VERTEX_COLOR | SHADER_INSTANCED);
+
+  // Prepare the houses data (by default the original 6 houses layout)
+  HouseInstances houses;
+  if (num_houses > 0) {
+    houses = make_house_grid(num_houses, HOUSE_SPACING);
+  } else {
+    const glm::vec3 house_positions[6] = {
+        glm::vec3(2.0f, 0.0f, -1.0f),  glm::vec3(-1.0f, 0.0f, 0.5f),
+        glm::vec3(0.9f, 0.0f, 1.0f),   glm::vec3(0.7f, 0.0f, -3.0f),
+        glm::vec3(-2.0f, 0.0f, -2.0f), glm::vec3(-0.8f, 0.0f, -6.0f)};
+    for (size_t i = 0; i < 6; i++) {
+      houses.add(house_positions[i], house_turn_speed(i));
+    }
+  }
+  // Ring buffer to stream the model matrices of the visible houses
+  auto instanceRing = std::make_unique<UploadRing>(
+      GL_ARRAY_BUFFER, houses.size() * sizeof(glm::mat4));
+
+  // Worker threads for the per-object update stages
+  JobSystem jobs;
+  VisibleSet visible;
 
   // Prepare the roof texture
   GLuint roof_tex = texture_setup("../../textures/roof.png");
@@ -234,6 +452,7 @@ int main() {
   glGenVertexArrays(1, &roof_VAO);
   glBindVertexArray(roof_VAO);
   set_up_roof();
+  set_up_instances(instanceRing->buffer());
 
   // Prepare the walls texture
   GLuint wall_tex = texture_setup("../../textures/container.jpg");
@@ -242,104 +461,577 @@ int main() {
   glGenVertexArrays(1, &walls_VAO);
   glBindVertexArray(walls_VAO);
   set_up_walls();
-
-  glm::vec3 house_positions[6] = {
-      glm::vec3(2.0f, 0.0f, -1.0f),  glm::vec3(-1.0f, 0.0f, 0.5f),
-      glm::vec3(0.9f, 0.0f, 1.0f),   glm::vec3(0.7f, 0.0f, -3.0f),
-      glm::vec3(-2.0f, 0.0f, -2.0f), glm::vec3(-0.8f, 0.0f, -6.0f)};
+  set_up_instances(instanceRing->buffer());
 
   // Get uniform variables locations to update them in the render loop
-  GLuint texLoc = glGetUniformLocation(shader.ID, "baseTexture");
-  GLuint modelLoc = glGetUniformLocation(shader.ID, "model");
-  GLuint viewLoc = glGetUniformLocation(shader.ID, "view");
-  GLuint projectionLoc = glGetUniformLocation(shader.ID, "projection");
+  GLuint texLoc = glGetUniformLocation(houseProgram, "baseTexture");
+  GLuint viewLoc = glGetUniformLocation(houseProgram, "view");
+  GLuint projectionLoc = glGetUniformLocation(houseProgram, "projection");
+
+  // The depth pre-pass reads only the positions, from their own buffers
+  std::unique_ptr<Shader> depthShader;
+  GLuint roof_depth_VAO = 0, walls_depth_VAO = 0;
+  GLuint depthViewLoc = 0, depthProjectionLoc = 0;
+  if (depthPrepass) {
+    depthShader =
+        std::make_unique<Shader>("../../src/shaders/house/depth_instanced.vert",
+                                 "../../src/shaders/house/depth.frag");
+    depthViewLoc = glGetUniformLocation(depthShader->ID, "view");
+    depthProjectionLoc = glGetUniformLocation(depthShader->ID, "projection");
+    glGenVertexArrays(1, &roof_depth_VAO);
+    glBindVertexArray(roof_depth_VAO);
+    set_up_roof_positions();
+    set_up_instances(instanceRing->buffer());
+    glGenVertexArrays(1, &walls_depth_VAO);
+    glBindVertexArray(walls_depth_VAO);
+    set_up_walls_positions();
+    set_up_instances(instanceRing->buffer());
+  }
+
+  // Camera of the rendered frames, at the interpolated pose of the simulated
+  // camera. The visible set is kept while it doesn't change and the order
+  // while it barely moves, since the houses don't move
+  Camera viewCamera;
+  unsigned long long culledVersion = 0;
+  DrawOrder drawOrder;
+
+  // Builds the camera matrices and the visible instances for a state
+  auto prepare_frame = [&](FrameSnapshot &frame, const SimState &state) {
+    PROFILE_ZONE("Prepare frame");
+    frame.framebuffer_width = framebufferWidth;
+    frame.framebuffer_height = framebufferHeight;
+    // The projection follows the aspect ratio of the framebuffer, so it is
+    // only rebuilt after a resize (the size is empty while minimized)
+    if (frame.framebuffer_width > 0 && frame.framebuffer_height > 0)
+      viewCamera.SetPerspective(static_cast<float>(frame.framebuffer_width) /
+                                frame.framebuffer_height);
+    viewCamera.Position = state.camera_position;
+    viewCamera.Zoom = state.camera_zoom;
+    viewCamera.SetOrientation(state.camera_yaw, state.camera_pitch);
+    frame.view = viewCamera.GetViewMatrix();
+    frame.projection = viewCamera.GetProjectionMatrix();
+
+    // Update the houses: the transforms and the culling run in parallel and
+    // the instance fill starts once both are done
+    frame.instances.resize(houses.size());
+    JobCounter transforms_done, culling_done, instances_done;
+    update_transforms(jobs, houses, state.time, transforms_done);
+    if (viewCamera.GetVersion() != culledVersion) {
+      cull_houses(jobs, houses, viewCamera.GetFrustum(), visible,
+                  culling_done);
+      jobs.wait(culling_done);
+      culledVersion = viewCamera.GetVersion();
+    }
+    // Every frame, so the sort decides itself when the camera moved enough
+    // for a new order
+    if (sortHouses)
+      sort_front_to_back(jobs, houses, visible, viewCamera.Position,
+                         viewCamera.Front, viewCamera.FarPlane, drawOrder);
+    if (sortHouses)
+      fill_sorted_instances(jobs, houses, visible, drawOrder,
+                            frame.instances.data(), instances_done,
+                            transforms_done);
+    else
+      fill_instances(jobs, houses, visible, frame.instances.data(),
+                     instances_done, transforms_done);
+    jobs.wait(instances_done);
+    jobs.wait(transforms_done);
+    frame.num_instances = visible.count;
+  };
+
+  auto report_order = [&]() {
+    if (sortHouses)
+      std::cout << "Front to back order: " << drawOrder.num_sorts
+                << " sorts, reused " << drawOrder.num_reused << " times"
+                << std::endl;
+  };
+
+  // Measures of the last frames, recorded by the thread that renders them
+  FrameStats frameStats;
+  auto report_stats = [&]() {
+    frameStats.print_summary();
+    if (!statsPath.empty()) {
+      frameStats.write_json(statsPath);
+      frameStats.write_csv(statsPath.substr(0, statsPath.rfind('.')) + ".csv");
+    }
+  };
+
+  // Scale of the scene in the window, driven by the GPU time of the frames
+  std::unique_ptr<DynamicResolution> dynamicResolution;
+  if (dynamicRes && !headless)
+    dynamicResolution =
+        std::make_unique<DynamicResolution>(resolutionSettings);
+
+  // GPU time of the passes, for the stats, the profile and the dynamic
+  // resolution
+  std::unique_ptr<GpuTimer> gpuTimer;
+  auto make_gpu_timer = [&]() {
+    gpuTimer = std::make_unique<GpuTimer>();
+    gpuTimer->set_frame_callback(
+        [&](unsigned long long frame, double milliseconds) {
+          frameStats.set_gpu_time(frame, milliseconds);
+          if (dynamicResolution)
+            dynamicResolution->update(frame, milliseconds);
+        });
+  };
+  auto begin_gpu_pass = [&](const char *name) {
+    if (gpuTimer)
+      gpuTimer->begin_pass(name);
+  };
+  auto end_gpu_pass = [&]() {
+    if (gpuTimer)
+      gpuTimer->end_pass();
+  };
+
+  // Submits the draw calls of a frame to the current framebuffer
+  auto draw_frame = [&](const FrameSnapshot &frame, FrameSample &sample) {
+    PROFILE_ZONE("Draw submission");
+    begin_gpu_pass("Houses");
+    // Clear the screen
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Write the model matrices of the visible houses in the region of this
+    // frame, which the GPU is not using anymore
+    instanceRing->begin_frame();
+    const size_t instancesSize = frame.num_instances * sizeof(glm::mat4);
+    UploadRing::Allocation instances = instanceRing->allocate(instancesSize);
+    std::memcpy(instances.data, frame.instances.data(), instancesSize);
+    instanceRing->commit();
+    // Point the instance attributes to the new data
+    glBindVertexArray(roof_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+    glBindVertexArray(walls_VAO);
+    point_instances(instanceRing->buffer(), instances.offset);
+
+    if (depthShader) {
+      begin_gpu_pass("Depth pre-pass");
+      glBindVertexArray(roof_depth_VAO);
+      point_instances(instanceRing->buffer(), instances.offset);
+      glBindVertexArray(walls_depth_VAO);
+      point_instances(instanceRing->buffer(), instances.offset);
+      depthShader->use();
+      glUniformMatrix4fv(depthViewLoc, 1, GL_FALSE,
+                         glm::value_ptr(frame.view));
+      glUniformMatrix4fv(depthProjectionLoc, 1, GL_FALSE,
+                         glm::value_ptr(frame.projection));
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      glBindVertexArray(roof_depth_VAO);
+      glDrawElementsInstanced(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT,
+                              0, frame.num_instances);
+      glBindVertexArray(walls_depth_VAO);
+      glDrawElementsInstanced(GL_TRIANGLES, WALLS_NUM_INDICES,
+                              GL_UNSIGNED_INT, 0, frame.num_instances);
+      // Shade only the fragments that ended up in the depth buffer
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      glDepthFunc(GL_EQUAL);
+      glDepthMask(GL_FALSE);
+      sample.triangles +=
+          (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3 * frame.num_instances;
+      end_gpu_pass();
+    }
+
+    // Prepare the shaders to draw
+    glUseProgram(houseProgram);
+
+    // Set the camera data for the shader
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(frame.view));
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE,
+                       glm::value_ptr(frame.projection));
+
+    // Draw all the visible roofs
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, roof_tex);
+    glUniform1i(texLoc, 0);
+    glBindVertexArray(roof_VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT,
+                            0, frame.num_instances);
+    sample.triangles += ROOF_NUM_INDICES / 3 * frame.num_instances;
+
+    // Draw all the visible walls
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, wall_tex);
+    glUniform1i(texLoc, 0);
+    glBindVertexArray(walls_VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, WALLS_NUM_INDICES, GL_UNSIGNED_INT,
+                            0, frame.num_instances);
+    sample.triangles += WALLS_NUM_INDICES / 3 * frame.num_instances;
+
+    // Restore the depth writes, also needed to clear the depth
+    if (depthShader) {
+      glDepthFunc(GL_LESS);
+      glDepthMask(GL_TRUE);
+    }
+
+    // Protect the instances region until the draws are done
+    instanceRing->end_frame();
+    end_gpu_pass();
+  };
+
+  SimState initialState;
+  initialState.camera_position = camera.Position;
+  initialState.camera_yaw = camera.Yaw;
+  initialState.camera_pitch = camera.Pitch;
+  initialState.camera_zoom = camera.Zoom;
+
+  if (headless) {
+    // Render the frames as fast as possible, with exactly one simulation tick
+    // per frame so the output doesn't depend on the speed of the machine
+    SimState state = initialState;
+    FrameSnapshot frame;
+    std::unique_ptr<FrameReadback> captureReadback;
+    if (captureWriter)
+      captureReadback = make_capture_readback(headlessWidth, headlessHeight);
+    make_gpu_timer();
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t lastFrameStart = profiler_now();
+    for (unsigned long i = 0; i < numFrames; i++) {
+      profiler_frame_mark();
+      const uint64_t frameStart = profiler_now();
+      FrameSample sample;
+      sample.frame = i;
+      sample.frame_ms = (frameStart - lastFrameStart) / 1e6;
+      lastFrameStart = frameStart;
+
+      gpuTimer->begin_frame();
+      simulation_tick(state, 1.0 / tickRate);
+      prepare_frame(frame, state);
+      draw_frame(frame, sample);
+      if (captureReadback) {
+        begin_gpu_pass("Readback");
+        captureReadback->capture(i);
+        end_gpu_pass();
+      }
+      gpuTimer->end_frame();
+
+      sample.cpu_ms = (profiler_now() - frameStart) / 1e6;
+      gl_hooks_frame_mark();
+      sample.draw_calls = gl_hooks_frame_draw_calls();
+      sample.state_changes = gl_hooks_frame_state_changes();
+      frameStats.record(sample);
+    }
+    // Wait for the GPU to account for all the rendering work
+    if (captureReadback)
+      captureReadback->flush();
+    glFinish();
+    profiler_frame_mark();
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    std::cout << "Rendered " << numFrames << " frames at " << headlessWidth
+              << "x" << headlessHeight << " in " << elapsed << " s ("
+              << elapsed / numFrames * 1000.0 << " ms/frame, "
+              << numFrames / elapsed << " fps)" << std::endl;
+    report_order();
+
+    bool saved = true;
+    if (!outputPath.empty()) {
+      const std::vector<unsigned char> pixels =
+          read_pixels_rgb(headlessWidth, headlessHeight);
+      saved = write_ppm(outputPath, headlessWidth, headlessHeight,
+                        pixels.data());
+    }
+
+    // Release the OpenGL resources while the context is still current
+    gpuTimer->finish();
+    if (!profilePath.empty())
+      gpuTimer->print_summary();
+    gpuTimer.reset();
+    gl_hooks_print_summary();
+    captureReadback.reset();
+    instanceRing.reset();
+    renderTarget.reset();
+    shaders->print_summary();
+    shaders.reset();
+    if (depthShader)
+      glDeleteProgram(depthShader->ID);
+    if (captureWriter) {
+      // Wait for the writers to empty the queue
+      captureWriter->finish();
+      std::cout << "Captured " << captureWriter->num_written() << " frames to "
+                << capturePath << " (" << captureWriter->num_blocked()
+                << " waits for the writers)" << std::endl;
+    }
+    if (!profilePath.empty()) {
+      profiler_print_summary();
+      profiler_write_chrome_trace(profilePath);
+    }
+    report_stats();
+    if (cameraPathMode == CameraPathMode::RECORD)
+      saved = cameraPath.save(cameraPathFile) && saved;
+    return saved ? 0 : 1;
+  }
 
   // Set mouse handling callback
   glfwSetCursorPosCallback(window, mouse_callback);
   glfwSetScrollCallback(window, scroll_callback);
 
-  // Keep track of the elapsed time to control movement speed
-  float lastFrameTime = 0.0f;
+  // From now on the render thread owns the OpenGL context, while the main
+  // thread reads the input and prepares the frames to draw
+  glfwMakeContextCurrent(NULL);
+  TripleBuffer<FrameSnapshot> frames;
+
+  std::thread render_thread([&]() {
+    profiler_thread_name("Render");
+    glfwMakeContextCurrent(window);
+    int viewportWidth = framebufferWidth;
+    int viewportHeight = framebufferHeight;
+    // Keep track of the time between reading the input and submitting the
+    // draw calls that use it
+    double totalLatency = 0.0;
+    double maxLatency = 0.0;
+    unsigned long long renderedFrames = 0;
+    // Screenshots are read back asynchronously and saved a few frames later,
+    // so taking one doesn't stall the rendering
+    auto screenshots = std::make_unique<FrameReadback>(
+        viewportWidth, viewportHeight,
+        [](const unsigned char *rgba, int width, int height,
+           unsigned long long frame) {
+          const std::string path =
+              "screenshot_" + std::to_string(frame) + ".ppm";
+          if (write_ppm(path, width, height,
+                        readback_to_rgb(rgba, width, height).data()))
+            std::cout << "Saved " << path << std::endl;
+        });
+    std::unique_ptr<FrameReadback> captureReadback;
+    if (captureWriter)
+      captureReadback = make_capture_readback(viewportWidth, viewportHeight);
+    // The scene is drawn offscreen and upscaled to the window. The target
+    // has room for the largest scale, and the frames use the region of the
+    // current scale
+    const float maxScale =
+        dynamicResolution ? resolutionSettings.max_scale : 1.0f;
+    auto target_size = [&](int size) {
+      return std::max(1, static_cast<int>(std::ceil(size * maxScale)));
+    };
+    auto sceneTarget = std::make_unique<ResizableTarget>(
+        target_size(viewportWidth), target_size(viewportHeight));
+    double totalScale = 0.0;
+    std::unique_ptr<Shader> upscaleShader;
+    GLuint upscaleVAO = 0;
+    if (sharpUpscale) {
+      upscaleShader = std::make_unique<Shader>(
+          "../../src/shaders/house/upscale.vert",
+          "../../src/shaders/house/upscale_sharp.frag");
+      // The vertices of the full screen triangle come from their index
+      glGenVertexArrays(1, &upscaleVAO);
+    }
+    // Draws the region of the target to the whole window
+    auto upscale = [&](const RenderTarget &target, FrameSample &sample) {
+      if (!upscaleShader) {
+        target.blit_to(0, viewportWidth, viewportHeight);
+        return;
+      }
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0, 0, viewportWidth, viewportHeight);
+      glDisable(GL_DEPTH_TEST);
+      upscaleShader->use();
+      upscaleShader->setInt("source", 0);
+      glUniform2f(glGetUniformLocation(upscaleShader->ID, "sourceScale"),
+                  static_cast<float>(target.viewport_width()) / target.width(),
+                  static_cast<float>(target.viewport_height()) /
+                      target.height());
+      glUniform2f(glGetUniformLocation(upscaleShader->ID, "texelSize"),
+                  1.0f / target.width(), 1.0f / target.height());
+      upscaleShader->setFloat("sharpness", UPSCALE_SHARPNESS);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, target.color_texture());
+      glBindVertexArray(upscaleVAO);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      glEnable(GL_DEPTH_TEST);
+      sample.triangles++;
+    };
+    make_gpu_timer();
+    uint64_t lastFrameStart = profiler_now();
+
+    while (const FrameSnapshot *frame = frames.acquire()) {
+      profiler_frame_mark();
+      const uint64_t frameStart = profiler_now();
+      FrameSample sample;
+      sample.frame = renderedFrames;
+      sample.frame_ms = (frameStart - lastFrameStart) / 1e6;
+      lastFrameStart = frameStart;
+      gpuTimer->begin_frame();
+      // Follow the window size. The scene target is reallocated once the
+      // size settles, and is stretched to the window until then
+      if (frame->framebuffer_width != viewportWidth ||
+          frame->framebuffer_height != viewportHeight) {
+        viewportWidth = frame->framebuffer_width;
+        viewportHeight = frame->framebuffer_height;
+        sceneTarget->resize(target_size(viewportWidth),
+                            target_size(viewportHeight));
+        screenshots->resize(viewportWidth, viewportHeight);
+        if (captureReadback)
+          captureReadback->resize(viewportWidth, viewportHeight);
+      }
+
+      // Until a resize settles the target has the previous size, so the
+      // region is relative to it
+      RenderTarget &target = sceneTarget->begin_frame();
+      const float scale = dynamicResolution
+                              ? dynamicResolution->begin_frame(renderedFrames)
+                              : 1.0f;
+      totalScale += scale;
+      target.set_viewport(std::lround(target.width() * scale / maxScale),
+                          std::lround(target.height() * scale / maxScale));
+      target.bind();
+      draw_frame(*frame, sample);
+      begin_gpu_pass("Upscale");
+      upscale(target, sample);
+      end_gpu_pass();
+
+      // Copy the frame for the screenshot before swapping the buffers, and
+      // save the previous ones that are ready
+      if (screenshotRequested.exchange(false))
+        screenshots->capture(renderedFrames);
+      else
+        screenshots->poll();
+      if (captureReadback) {
+        begin_gpu_pass("Readback");
+        captureReadback->capture(renderedFrames);
+        end_gpu_pass();
+      }
+      gpuTimer->end_frame();
+      sample.cpu_ms = (profiler_now() - frameStart) / 1e6;
+      gl_hooks_frame_mark();
+      sample.draw_calls = gl_hooks_frame_draw_calls();
+      sample.state_changes = gl_hooks_frame_state_changes();
+      frameStats.record(sample);
+      if (statsRequested.exchange(false))
+        report_stats();
+
+      // All the draw calls of the frame are submitted
+      const double latency = glfwGetTime() - frame->input_time;
+      totalLatency += latency;
+      maxLatency = std::max(maxLatency, latency);
+      renderedFrames++;
+
+      // Display the updated rendered data
+      PROFILE_ZONE("Swap buffers");
+      glfwSwapBuffers(window);
+    }
+
+    if (renderedFrames > 0) {
+      std::cout << "Rendered " << renderedFrames << " frames ("
+                << frames.num_dropped() << " dropped)" << std::endl;
+      std::cout << "Input to submission latency: avg "
+                << totalLatency / renderedFrames * 1000.0 << " ms, max "
+                << maxLatency * 1000.0 << " ms" << std::endl;
+      if (dynamicResolution)
+        std::cout << "Render scale: avg " << totalScale / renderedFrames
+                  << ", last " << dynamicResolution->scale() << " ("
+                  << dynamicResolution->num_drops() << " drops)" << std::endl;
+    }
+
+    // Release the OpenGL resources while the context is still current
+    gpuTimer->finish();
+    if (!profilePath.empty())
+      gpuTimer->print_summary();
+    gpuTimer.reset();
+    gl_hooks_print_summary();
+    report_stats();
+    screenshots->flush();
+    screenshots.reset();
+    if (captureReadback)
+      captureReadback->flush();
+    captureReadback.reset();
+    sceneTarget.reset();
+    if (upscaleShader) {
+      glDeleteProgram(upscaleShader->ID);
+      glDeleteVertexArrays(1, &upscaleVAO);
+    }
+    instanceRing.reset();
+    shaders->print_summary();
+    shaders.reset();
+    if (depthShader)
+      glDeleteProgram(depthShader->ID);
+    glfwMakeContextCurrent(NULL);
+  });
 
+  // The camera and the animation advance with a fixed time step, in the main
+  // thread or in their own thread
+  auto simulation = std::make_unique<Simulation<SimState>>(
+      tickRate, initialState, simulation_tick, simThread);
+
+  bool screenshotKeyDown = false;
+  bool statsKeyDown = false;
   while (!glfwWindowShouldClose(window)) {
     // Read used input
-    glfwPollEvents();
+    {
+      PROFILE_ZONE("Poll events");
+      glfwPollEvents();
+    }
+    const double inputTime = glfwGetTime();
 
-    // Clear the screen
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Take a screenshot when the key is pressed (not while held)
+    const bool screenshotKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+    if (screenshotKey && !screenshotKeyDown)
+      screenshotRequested = true;
+    screenshotKeyDown = screenshotKey;
+    // Report the stats of the last frames
+    const bool statsKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+      statsRequested = true;
+    statsKeyDown = statsKey;
 
-    // Prepare the shaders to draw
-    shader.use();
-
-    // Compute elapsed time between frames
-    const float currentFrameTime = glfwGetTime();
-    const float deltaTime = currentFrameTime - lastFrameTime;
-    lastFrameTime = currentFrameTime;
-
-    const float cameraSpeed = CAMERA_SPEED * deltaTime;
-    // Process user input to move the camera
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::RIGHT, deltaTime);
+    // Store the movement keys state for the next simulation ticks
+    {
+      std::lock_guard<std::mutex> lock(pendingInput.mutex);
+      pendingInput.moving[FORWARD] =
+          glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+      pendingInput.moving[BACKWARD] =
+          glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+      pendingInput.moving[LEFT] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+      pendingInput.moving[RIGHT] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    }
 
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
       break; // Exit the program loop
 
-    // Create the LooAt matrix for the camera
-    glm::mat4 view = camera.GetViewMatrix();
-
-    // Create the perspective projection matrix
-    glm::mat4 projection = glm::perspective(
-        glm::radians(fov), WIN_WIDTH / WIN_HEIGHT, 0.1f, 100.0f);
-
-    int speed_idx = 0;
-    bool invert_turn = false;
-    // Draw each house in its corresponding postion using the model transform
-    for (glm::vec3 &house_pos : house_positions) {
-      // Initialize the transform matrix with the identity matrix
-      glm::mat4 model = glm::mat4(1.0f);
-      // Apply translation between rotations
-      model = glm::translate(model, house_pos);
-      // Apply rotation over Y-axis using the elapsed time
-      const float rotation =
-          (speed_idx % MAX_SPEED + MIN_SPEED) * glfwGetTime();
-      model = glm::rotate(model, invert_turn ? -rotation : rotation,
-                          glm::vec3(0.0f, 1.0f, 0.0f));
-      speed_idx++;
-      invert_turn = !invert_turn;
-      // Set transform data for the shader
-      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-      glUniformMatrix4fv(projectionLoc, 1, GL_FALSE,
-                         glm::value_ptr(projection));
-
-      // Bind the roof texture
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, roof_tex);
-      glUniform1i(texLoc, 0);
-      // Draw the roof
-      glBindVertexArray(roof_VAO);
-      glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_INT, 0);
-
-      // Bind the walls texture
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, wall_tex);
-      glUniform1i(texLoc, 0);
-      // Draw the walls
-      glBindVertexArray(walls_VAO);
-      glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, 0);
+    // Run the ticks that are due and get the state to render, interpolated
+    // between the last two ticks
+    SimState state;
+    {
+      PROFILE_ZONE("Simulation");
+      simulation->update();
+      state = simulation->sample();
     }
 
-    // Display the updated rendered data
-    glfwSwapBuffers(window);
+    // Prepare the next frame in the free slot
+    FrameSnapshot &frame = frames.write_slot();
+    prepare_frame(frame, state);
+    frame.input_time = inputTime;
+    frames.publish();
+
+    // Don't prepare frames faster than they are rendered, but keep reading
+    // the input while waiting
+    frames.wait_consumed(MAX_INPUT_INTERVAL);
+  }
+
+  // Stop the render thread before destroying the window
+  frames.close();
+  render_thread.join();
+  report_order();
+  // Stop the ticks before saving the camera path they record
+  simulation.reset();
+  bool saved = true;
+  if (cameraPathMode == CameraPathMode::RECORD) {
+    saved = cameraPath.save(cameraPathFile);
+    std::cout << "Recorded " << cameraPath.duration() << " s of camera path ("
+              << cameraPath.size() << " poses) to " << cameraPathFile
+              << std::endl;
   }
 
-  glDeleteProgram(shader.ID);
   glfwTerminate();
-  return 0;
+  if (!profilePath.empty()) {
+    profiler_print_summary();
+    profiler_write_chrome_trace(profilePath);
+  }
+  if (captureWriter) {
+    // Wait for the writers to empty the queue
+    captureWriter->finish();
+    std::cout << "Captured " << captureWriter->num_written() << " frames to "
+              << capturePath << " (" << captureWriter->num_blocked()
+              << " waits for the writers)" << std::endl;
+  }
+  return saved ? 0 : 1;
 }
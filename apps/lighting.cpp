@@ -1,10 +1,33 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <glutils.hpp>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
 #include <string>
-#define STB_IMAGE_IMPLEMENTATION
+#include <utility>
+#include <vector>
+
+#include "capturewriter.hpp"
 #include "flycamera.hpp"
+#include "framestats.hpp"
+#include "gbuffer.hpp"
+#include "glcontext.hpp"
+#include "glhooks.hpp"
+#include "gputimer.hpp"
+#include "jobsystem.hpp"
+#include "lightclusters.hpp"
+#include "lightmapbaker.hpp"
+#include "profiler.hpp"
+#include "readback.hpp"
+#include "rendertarget.hpp"
 #include "shader.hpp"
-#include "stb/stb_image.h"
+#include "shadercache.hpp"
+#include "shadowmaps.hpp"
+#include "uploadring.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -18,6 +41,11 @@ const float CAMERA_SPEED = 3.0f;
 const float WIN_WIDTH = 800.0f;
 const float WIN_HEIGHT = 600.0f;
 
+// Frames rendered in headless mode if no other count is given, and the rate
+// used to animate them
+const unsigned long DEFAULT_HEADLESS_FRAMES = 100;
+const float HEADLESS_FRAME_RATE = 60.0f;
+
 // Auxiliary variables of the mouse controller
 bool firstMouse = true;
 float lastX = WIN_WIDTH / 2.0;
@@ -28,43 +56,75 @@ const glm::vec3 cameraPos = glm::vec3(0.0f, 1.0f, 8.0f);
 const glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 // Create the camera controller
 Camera camera = Camera(cameraPos, cameraUp);
-// Camera Field Of View
-float fov = 45.0f;
 
 // Lighting
 glm::vec3 light_position = glm::vec3(0.0f, 0.5f, 0.0f);
 glm::vec3 lightCubeColor = glm::vec3(1.0f, 1.0f, 1.0f);
+// The light of the cube reaches the whole scene
+const float MAIN_LIGHT_RADIUS = 12.0f;
+const float MAIN_LIGHT_INTENSITY = 4.0f;
+// Extra lights requested with --lights, placed at random around the houses
+// and circling their position
+const float EXTRA_LIGHT_RADIUS = 1.5f;
+const glm::vec3 EXTRA_LIGHTS_MIN = glm::vec3(-4.0f, 0.1f, -8.0f);
+const glm::vec3 EXTRA_LIGHTS_MAX = glm::vec3(4.0f, 1.0f, 3.0f);
+const float EXTRA_LIGHT_ORBIT = 0.5f;
+const uint32_t EXTRA_LIGHTS_SEED = 7;
+// First texture unit of the cluster buffers (the unit 0 has the base texture)
+const GLuint CLUSTER_TEXTURE_UNIT = 1;
+// First texture unit of the G-buffer, read by the deferred lighting pass
+const GLuint GBUFFER_TEXTURE_UNIT = 4;
+// Texture unit of the shadow atlas of the sun
+const GLuint SHADOW_TEXTURE_UNIT = 7;
+// Texture unit of the baked lighting of the static set
+const GLuint LIGHTMAP_TEXTURE_UNIT = 8;
 
-GLuint texture_setup(const std::string &filepath) {
-  // Generate the OpenGL texture object
-  GLuint texture;
-  glGenTextures(1, &texture);
-  // Bind the texture to the texture unit 0
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  // Set the texture wrapping/filtering options
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // Load the texture data from file
-  int width, height, nrChannels;
-  unsigned char *data =
-      stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-  if (data) {
-    // Generate the 2D texture by setting the data and format
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, data);
-    // Generate all the Mipmap levels up to 1-pixel-size
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Error during texture data loading" << std::endl;
-  }
-  // Now we can free the source texture data
-  stbi_image_free(data);
-  return texture;
-}
+// Sun of --shadows, a directional light shining along SUN_DIRECTION
+const glm::vec3 SUN_DIRECTION = glm::vec3(-0.4f, -1.0f, -0.3f);
+const glm::vec3 SUN_COLOR = glm::vec3(0.8f, 0.75f, 0.6f);
+// Static set of --shadows and --lightmap: the ground under the houses and a
+// few crates. They never move, so their shadows are drawn once and cached, and
+// their lighting can be baked
+const glm::vec3 GROUND_CENTER = glm::vec3(0.0f, -0.5f, -2.0f);
+const float GROUND_SIZE = 24.0f;
+const float CRATE_SCALE = 0.5f;
+const glm::vec3 crate_positions[4] = {
+    glm::vec3(3.0f, -0.25f, 1.0f), glm::vec3(-3.0f, -0.25f, -4.0f),
+    glm::vec3(1.5f, -0.25f, -5.0f), glm::vec3(-2.5f, -0.25f, 2.0f)};
+
+// Size of the framebuffer, to find the cluster tile of the fragments
+int viewportWidth = 0;
+int viewportHeight = 0;
+
+// Binding points of the uniform blocks used by the shaders
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint DRAW_BLOCK_BINDING = 1;
+
+// Data of the `CameraData` uniform block (std140 layout)
+struct CameraData {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec4 clusterParams;
+  // View space direction towards the sun, with the number of cascades in w
+  glm::vec4 sunDirection;
+  glm::vec4 sunColor;
+  glm::vec4 cascadeSplits;
+  glm::mat4 shadowMatrices[MAX_SHADOW_CASCADES];
+};
+
+// Data of the `DrawData` uniform block (std140 layout, each vec3 is padded to
+// 16 bytes)
+struct DrawData {
+  glm::mat4 model;
+  glm::vec3 objectColor;
+  float padding0;
+  glm::vec3 lightColor;
+  float padding1;
+};
+
+// Number of indices of the roof pyramid and of the walls cube
+const GLsizei ROOF_NUM_INDICES = 12;
+const GLsizei WALLS_NUM_INDICES = 24;
 
 void set_up_roof() {
   // Triangle vertices data
@@ -77,7 +137,7 @@ void set_up_roof() {
       0.5f,  0.0f, -0.5f, 0.0f, 0.0f, // Right-back
   };
   // Order to draw the unique vertices to form the roof pyramid
-  constexpr GLuint indices[12] = {
+  constexpr GLuint indices[ROOF_NUM_INDICES] = {
       0, 2, 1, // Front
       1, 2, 4, // Right
       4, 2, 3, // Back
@@ -101,9 +161,9 @@ void set_up_roof() {
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
   // Prepare the texture coordinates attribute
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
                         (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
 }
 
 void set_up_walls() {
@@ -120,7 +180,7 @@ void set_up_walls() {
       -0.5f, 0.0f,  -0.5f, 1.0f, 1.0f  // Top-left-back
   };
   // Order to draw the unique vertices to form the walls cube
-  constexpr GLuint indices[24] = {
+  constexpr GLuint indices[WALLS_NUM_INDICES] = {
       0, 1, 3, // Top-front triangle
       1, 2, 3, // Bottom-front triangle
       4, 5, 7, // Top-back triangle
@@ -148,14 +208,164 @@ void set_up_walls() {
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
   // Prepare the texture coordinates attribute
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                        (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+}
+
+// Square of unit size, with the texture repeated over it
+// Format: postion(x, y, z), texCoord(x, y)
+constexpr float ground_vertices[20] = {
+    -0.5f, 0.0f, 0.5f,  0.0f,  0.0f,  // Left-front
+    0.5f,  0.0f, 0.5f,  12.0f, 0.0f,  // Right-front
+    0.5f,  0.0f, -0.5f, 12.0f, 12.0f, // Right-back
+    -0.5f, 0.0f, -0.5f, 0.0f,  12.0f  // Left-back
+};
+constexpr GLuint ground_indices[6] = {0, 1, 2, 2, 3, 0};
+const GLsizei GROUND_NUM_INDICES = std::size(ground_indices);
+
+// Cube of unit size, with the whole texture on each face
+// Format: postion(x, y, z), texCoord(x, y)
+constexpr float crate_vertices[120] = {
+    // Front
+    -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, //
+    0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -0.5f, 0.5f, 0.5f, 0.0f, 1.0f,   //
+    // Back
+    0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, //
+    -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f, 0.5f, -0.5f, 0.0f, 1.0f,   //
+    // Right
+    0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, //
+    0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f, 0.5f, 0.5f, 0.0f, 1.0f,   //
+    // Left
+    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -0.5f, -0.5f, 0.5f, 1.0f, 0.0f, //
+    -0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f,   //
+    // Top
+    -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f, 0.0f, //
+    0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, //
+    // Bottom
+    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, //
+    0.5f, -0.5f, 0.5f, 1.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f, 1.0f    //
+};
+// Two triangles per face, from its four vertices
+constexpr GLuint crate_indices[36] = {
+    0,  1,  2,  2,  3,  0,  // Front
+    4,  5,  6,  6,  7,  4,  // Back
+    8,  9,  10, 10, 11, 8,  // Right
+    12, 13, 14, 14, 15, 12, // Left
+    16, 17, 18, 18, 19, 16, // Top
+    20, 21, 22, 22, 23, 20  // Bottom
+};
+const GLsizei CRATE_NUM_INDICES = std::size(crate_indices);
+
+// Transform of the ground (0) or a crate (1 onwards) of the static set
+glm::mat4 static_model(size_t index) {
+  glm::mat4 model = glm::mat4(1.0f);
+  if (index == 0) {
+    model = glm::translate(model, GROUND_CENTER);
+    return glm::scale(model, glm::vec3(GROUND_SIZE, 1.0f, GROUND_SIZE));
+  }
+  model = glm::translate(model, crate_positions[index - 1]);
+  return glm::scale(model, glm::vec3(CRATE_SCALE));
+}
+
+void set_up_mesh(const float *vertices, size_t verticesSize,
+                 const GLuint *indices, size_t indicesSize) {
+  // Prepare the Element Buffer Object for `index drawing`
+  GLuint EBO;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, indices, GL_STATIC_DRAW);
+  // Prepare the vertex buffer for the unique vertices data
+  GLuint VBO;
+  glGenBuffers(1, &VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, verticesSize, vertices, GL_STATIC_DRAW);
+  // Prepare the vertex position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+  // Prepare the texture coordinates attribute
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                        (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+}
+
+void set_up_ground() {
+  set_up_mesh(ground_vertices, sizeof(ground_vertices), ground_indices,
+              sizeof(ground_indices));
+}
+
+void set_up_crate() {
+  set_up_mesh(crate_vertices, sizeof(crate_vertices), crate_indices,
+              sizeof(crate_indices));
+}
+
+// The whole static set in world space, for the lightmap
+// Format: postion(x, y, z), texCoord(x, y)
+void build_static_set(std::vector<float> &vertices,
+                      std::vector<GLuint> &indices) {
+  vertices.clear();
+  indices.clear();
+  for (size_t i = 0; i <= std::size(crate_positions); i++) {
+    const float *meshVertices = i == 0 ? ground_vertices : crate_vertices;
+    const size_t numVertices =
+        i == 0 ? std::size(ground_vertices) / 5 : std::size(crate_vertices) / 5;
+    const GLuint *meshIndices = i == 0 ? ground_indices : crate_indices;
+    const size_t numIndices =
+        i == 0 ? std::size(ground_indices) : std::size(crate_indices);
+    const GLuint first = vertices.size() / 5;
+    const glm::mat4 model = static_model(i);
+    for (size_t v = 0; v < numVertices; v++) {
+      const float *vertex = meshVertices + 5 * v;
+      const glm::vec4 position =
+          model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+      vertices.insert(vertices.end(),
+                      {position.x, position.y, position.z, vertex[3],
+                       vertex[4]});
+    }
+    for (size_t n = 0; n < numIndices; n++)
+      indices.push_back(first + meshIndices[n]);
+  }
+}
+
+// Stores the static set unwrapped in the lightmap, adding the lightmap
+// coordinates to the vertices of `build_static_set`
+// Format: postion(x, y, z), texCoord(x, y), lightmapCoord(x, y)
+void set_up_lightmapped(const std::vector<float> &vertices,
+                        const LightmapMesh &mesh) {
+  std::vector<float> lightmapped;
+  for (size_t v = 0; v < mesh.vertex_map.size(); v++) {
+    const float *vertex = vertices.data() + 5 * mesh.vertex_map[v];
+    lightmapped.insert(lightmapped.end(), vertex, vertex + 5);
+    lightmapped.push_back(mesh.coords[v].x);
+    lightmapped.push_back(mesh.coords[v].y);
+  }
+  GLuint EBO;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint),
+               mesh.indices.data(), GL_STATIC_DRAW);
+  GLuint VBO;
+  glGenBuffers(1, &VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, lightmapped.size() * sizeof(float),
+               lightmapped.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 7 * sizeof(float),
                         (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  // Prepare the lightmap coordinates attribute
+  glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, 7 * sizeof(float),
+                        (void *)(5 * sizeof(float)));
+  glEnableVertexAttribArray(7);
 }
 
+// Number of vertices of the light cube, drawn without indices
+const GLsizei LIGHT_NUM_VERTICES = 36;
+
 void set_up_light() {
   // Vertices to create a cube
-  float vertices[108] = {
+  float vertices[3 * LIGHT_NUM_VERTICES] = {
       -0.5f, -0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, 0.5f,  0.5f,  -0.5f, 0.5f,
       0.5f,  -0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, -0.5f, -0.5f, -0.5f, -0.5f,
       0.5f,  0.5f,  -0.5f, 0.5f,  0.5f,  0.5f,  0.5f,  0.5f,  0.5f,  0.5f,
@@ -198,43 +408,176 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
   camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-int main() {
-  // Initialize the window manager
-  if (!glfwInit()) {
-    std::cout << "GLFW could not be initialized" << std::endl;
-    exit(EXIT_FAILURE);
-  }
-  // Set the OpenGL version to 3.3 with core-profile
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-
-  // Initialize the window
-  GLFWwindow *window =
-      glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "OpenGL Sandbox", NULL, NULL);
-  if (!window) {
-    glfwTerminate();
-    exit(EXIT_FAILURE);
+void framebuffer_resize_callback(GLFWwindow *window, int width, int height) {
+  framebuffer_size_callback(window, width, height);
+  viewportWidth = width;
+  viewportHeight = height;
+  // The projection is only rebuilt when the aspect ratio changes, and kept
+  // while minimized
+  if (width > 0 && height > 0)
+    camera.SetPerspective(static_cast<float>(width) / height);
+}
+
+int main(int argc, char *argv[]) {
+  // Usage: lighting [--headless WxH [--frames N] [--output file.ppm]]
+  //                 [--capture out.ppm|out.png|out.y4m] [--profile trace.json]
+  //                 [--stats stats.json] [--gl-check] [--lights N]
+  //                 [--deferred] [--shadows [--cascades N] [--sun-speed DEG]]
+  //                 [--bake-lightmap out.ktx] [--lightmap in.ktx]
+  //                 [--shader-cache DIR]
+  // The headless mode renders N frames offscreen without a window, for batch
+  // runs and CI machines without display. The capture saves every rendered
+  // frame as an image sequence or a video, and the profile writes the CPU
+  // zones as a Chrome trace. The stats of the last frames are reported at exit
+  // (and with F9), also as JSON and CSV files if requested. In builds with
+  // GLUTILS_GL_HOOKS the GL calls per frame are reported at exit, and
+  // --gl-check reports the GL errors after each call. The scene is lit by
+  // the light cube plus N - 1 small colored lights, shaded in clusters so
+  // each fragment only computes the lights that reach it. By default the
+  // houses are lit while drawn (forward), and with --deferred they are drawn
+  // into a G-buffer first and lit once per pixel in a full screen pass. With
+  // --shadows a sun turning DEG degrees per second around the vertical casts
+  // shadows in N cascades over a ground with a few crates. The shadows of the
+  // ground and the crates are cached, and only the houses are drawn into the
+  // shadow maps every frame. The lighting of the ground and the crates can
+  // also be baked offline into a lightmap, from the light cube and the sun
+  // at its first direction, and shaded with a single texture fetch. The
+  // moving lights and the houses don't reach the lightmapped surfaces. The
+  // shader variants are compiled when first drawn, and their program
+  // binaries are kept in DIR (shader_cache by default, none if empty) to be
+  // loaded instead by the next runs
+  bool headless = false;
+  int headlessWidth = 0, headlessHeight = 0;
+  unsigned long numFrames = DEFAULT_HEADLESS_FRAMES;
+  std::string outputPath;
+  std::string capturePath;
+  std::string profilePath;
+  std::string statsPath;
+  bool glCheck = false;
+  unsigned long numLights = 1;
+  bool deferred = false;
+  bool shadows = false;
+  unsigned numCascades = 1;
+  float sunSpeed = 0.0f;
+  std::string bakeLightmapPath;
+  std::string lightmapPath;
+  std::string shaderCacheDir = "shader_cache";
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--headless" && i + 1 < argc) {
+      headless = std::sscanf(argv[++i], "%dx%d", &headlessWidth,
+                             &headlessHeight) == 2 &&
+                 headlessWidth > 0 && headlessHeight > 0;
+      if (!headless) {
+        std::cout << "Invalid headless size " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (arg == "--frames" && i + 1 < argc)
+      numFrames = std::stoul(argv[++i]);
+    else if (arg == "--output" && i + 1 < argc)
+      outputPath = argv[++i];
+    else if (arg == "--capture" && i + 1 < argc)
+      capturePath = argv[++i];
+    else if (arg == "--profile" && i + 1 < argc)
+      profilePath = argv[++i];
+    else if (arg == "--stats" && i + 1 < argc)
+      statsPath = argv[++i];
+    else if (arg == "--gl-check")
+      glCheck = true;
+    else if (arg == "--lights" && i + 1 < argc)
+      numLights = std::max(std::stoul(argv[++i]), 1ul);
+    else if (arg == "--deferred")
+      deferred = true;
+    else if (arg == "--shadows")
+      shadows = true;
+    else if (arg == "--cascades" && i + 1 < argc)
+      numCascades = std::clamp(std::stoul(argv[++i]), 1ul,
+                               static_cast<unsigned long>(MAX_SHADOW_CASCADES));
+    else if (arg == "--sun-speed" && i + 1 < argc)
+      sunSpeed = std::stof(argv[++i]);
+    else if (arg == "--bake-lightmap" && i + 1 < argc)
+      bakeLightmapPath = lightmapPath = argv[++i];
+    else if (arg == "--lightmap" && i + 1 < argc)
+      lightmapPath = argv[++i];
+    else if (arg == "--shader-cache" && i + 1 < argc)
+      shaderCacheDir = argv[++i];
   }
-  // Capture the mouse when focusing the window
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-  // Set the window as the OpenGL context
-  glfwMakeContextCurrent(window);
+  profiler_enable(!profilePath.empty());
+  gl_hooks_check_errors(glCheck);
+  profiler_thread_name("Main");
 
-  // Load OpenGL
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    glfwTerminate();
-    return 1;
+  // The captured frames are read back asynchronously and written to disk by
+  // background threads
+  std::unique_ptr<CaptureWriter> captureWriter;
+  if (!capturePath.empty()) {
+    captureWriter = std::make_unique<CaptureWriter>(
+        capturePath, static_cast<int>(HEADLESS_FRAME_RATE));
+    if (!captureWriter->valid())
+      return 1;
   }
+  auto make_capture_readback = [&](int width, int height) {
+    return std::make_unique<FrameReadback>(
+        width, height,
+        [&](const unsigned char *rgba, int width, int height,
+            unsigned long long frame) {
+          captureWriter->submit(rgba, width, height, frame);
+        });
+  };
 
-  // Ensure that the OpenGL viewport is adjusted to the window size
-  int frameWidth, frameHeight;
-  glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
-  glViewport(0, 0, frameWidth, frameHeight);
-  // Set a callback to adjust the viewport when resizing the window
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  GLFWwindow *window = NULL;
+  HeadlessContext headlessContext;
+  // Offscreen framebuffer that replaces the window in headless mode
+  std::unique_ptr<RenderTarget> renderTarget;
+  if (headless) {
+    if (!headlessContext.create(3, 3)) {
+      return 1;
+    }
+    renderTarget =
+        std::make_unique<RenderTarget>(headlessWidth, headlessHeight);
+    renderTarget->bind();
+    viewportWidth = headlessWidth;
+    viewportHeight = headlessHeight;
+    camera.SetPerspective(static_cast<float>(headlessWidth) / headlessHeight);
+  } else {
+    // Initialize the window manager
+    if (!glfwInit()) {
+      std::cout << "GLFW could not be initialized" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    // Set the OpenGL version to 3.3 with core-profile
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    // Initialize the window
+    window =
+        glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "OpenGL Sandbox", NULL, NULL);
+    if (!window) {
+      glfwTerminate();
+      exit(EXIT_FAILURE);
+    }
+    // Capture the mouse when focusing the window
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // Set the window as the OpenGL context
+    glfwMakeContextCurrent(window);
+
+    // Load OpenGL
+    if (!load_gl((GLADloadproc)glfwGetProcAddress)) {
+      glfwTerminate();
+      return 1;
+    }
+
+    // Ensure that the OpenGL viewport is adjusted to the window size
+    int frameWidth, frameHeight;
+    glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+    framebuffer_resize_callback(window, frameWidth, frameHeight);
+    // Set a callback to adjust the viewport and the projection when resizing
+    // the window
+    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+  }
 
   // Set the color to clear the screen
   glClearColor(0.25f, 0.5f, 0.75f, 1.0f);
@@ -242,10 +585,21 @@ int main() {
   // Enable Z-buffer
   glEnable(GL_DEPTH_TEST);
 
-  Shader base_shader = Shader("../../src/shaders/lighting/base.vert",
-                              "../../src/shaders/lighting/base.frag");
-  Shader light_shader = Shader("../../src/shaders/lighting/base.vert",
-                               "../../src/shaders/lighting/light.frag");
+  // The houses, the static set, the light cube and the G-buffer pass share
+  // the surface shaders, in the variants of the features they are drawn with
+  auto surfaceShaders = std::make_unique<ShaderCache>(
+      "../../src/shaders/common/surface.vert",
+      "../../src/shaders/common/surface.frag", shaderCacheDir);
+  auto lightShaders = std::make_unique<ShaderCache>(
+      "../../src/shaders/common/surface.vert",
+      "../../src/shaders/lighting/light.frag", shaderCacheDir);
+  auto gbufferShaders = std::make_unique<ShaderCache>(
+      "../../src/shaders/common/surface.vert",
+      "../../src/shaders/lighting/gbuffer.frag", shaderCacheDir);
+  Shader deferred_shader = Shader("../../src/shaders/lighting/deferred.vert",
+                                  "../../src/shaders/lighting/deferred.frag");
+  Shader shadow_shader = Shader("../../src/shaders/lighting/shadow.vert",
+                                "../../src/shaders/lighting/shadow.frag");
 
   // Prepare the roof texture
   GLuint roof_tex = texture_setup("../../textures/roof.png");
@@ -269,136 +623,673 @@ int main() {
   glBindVertexArray(light_VAO);
   set_up_light();
 
+  // Store the vertices of the static set in their Vertex Array Objects
+  GLuint ground_VAO;
+  glGenVertexArrays(1, &ground_VAO);
+  glBindVertexArray(ground_VAO);
+  set_up_ground();
+  GLuint crate_VAO;
+  glGenVertexArrays(1, &crate_VAO);
+  glBindVertexArray(crate_VAO);
+  set_up_crate();
+
+  // The full screen triangle of the deferred lighting has no vertex data,
+  // but drawing needs a Vertex Array Object
+  GLuint screen_VAO;
+  glGenVertexArrays(1, &screen_VAO);
+
   glm::vec3 house_positions[6] = {
       glm::vec3(2.0f, 0.0f, -1.0f),  glm::vec3(-1.0f, 0.0f, 0.5f),
       glm::vec3(0.9f, 0.0f, 1.0f),   glm::vec3(0.7f, 0.0f, -3.0f),
       glm::vec3(-2.0f, 0.0f, -2.0f), glm::vec3(-0.8f, 0.0f, -6.0f)};
 
-  // Get uniform variables locations to update them in the render loop
-  GLuint base_texLoc = glGetUniformLocation(base_shader.ID, "baseTexture");
-  GLuint base_lightColorLoc =
-      glGetUniformLocation(base_shader.ID, "lightColor");
-  GLuint base_objectColorLoc =
-      glGetUniformLocation(base_shader.ID, "objectColor");
-  GLuint base_modelLoc = glGetUniformLocation(base_shader.ID, "model");
-  GLuint base_viewLoc = glGetUniformLocation(base_shader.ID, "view");
-  GLuint base_projectionLoc =
-      glGetUniformLocation(base_shader.ID, "projection");
-  GLuint light_objectColorLoc =
-      glGetUniformLocation(light_shader.ID, "objectColor");
-  GLuint light_modelLoc = glGetUniformLocation(light_shader.ID, "model");
-  GLuint light_viewLoc = glGetUniformLocation(light_shader.ID, "view");
-  GLuint light_projectionLoc =
-      glGetUniformLocation(light_shader.ID, "projection");
+  // The houses always sample the texture unit 0, and the light clusters the
+  // next ones. The shadow atlas needs its own unit even without shadows, as
+  // samplers of different types can't share one. The samplers and blocks
+  // that a variant doesn't have are ignored
+  const ShaderCache::ProgramSetup setUpSurface = [](GLuint program,
+                                                    unsigned) {
+    bind_uniform_block(program, "CameraData", CAMERA_BLOCK_BINDING);
+    bind_uniform_block(program, "DrawData", DRAW_BLOCK_BINDING);
+    glUseProgram(program);
+    const std::pair<const char *, GLint> samplers[] = {
+        {"baseTexture", 0},
+        {"clusterLights", CLUSTER_TEXTURE_UNIT},
+        {"clusterRanges", CLUSTER_TEXTURE_UNIT + 1},
+        {"clusterIndices", CLUSTER_TEXTURE_UNIT + 2},
+        {"shadowAtlas", SHADOW_TEXTURE_UNIT},
+        {"lightmap", LIGHTMAP_TEXTURE_UNIT}};
+    for (const auto &[name, unit] : samplers) {
+      glUniform1i(glGetUniformLocation(program, name), unit);
+    }
+  };
+  surfaceShaders->set_program_setup(setUpSurface);
+  lightShaders->set_program_setup(setUpSurface);
+  gbufferShaders->set_program_setup(setUpSurface);
+  deferred_shader.use();
+  deferred_shader.setInt("gbufferAlbedo", GBUFFER_TEXTURE_UNIT);
+  deferred_shader.setInt("gbufferNormal", GBUFFER_TEXTURE_UNIT + 1);
+  deferred_shader.setInt("gbufferDepth", GBUFFER_TEXTURE_UNIT + 2);
+  deferred_shader.setInt("clusterLights", CLUSTER_TEXTURE_UNIT);
+  deferred_shader.setInt("clusterRanges", CLUSTER_TEXTURE_UNIT + 1);
+  deferred_shader.setInt("clusterIndices", CLUSTER_TEXTURE_UNIT + 2);
+  deferred_shader.setInt("shadowAtlas", SHADOW_TEXTURE_UNIT);
+  const GLint lightViewProjectionLoc =
+      glGetUniformLocation(shadow_shader.ID, "lightViewProjection");
 
-  // Set mouse handling callback
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  // The light of the cube comes first, then the extra lights
+  std::vector<PointLight> lights(numLights);
+  lights[0] = {light_position, MAIN_LIGHT_RADIUS,
+               lightCubeColor * MAIN_LIGHT_INTENSITY};
+  std::vector<glm::vec3> lightCenters(numLights, light_position);
+  std::vector<float> lightPhases(numLights, 0.0f);
+  std::mt19937 random(EXTRA_LIGHTS_SEED);
+  auto uniform = [&random](float low, float high) {
+    return low + (high - low) * (random() / 4294967296.0f);
+  };
+  for (size_t i = 1; i < numLights; i++) {
+    lightCenters[i] =
+        glm::vec3(uniform(EXTRA_LIGHTS_MIN.x, EXTRA_LIGHTS_MAX.x),
+                  uniform(EXTRA_LIGHTS_MIN.y, EXTRA_LIGHTS_MAX.y),
+                  uniform(EXTRA_LIGHTS_MIN.z, EXTRA_LIGHTS_MAX.z));
+    lightPhases[i] = uniform(0.0f, 2.0f * glm::pi<float>());
+    // Saturated colors, with at least one channel at full intensity
+    glm::vec3 color(uniform(0.0f, 1.0f), uniform(0.0f, 1.0f),
+                    uniform(0.0f, 1.0f));
+    lights[i].color = color / std::max({color.x, color.y, color.z, 1e-3f});
+    lights[i].radius = EXTRA_LIGHT_RADIUS;
+  }
+  // Assigns the lights to the clusters on the worker threads
+  JobSystem jobs;
 
-  // Keep track of the elapsed time to control movement speed
-  float lastFrameTime = 0.0f;
+  // The ground and the crates are drawn with shadows or with a lightmap
+  const bool staticSet = shadows || !lightmapPath.empty();
+  GLuint lightmap_tex = 0;
+  GLuint lightmapped_VAO = 0;
+  GLsizei lightmappedIndices = 0;
+  if (!lightmapPath.empty()) {
+    // The unwrap gives the same lightmap coordinates when only loading
+    std::vector<float> staticVertices;
+    std::vector<GLuint> staticIndices;
+    build_static_set(staticVertices, staticIndices);
+    std::vector<glm::vec3> staticPositions;
+    for (size_t v = 0; v < staticVertices.size(); v += 5)
+      staticPositions.emplace_back(staticVertices[v], staticVertices[v + 1],
+                                   staticVertices[v + 2]);
+    LightmapBaker baker;
+    if (!baker.unwrap(staticPositions, staticIndices))
+      return 1;
+    const LightmapMesh &mesh = baker.mesh();
+    if (!bakeLightmapPath.empty()) {
+      // Bake the light cube, and the sun if the scene has it
+      SunLight sun;
+      if (shadows)
+        sun = {SUN_DIRECTION, SUN_COLOR};
+      baker.bake(jobs, {lights[0]}, sun);
+      if (!baker.write(bakeLightmapPath))
+        return 1;
+      baker.print_summary();
+    }
+    lightmap_tex = load_lightmap(lightmapPath);
+    if (!lightmap_tex)
+      return 1;
+    glGenVertexArrays(1, &lightmapped_VAO);
+    glBindVertexArray(lightmapped_VAO);
+    set_up_lightmapped(staticVertices, mesh);
+    lightmappedIndices = mesh.indices.size();
+  }
+  auto lightClusters = std::make_unique<LightClusters>();
 
-  while (!glfwWindowShouldClose(window)) {
-    // Read used input
-    glfwPollEvents();
+  // Surfaces of the deferred path, following the size of the framebuffer
+  std::unique_ptr<GBuffer> gbuffer;
+  if (deferred)
+    gbuffer = std::make_unique<GBuffer>(std::max(viewportWidth, 1),
+                                        std::max(viewportHeight, 1));
+  // Shadows of the sun. The static set never changes in this scene, so its
+  // version stays the same and its shadows are only drawn again when the sun
+  // turns or a cascade follows the camera
+  std::unique_ptr<ShadowMaps> shadowMaps;
+  if (shadows) {
+    ShadowSettings shadowSettings;
+    shadowSettings.cascades = numCascades;
+    shadowMaps = std::make_unique<ShadowMaps>(shadowSettings);
+  }
+  const unsigned long long staticVersion = 1;
 
-    // Clear the screen
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // Framebuffer that the lighting pass draws into
+  const GLuint outputFramebuffer =
+      renderTarget ? renderTarget->framebuffer() : 0;
+  auto report_gbuffer = [&]() {
+    if (!gbuffer)
+      return;
+    std::cout << "G-buffer of " << gbuffer->width() << "x"
+              << gbuffer->height() << ": " << GBuffer::BYTES_PER_PIXEL
+              << " bytes per pixel, "
+              << gbuffer->size_bytes() / (1024.0 * 1024.0)
+              << " MB written and read back every frame ("
+              << gbuffer->allocated_bytes() / (1024.0 * 1024.0)
+              << " MB allocated in " << gbuffer->num_allocations()
+              << " allocations)" << std::endl;
+  };
 
-    // Prepare the shaders to draw the houses
-    base_shader.use();
+  // Connect the uniform blocks of the shaders to their binding points (the
+  // surface shaders connect theirs when built)
+  bind_uniform_block(shadow_shader.ID, "DrawData", DRAW_BLOCK_BINDING);
+  bind_uniform_block(deferred_shader.ID, "CameraData", CAMERA_BLOCK_BINDING);
 
-    // Compute elapsed time between frames
-    const float currentFrameTime = glfwGetTime();
-    const float deltaTime = currentFrameTime - lastFrameTime;
-    lastFrameTime = currentFrameTime;
+  // Per-frame uniform data is streamed through a ring buffer, in chunks
+  // aligned to the offsets allowed by glBindBufferRange
+  GLint uboAlignment;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+  const size_t cameraChunk =
+      (sizeof(CameraData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+  const size_t drawChunk =
+      (sizeof(DrawData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+  // One draw chunk per house, then the ground, the crates and the whole
+  // lightmapped static set, and another for the light cube
+  const size_t groundDraw = std::size(house_positions);
+  const size_t firstCrateDraw = groundDraw + 1;
+  const size_t lightmappedDraw = firstCrateDraw + std::size(crate_positions);
+  const size_t numDraws = lightmappedDraw + 2;
+  auto uniformRing = std::make_unique<UploadRing>(
+      GL_UNIFORM_BUFFER, cameraChunk + numDraws * drawChunk);
+  std::vector<GLintptr> drawOffsets(numDraws);
 
-    const float cameraSpeed = CAMERA_SPEED * deltaTime;
-    // Process user input to move the camera
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-      camera.ProcessKeyboard(CameraMovement::RIGHT, deltaTime);
+  // Measures of the last frames
+  FrameStats frameStats;
+  auto report_stats = [&]() {
+    frameStats.print_summary();
+    if (!statsPath.empty()) {
+      frameStats.write_json(statsPath);
+      frameStats.write_csv(statsPath.substr(0, statsPath.rfind('.')) + ".csv");
+    }
+  };
 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-      break; // Exit the program loop
+  // GPU time of the passes, for the stats and the profile
+  std::unique_ptr<GpuTimer> gpuTimer = std::make_unique<GpuTimer>();
+  gpuTimer->set_frame_callback(
+      [&](unsigned long long frame, double milliseconds) {
+        frameStats.set_gpu_time(frame, milliseconds);
+      });
+  auto begin_gpu_pass = [&](const char *name) {
+    if (gpuTimer)
+      gpuTimer->begin_pass(name);
+  };
+  auto end_gpu_pass = [&]() {
+    if (gpuTimer)
+      gpuTimer->end_pass();
+  };
+
+  // Draws the scene with the houses animation at `time` seconds
+  auto draw_frame = [&](float time, FrameSample &sample) {
+    PROFILE_ZONE("Draw submission");
+    gpuTimer->begin_frame();
 
     // Create the LooAt matrix for the camera
-    glm::mat4 view = camera.GetViewMatrix();
+    const glm::mat4 &view = camera.GetViewMatrix();
 
     // Create the perspective projection matrix
-    glm::mat4 projection = glm::perspective(
-        glm::radians(fov), WIN_WIDTH / WIN_HEIGHT, 0.1f, 100.0f);
+    const glm::mat4 &projection = camera.GetProjectionMatrix();
 
-    glUniformMatrix4fv(base_viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(base_projectionLoc, 1, GL_FALSE,
-                       glm::value_ptr(projection));
+    // Move the extra lights around their centers and find the clusters
+    // they reach
+    for (size_t i = 1; i < lights.size(); i++) {
+      const float angle = time + lightPhases[i];
+      lights[i].position =
+          lightCenters[i] + EXTRA_LIGHT_ORBIT * glm::vec3(std::cos(angle), 0.0f,
+                                                          std::sin(angle));
+    }
+    lightClusters->set_projection(projection);
+    lightClusters->build(jobs, lights, view);
+    const glm::vec4 clusterParams(
+        static_cast<float>(CLUSTER_TILES_X) / std::max(viewportWidth, 1),
+        static_cast<float>(CLUSTER_TILES_Y) / std::max(viewportHeight, 1),
+        lightClusters->slice_scale(), lightClusters->slice_bias());
+
+    // Turn the sun and fit the shadow cascades to the view
+    const glm::vec3 sunDirection =
+        glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians(sunSpeed) * time,
+                              glm::vec3(0.0f, 1.0f, 0.0f)) *
+                  glm::vec4(SUN_DIRECTION, 0.0f));
+    if (shadowMaps)
+      shadowMaps->update(view, projection, sunDirection, staticVersion);
 
-    // Set the color for the houses
-    glUniform3f(base_objectColorLoc, 1.0f, 1.0f, 1.0f);
-    glUniform3f(base_lightColorLoc, 1.0f, 1.0f, 1.0f);
+    // Write the uniform data of all the draws of the frame at once
+    uniformRing->begin_frame();
+    UploadRing::Allocation cameraBlock =
+        uniformRing->allocate(sizeof(CameraData), uboAlignment);
+    CameraData *cameraData = static_cast<CameraData *>(cameraBlock.data);
+    cameraData->view = view;
+    cameraData->projection = projection;
+    cameraData->clusterParams = clusterParams;
+    // Without shadows the sun is black and has no cascades
+    cameraData->sunDirection = glm::vec4(0.0f);
+    cameraData->sunColor = glm::vec4(0.0f);
+    cameraData->cascadeSplits = glm::vec4(0.0f);
+    if (shadowMaps) {
+      const glm::vec3 towardsSun =
+          glm::normalize(glm::vec3(view * glm::vec4(-sunDirection, 0.0f)));
+      cameraData->sunDirection =
+          glm::vec4(towardsSun, static_cast<float>(shadowMaps->num_cascades()));
+      cameraData->sunColor = glm::vec4(SUN_COLOR, 1.0f);
+      cameraData->cascadeSplits = shadowMaps->cascade_splits();
+      for (unsigned c = 0; c < shadowMaps->num_cascades(); c++)
+        cameraData->shadowMatrices[c] = shadowMaps->shadow_matrix(c);
+    }
 
     int speed_idx = 0;
     bool invert_turn = false;
-    // Draw each house in its corresponding postion using the model transform
-    for (glm::vec3 &house_pos : house_positions) {
+    // Compute the transform of each house in its corresponding postion
+    for (size_t i = 0; i < std::size(house_positions); i++) {
       // Initialize the transform matrix with the identity matrix
       glm::mat4 model = glm::mat4(1.0f);
       // Apply translation between rotations
-      model = glm::translate(model, house_pos);
+      model = glm::translate(model, house_positions[i]);
       // Apply rotation over Y-axis using the elapsed time
-      const float rotation =
-          (speed_idx % MAX_SPEED + MIN_SPEED) * glfwGetTime();
+      const float rotation = (speed_idx % MAX_SPEED + MIN_SPEED) * time;
       model = glm::rotate(model, invert_turn ? -rotation : rotation,
                           glm::vec3(0.0f, 1.0f, 0.0f));
       speed_idx++;
       invert_turn = !invert_turn;
-      // Set transform data for the shader
-      glUniformMatrix4fv(base_modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+
+      UploadRing::Allocation drawBlock =
+          uniformRing->allocate(sizeof(DrawData), uboAlignment);
+      DrawData *draw = static_cast<DrawData *>(drawBlock.data);
+      draw->model = model;
+      // Set the color for the houses
+      draw->objectColor = glm::vec3(1.0f, 1.0f, 1.0f);
+      draw->lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+      drawOffsets[i] = drawBlock.offset;
+    }
+
+    // The static set keeps its transforms, but they are written every frame
+    // like the rest. The lightmapped one is already in world space
+    if (staticSet) {
+      for (size_t i = 0; i <= std::size(crate_positions) + 1; i++) {
+        UploadRing::Allocation drawBlock =
+            uniformRing->allocate(sizeof(DrawData), uboAlignment);
+        DrawData *draw = static_cast<DrawData *>(drawBlock.data);
+        draw->model = i <= std::size(crate_positions) ? static_model(i)
+                                                       : glm::mat4(1.0f);
+        draw->objectColor = glm::vec3(1.0f, 1.0f, 1.0f);
+        draw->lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+        drawOffsets[groundDraw + i] = drawBlock.offset;
+      }
+    }
+
+    // Set up the light postion and scale
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, light_position);
+    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+    UploadRing::Allocation lightBlock =
+        uniformRing->allocate(sizeof(DrawData), uboAlignment);
+    DrawData *lightDraw = static_cast<DrawData *>(lightBlock.data);
+    lightDraw->model = model;
+    // Set the color for the light cube
+    lightDraw->objectColor = lightCubeColor;
+    lightDraw->lightColor = lightCubeColor;
+    drawOffsets.back() = lightBlock.offset;
+
+    uniformRing->commit();
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING,
+                      uniformRing->buffer(), cameraBlock.offset,
+                      sizeof(CameraData));
+
+    // Draws the crates, or the houses without their textures, into the
+    // bound framebuffer
+    auto draw_crates = [&]() {
+      glBindVertexArray(crate_VAO);
+      for (size_t i = 0; i < std::size(crate_positions); i++) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                          uniformRing->buffer(),
+                          drawOffsets[firstCrateDraw + i], sizeof(DrawData));
+        glDrawElements(GL_TRIANGLES, CRATE_NUM_INDICES, GL_UNSIGNED_INT, 0);
+        sample.triangles += CRATE_NUM_INDICES / 3;
+      }
+    };
+    auto draw_house_casters = [&]() {
+      for (size_t i = 0; i < std::size(house_positions); i++) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                          uniformRing->buffer(), drawOffsets[i],
+                          sizeof(DrawData));
+        glBindVertexArray(roof_VAO);
+        glDrawElements(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(walls_VAO);
+        glDrawElements(GL_TRIANGLES, WALLS_NUM_INDICES, GL_UNSIGNED_INT, 0);
+        sample.triangles += (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3;
+      }
+    };
+
+    // Draw the shadows of the sun. The cached shadows of the static set are
+    // only drawn again when they are no longer valid, then the houses are
+    // drawn over a copy of them
+    if (shadowMaps) {
+      begin_gpu_pass("Shadows");
+      shadow_shader.use();
+      for (unsigned c = 0; c < shadowMaps->num_cascades(); c++) {
+        glUniformMatrix4fv(lightViewProjectionLoc, 1, GL_FALSE,
+                           glm::value_ptr(shadowMaps->light_matrix(c)));
+        if (shadowMaps->begin_static(c))
+          draw_crates();
+        shadowMaps->begin_dynamic(c);
+        draw_house_casters();
+      }
+      shadowMaps->end();
+      shadowMaps->bind(SHADOW_TEXTURE_UNIT);
+      end_gpu_pass();
+    }
+
+    // The deferred path draws the houses into the G-buffer, and the shadow
+    // passes left their own framebuffer bound
+    if (gbuffer) {
+      gbuffer->resize(viewportWidth, viewportHeight);
+      gbuffer->bind();
+    } else if (shadowMaps) {
+      glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+      glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+    // Clear the screen
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Prepare the shaders to draw the houses
+    ShaderCache &houseShaders = gbuffer ? *gbufferShaders : *surfaceShaders;
+    houseShaders.use(SHADER_LIGHTING);
+
+    // Draw each house selecting its data range of the uniform buffer
+    begin_gpu_pass(gbuffer ? "Geometry" : "Houses");
+    if (!gbuffer) {
+      lightClusters->bind(CLUSTER_TEXTURE_UNIT);
+    }
+    for (size_t i = 0; i < std::size(house_positions); i++) {
+      glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                        uniformRing->buffer(), drawOffsets[i],
+                        sizeof(DrawData));
 
       // Bind the roof texture
       glActiveTexture(GL_TEXTURE0);
       glBindTexture(GL_TEXTURE_2D, roof_tex);
-      glUniform1i(base_texLoc, 0);
       // Draw the roof
       glBindVertexArray(roof_VAO);
-      glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_INT, 0);
+      glDrawElements(GL_TRIANGLES, ROOF_NUM_INDICES, GL_UNSIGNED_INT, 0);
 
       // Bind the walls texture
       glActiveTexture(GL_TEXTURE0);
       glBindTexture(GL_TEXTURE_2D, wall_tex);
-      glUniform1i(base_texLoc, 0);
       // Draw the walls
       glBindVertexArray(walls_VAO);
-      glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, 0);
+      glDrawElements(GL_TRIANGLES, WALLS_NUM_INDICES, GL_UNSIGNED_INT, 0);
+
+      sample.triangles += (ROOF_NUM_INDICES + WALLS_NUM_INDICES) / 3;
+    }
+
+    // Draw the ground and the crates with the texture of the walls, unless
+    // their lighting is baked
+    if (staticSet && !lightmap_tex) {
+      glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                        uniformRing->buffer(), drawOffsets[groundDraw],
+                        sizeof(DrawData));
+      glBindVertexArray(ground_VAO);
+      glDrawElements(GL_TRIANGLES, GROUND_NUM_INDICES, GL_UNSIGNED_INT, 0);
+      sample.triangles += GROUND_NUM_INDICES / 3;
+      draw_crates();
+    }
+
+    end_gpu_pass();
+
+    // Light the pixels of the G-buffer into the output framebuffer
+    if (gbuffer) {
+      begin_gpu_pass("Lighting");
+      glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+      glViewport(0, 0, viewportWidth, viewportHeight);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      deferred_shader.use();
+      gbuffer->bind_textures(GBUFFER_TEXTURE_UNIT);
+      lightClusters->bind(CLUSTER_TEXTURE_UNIT);
+      // The pass copies the depth of the houses, for the light cube to test
+      // against, so it must always pass the depth test
+      glDepthFunc(GL_ALWAYS);
+      glBindVertexArray(screen_VAO);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      glDepthFunc(GL_LESS);
+      sample.triangles++;
+      end_gpu_pass();
+    }
+
+    // Draw the lightmapped static set at once, over the lit houses
+    if (lightmap_tex) {
+      begin_gpu_pass("Lightmapped");
+      surfaceShaders->use(SHADER_LIGHTMAP);
+      glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                        uniformRing->buffer(), drawOffsets[lightmappedDraw],
+                        sizeof(DrawData));
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, wall_tex);
+      glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+      glBindTexture(GL_TEXTURE_2D, lightmap_tex);
+      glActiveTexture(GL_TEXTURE0);
+      glBindVertexArray(lightmapped_VAO);
+      glDrawElements(GL_TRIANGLES, lightmappedIndices, GL_UNSIGNED_INT, 0);
+      sample.triangles += lightmappedIndices / 3;
+      end_gpu_pass();
     }
 
     // Prepare the shaders to draw the light cube
-    light_shader.use();
-    glUniformMatrix4fv(light_viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(light_projectionLoc, 1, GL_FALSE,
-                       glm::value_ptr(projection));
-    // Set the color for the light cube
-    glUniform3fv(light_objectColorLoc, 1, glm::value_ptr(lightCubeColor));
-    // Set up the light postion and scale
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, light_position);
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-    glUniformMatrix4fv(light_modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    begin_gpu_pass("Light cube");
+    lightShaders->use(SHADER_LIGHTING);
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING,
+                      uniformRing->buffer(), drawOffsets.back(),
+                      sizeof(DrawData));
     // Draw the light cube
     glBindVertexArray(light_VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glDrawArrays(GL_TRIANGLES, 0, LIGHT_NUM_VERTICES);
+    sample.triangles += LIGHT_NUM_VERTICES / 3;
+
+    // Protect the uniform data of the frame until the draws are done
+    uniformRing->end_frame();
+    end_gpu_pass();
+    gpuTimer->end_frame();
+  };
+
+  if (headless) {
+    // Render the frames as fast as possible, animating them with a fixed
+    // frame rate so the output doesn't depend on the speed of the machine
+    std::unique_ptr<FrameReadback> captureReadback;
+    if (captureWriter)
+      captureReadback = make_capture_readback(headlessWidth, headlessHeight);
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t lastFrameStart = profiler_now();
+    for (unsigned long i = 0; i < numFrames; i++) {
+      profiler_frame_mark();
+      const uint64_t frameStart = profiler_now();
+      FrameSample sample;
+      sample.frame = i;
+      sample.frame_ms = (frameStart - lastFrameStart) / 1e6;
+      lastFrameStart = frameStart;
+
+      draw_frame(static_cast<float>(i) / HEADLESS_FRAME_RATE, sample);
+      if (captureReadback)
+        captureReadback->capture(i);
+
+      sample.cpu_ms = (profiler_now() - frameStart) / 1e6;
+      gl_hooks_frame_mark();
+      sample.draw_calls = gl_hooks_frame_draw_calls();
+      sample.state_changes = gl_hooks_frame_state_changes();
+      frameStats.record(sample);
+    }
+    // Wait for the GPU to account for all the rendering work
+    if (captureReadback)
+      captureReadback->flush();
+    glFinish();
+    profiler_frame_mark();
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    std::cout << "Rendered " << numFrames << " frames at " << headlessWidth
+              << "x" << headlessHeight << " in " << elapsed << " s ("
+              << elapsed / numFrames * 1000.0 << " ms/frame, "
+              << numFrames / elapsed << " fps)" << std::endl;
+
+    bool saved = true;
+    if (!outputPath.empty()) {
+      const std::vector<unsigned char> pixels =
+          read_pixels_rgb(headlessWidth, headlessHeight);
+      saved = write_ppm(outputPath, headlessWidth, headlessHeight,
+                        pixels.data());
+    }
+
+    gpuTimer->finish();
+    if (!profilePath.empty())
+      gpuTimer->print_summary();
+    gpuTimer.reset();
+    gl_hooks_print_summary();
+    lightClusters->print_summary();
+    report_gbuffer();
+    if (shadowMaps)
+      shadowMaps->print_summary();
+    surfaceShaders->print_summary();
+    lightShaders->print_summary();
+    gbufferShaders->print_summary();
+    lightClusters.reset();
+    gbuffer.reset();
+    shadowMaps.reset();
+    captureReadback.reset();
+    uniformRing.reset();
+    renderTarget.reset();
+    surfaceShaders.reset();
+    lightShaders.reset();
+    gbufferShaders.reset();
+    glDeleteProgram(deferred_shader.ID);
+    glDeleteProgram(shadow_shader.ID);
+    glDeleteVertexArrays(1, &screen_VAO);
+    if (captureWriter) {
+      // Wait for the writers to empty the queue
+      captureWriter->finish();
+      std::cout << "Captured " << captureWriter->num_written() << " frames to "
+                << capturePath << " (" << captureWriter->num_blocked()
+                << " waits for the writers)" << std::endl;
+    }
+    if (!profilePath.empty()) {
+      profiler_print_summary();
+      profiler_write_chrome_trace(profilePath);
+    }
+    report_stats();
+    return saved ? 0 : 1;
+  }
+
+  // Set mouse handling callback
+  glfwSetCursorPosCallback(window, mouse_callback);
+  glfwSetScrollCallback(window, scroll_callback);
+
+  // Keep track of the elapsed time to control movement speed
+  float lastFrameTime = 0.0f;
+
+  std::unique_ptr<FrameReadback> captureReadback;
+  unsigned long long capturedFrames = 0;
+  if (captureWriter) {
+    int frameWidth, frameHeight;
+    glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+    captureReadback = make_capture_readback(frameWidth, frameHeight);
+  }
+
+  unsigned long long renderedFrames = 0;
+  uint64_t lastFrameStart = profiler_now();
+  bool statsKeyDown = false;
+  while (!glfwWindowShouldClose(window)) {
+    profiler_frame_mark();
+    const uint64_t frameStart = profiler_now();
+    FrameSample sample;
+    sample.frame = renderedFrames++;
+    sample.frame_ms = (frameStart - lastFrameStart) / 1e6;
+    lastFrameStart = frameStart;
+    // Read used input
+    {
+      PROFILE_ZONE("Poll events");
+      glfwPollEvents();
+    }
+
+    // Compute elapsed time between frames
+    const float currentFrameTime = glfwGetTime();
+    const float deltaTime = currentFrameTime - lastFrameTime;
+    lastFrameTime = currentFrameTime;
+
+    const float cameraSpeed = CAMERA_SPEED * deltaTime;
+    // Process user input to move the camera
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+      camera.ProcessKeyboard(CameraMovement::FORWARD, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+      camera.ProcessKeyboard(CameraMovement::BACKWARD, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+      camera.ProcessKeyboard(CameraMovement::LEFT, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+      camera.ProcessKeyboard(CameraMovement::RIGHT, deltaTime);
+
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+      break; // Exit the program loop
+
+    // Report the stats of the last frames
+    const bool statsKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+      report_stats();
+    statsKeyDown = statsKey;
+
+    const uint64_t submitStart = profiler_now();
+    draw_frame(glfwGetTime(), sample);
+
+    // Copy the frame before swapping the buffers, following the window size
+    if (captureReadback) {
+      int frameWidth, frameHeight;
+      glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+      captureReadback->resize(frameWidth, frameHeight);
+      captureReadback->capture(capturedFrames++);
+    }
+    sample.cpu_ms = (profiler_now() - submitStart) / 1e6;
+    gl_hooks_frame_mark();
+    sample.draw_calls = gl_hooks_frame_draw_calls();
+    sample.state_changes = gl_hooks_frame_state_changes();
+    frameStats.record(sample);
 
     // Display the updated rendered data
+    PROFILE_ZONE("Swap buffers");
     glfwSwapBuffers(window);
   }
 
-  glDeleteProgram(base_shader.ID);
-  glDeleteProgram(light_shader.ID);
+  if (captureReadback)
+    captureReadback->flush();
+  gpuTimer->finish();
+  if (!profilePath.empty())
+    gpuTimer->print_summary();
+  gpuTimer.reset();
+  gl_hooks_print_summary();
+  lightClusters->print_summary();
+  report_gbuffer();
+  if (shadowMaps)
+    shadowMaps->print_summary();
+  surfaceShaders->print_summary();
+  lightShaders->print_summary();
+  gbufferShaders->print_summary();
+  report_stats();
+  lightClusters.reset();
+  gbuffer.reset();
+  shadowMaps.reset();
+  captureReadback.reset();
+  uniformRing.reset();
+  surfaceShaders.reset();
+  lightShaders.reset();
+  gbufferShaders.reset();
+  glDeleteProgram(deferred_shader.ID);
+  glDeleteProgram(shadow_shader.ID);
+  glDeleteVertexArrays(1, &screen_VAO);
   glfwTerminate();
+  if (!profilePath.empty()) {
+    profiler_print_summary();
+    profiler_write_chrome_trace(profilePath);
+  }
+  if (captureWriter) {
+    // Wait for the writers to empty the queue
+    captureWriter->finish();
+    std::cout << "Captured " << captureWriter->num_written() << " frames to "
+              << capturePath << " (" << captureWriter->num_blocked()
+              << " waits for the writers)" << std::endl;
+  }
   return 0;
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <flycamera.hpp>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Pose of the camera at a simulated time (in seconds)
+struct CameraPose {
+  float time;
+  glm::vec3 position;
+  float yaw;
+  float pitch;
+  float zoom;
+};
+
+// Camera flythrough stored as the poses that the camera took at increasing
+// times. Playback samples the path at any time, interpolating between the
+// poses, so a path recorded while flying with the live input can be replayed
+// at fixed time steps and gives the same frames in every run. While the
+// camera is still only the first and last poses are kept, so the log stays
+// small. It is saved in a compact binary format:
+//   "CPTH", version (uint32), number of poses (uint32)
+//   per pose: time, position (x, y, z), yaw, pitch, zoom (float32)
+// with the values in the byte order of the machine
+class CameraPath {
+public:
+  // Adds the pose of the camera at `time`, which must not be earlier than
+  // the last recorded one
+  void record(float time, const Camera &camera);
+
+  // Moves the camera to the pose of the path at `time`, holding the first or
+  // last pose outside of the path
+  void apply(float time, Camera &camera) const;
+
+  void clear() { poses.clear(); }
+  size_t size() const { return poses.size(); }
+  bool empty() const { return poses.empty(); }
+  // Time of the last pose
+  float duration() const { return poses.empty() ? 0.0f : poses.back().time; }
+
+  bool save(const std::string &filepath) const;
+  bool load(const std::string &filepath);
+
+private:
+  std::vector<CameraPose> poses;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat {
+  // One image file per frame
+  PPM,
+  PNG,
+  // Single uncompressed YUV 4:2:0 video stream
+  Y4M,
+};
+
+// Encodes and writes captured frames to disk in a pool of background threads,
+// so the render thread never does I/O. The queue of frames is bounded: when the
+// writers fall behind, `submit` blocks until there is room (backpressure)
+// instead of using more and more memory.
+// The image sequences are named after the output path with the frame number,
+// e.g. `out/frame.png` is written as `out/frame_000042.png`
+class CaptureWriter {
+public:
+  // The format is chosen from the extension of `path` (.ppm, .png or .y4m).
+  // The frame rate is only used by the video formats
+  CaptureWriter(const std::string &path, int frame_rate = 60,
+                unsigned num_threads = 2, size_t max_queued_frames = 8);
+  // Writes the frames still in the queue before returning
+  ~CaptureWriter();
+
+  CaptureWriter(const CaptureWriter &) = delete;
+  CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+  // Queues a copy of the RGBA pixels of a frame, bottom row first, as
+  // delivered by `FrameReadback`
+  void submit(const unsigned char *rgba, int width, int height,
+              unsigned long long frame);
+
+  // Waits until all the queued frames are written
+  void finish();
+
+  // False if the output path has an unknown extension or can't be opened
+  bool valid() const { return is_valid; }
+  CaptureFormat format() const { return capture_format; }
+  unsigned long long num_written();
+  // Number of submits that had to wait because the queue was full
+  unsigned long long num_blocked();
+
+private:
+  struct QueuedFrame {
+    std::vector<unsigned char> rgba;
+    int width;
+    int height;
+    unsigned long long frame;
+    // Position in the order of submission, to write video frames in order
+    unsigned long long sequence;
+  };
+
+  void worker_loop();
+  void write_image(const QueuedFrame &frame);
+  void write_video_frame(const QueuedFrame &frame);
+
+  std::string output_path;
+  CaptureFormat capture_format;
+  int fps;
+  bool is_valid = true;
+  size_t max_queued;
+  std::FILE *video_file = nullptr;
+  // Size of the video, set by its first frame
+  int video_width = 0;
+  int video_height = 0;
+  // Serializes the writes to the video file in the order of submission
+  std::mutex video_mutex;
+  std::condition_variable video_turn;
+  unsigned long long next_video_sequence = 0;
+
+  std::mutex mutex;
+  // Signaled when a frame is queued or the writers must stop
+  std::condition_variable frame_queued;
+  // Signaled when a frame is taken from the queue or finished
+  std::condition_variable frame_done;
+  std::deque<QueuedFrame> queue;
+  // Buffers of the written frames, reused to avoid allocations
+  std::vector<std::vector<unsigned char>> free_buffers;
+  unsigned long long next_sequence = 0;
+  unsigned busy_workers = 0;
+  unsigned long long written = 0;
+  unsigned long long blocked = 0;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+struct DynamicResolutionSettings {
+  // Range of the render scale, relative to the window size on each axis
+  float min_scale = 0.5f;
+  float max_scale = 1.0f;
+  // GPU time budget of a frame
+  double target_ms = 16.0;
+};
+
+// Chooses the scale to render the frames at from their GPU time, so a frame
+// over budget drops resolution instead of frames. The GPU time is assumed to
+// grow with the pixels drawn (the square of the scale). Over budget the scale
+// drops at once to the one expected to fit, while under budget it grows a
+// step at a time and leaves some headroom, so it doesn't oscillate around the
+// target. The GPU times arrive a few frames late, so the scale of each frame
+// is remembered until its time is known
+class DynamicResolution {
+public:
+  explicit DynamicResolution(const DynamicResolutionSettings &settings = {});
+
+  // Returns the scale to draw the frame at
+  float begin_frame(unsigned long long frame);
+
+  // Adds the GPU time of a frame, ignored if it is too old
+  void update(unsigned long long frame, double gpu_ms);
+
+  float scale() const { return current_scale; }
+  const DynamicResolutionSettings &settings() const { return config; }
+  // Times the scale was lowered
+  unsigned long long num_drops() const { return drops; }
+
+private:
+  struct FrameScale {
+    unsigned long long frame = 0;
+    float scale = 0.0f;
+  };
+
+  DynamicResolutionSettings config;
+  float current_scale;
+  // Smoothed GPU time of a frame at scale 1, negative until measured
+  double full_scale_ms = -1.0;
+  std::vector<FrameScale> frame_scales;
+  unsigned long long drops = 0;
+};
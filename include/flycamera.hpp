@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <frustum.hpp>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,9 +18,16 @@ const float PITCH = 0.0f;
 const float SPEED = 3.0f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float ASPECT_RATIO = 4.0f / 3.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 // An abstract camera class that processes input and calculates the
-// corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+// corresponding Euler Angles, Vectors and Matrices for use in OpenGL. The
+// matrices and the frustum are cached, and only computed again when the
+// position, orientation, zoom or projection options changed since the last
+// time. Each change increments the version, so the users of the camera can
+// skip their work (e.g. culling) while it is static
 class Camera {
 public:
   // Camera Attributes
@@ -34,7 +42,12 @@ public:
   // Camera options
   float MovementSpeed;
   float MouseSensitivity;
+  // Vertical field of view in degrees
   float Zoom;
+  // Projection options
+  float AspectRatio = ASPECT_RATIO;
+  float NearPlane = NEAR_PLANE;
+  float FarPlane = FAR_PLANE;
 
   // Constructor with vectors
   Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f),
@@ -62,8 +75,39 @@ public:
   }
 
   // Returns the view matrix calculated using Euler Angles and the LookAt Matrix
-  glm::mat4 GetViewMatrix() {
-    return glm::lookAt(Position, Position + Front, Up);
+  const glm::mat4 &GetViewMatrix() {
+    updateCache();
+    return cache.view;
+  }
+
+  // Returns the perspective projection matrix, using the zoom as the field
+  // of view
+  const glm::mat4 &GetProjectionMatrix() {
+    updateCache();
+    return cache.projection;
+  }
+
+  const glm::mat4 &GetViewProjectionMatrix() {
+    updateCache();
+    return cache.view_projection;
+  }
+
+  const Frustum &GetFrustum() {
+    updateCache();
+    return cache.frustum;
+  }
+
+  // Increases every time that the matrices change
+  unsigned long long GetVersion() {
+    updateCache();
+    return cache.version;
+  }
+
+  void SetPerspective(float aspectRatio, float nearPlane = NEAR_PLANE,
+                      float farPlane = FAR_PLANE) {
+    AspectRatio = aspectRatio;
+    NearPlane = nearPlane;
+    FarPlane = farPlane;
   }
 
   // Processes input received from any keyboard-like input system. Accepts input
@@ -85,6 +129,8 @@ public:
   // value in both the x and y direction.
   void ProcessMouseMovement(float xoffset, float yoffset,
                             GLboolean constrainPitch = true) {
+    if (xoffset == 0.0f && yoffset == 0.0f)
+      return;
     xoffset *= MouseSensitivity;
     yoffset *= MouseSensitivity;
 
@@ -113,14 +159,65 @@ public:
       Zoom = 45.0f;
   }
 
+  // Sets the Euler angles directly, like when replaying a recorded path
+  void SetOrientation(float yaw, float pitch) {
+    Yaw = yaw;
+    Pitch = pitch;
+    updateCameraVectors();
+  }
+
 private:
+  // Inputs of the cached matrices, and the matrices computed from them
+  struct Cache {
+    glm::vec3 position, front, up;
+    float zoom, aspect_ratio, near_plane, far_plane;
+    glm::mat4 view, projection, view_projection;
+    Frustum frustum;
+    unsigned long long version = 0;
+  } cache;
+  // Euler angles of the current vectors
+  float vectorsYaw = 0.0f;
+  float vectorsPitch = 0.0f;
+  bool vectorsValid = false;
+
+  // Computes the matrices again if any of their inputs changed
+  void updateCache() {
+    if (cache.version > 0 && cache.position == Position &&
+        cache.front == Front && cache.up == Up && cache.zoom == Zoom &&
+        cache.aspect_ratio == AspectRatio && cache.near_plane == NearPlane &&
+        cache.far_plane == FarPlane)
+      return;
+    cache.position = Position;
+    cache.front = Front;
+    cache.up = Up;
+    cache.zoom = Zoom;
+    cache.aspect_ratio = AspectRatio;
+    cache.near_plane = NearPlane;
+    cache.far_plane = FarPlane;
+    cache.view = glm::lookAt(Position, Position + Front, Up);
+    cache.projection = glm::perspective(glm::radians(Zoom), AspectRatio,
+                                        NearPlane, FarPlane);
+    cache.view_projection = cache.projection * cache.view;
+    cache.frustum = Frustum(cache.view_projection);
+    cache.version++;
+  }
+
   // Calculates the front vector from the Camera's (updated) Euler Angles
   void updateCameraVectors() {
+    // Nothing to do if the angles didn't change
+    if (vectorsValid && Yaw == vectorsYaw && Pitch == vectorsPitch)
+      return;
+    vectorsYaw = Yaw;
+    vectorsPitch = Pitch;
+    vectorsValid = true;
     // Calculate the new Front vector
+    const float yaw = glm::radians(Yaw);
+    const float pitch = glm::radians(Pitch);
+    const float cosPitch = cos(pitch);
     glm::vec3 front;
-    front.x = cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-    front.y = sin(glm::radians(Pitch));
-    front.z = sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
+    front.x = cos(yaw) * cosPitch;
+    front.y = sin(pitch);
+    front.z = sin(yaw) * cosPitch;
     Front = glm::normalize(front);
     // also re-calculate the Right and Up vector
     Right = glm::normalize(glm::cross(
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Query target of GL_ARB_pipeline_statistics_query (core in GL 4.6), not
+// included in the glad loader
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS
+#define GL_FRAGMENT_SHADER_INVOCATIONS 0x82F4
+#endif
+
+// Counts the fragments of the draws of a pass in two ways: the samples that
+// pass the depth test, which are the fragments shaded while the shaders don't
+// discard (early depth testing rejects the others), and the fragment shader
+// invocations if the context has pipeline statistics. Some drivers count the
+// invocations before the early depth test, so both are kept. Like the
+// GpuTimer, a frame is read back a few frames later, and is not counted if
+// its results are still not available then, so counting never stalls
+class FragmentCounter {
+public:
+  explicit FragmentCounter(unsigned frames_in_flight = 4);
+  ~FragmentCounter();
+
+  FragmentCounter(const FragmentCounter &) = delete;
+  FragmentCounter &operator=(const FragmentCounter &) = delete;
+
+  // Counts the fragments of the draws between these calls, once per frame
+  void begin();
+  void end();
+
+  // Waits for the frames in flight and reads their results
+  void finish();
+
+  // Forgets the frames counted so far, including the ones in flight
+  void reset();
+
+  bool has_invocations() const { return statistics; }
+  unsigned long long num_counted() const { return counted; }
+  // Averages per counted frame
+  double average_samples() const { return average(total_samples); }
+  double average_invocations() const { return average(total_invocations); }
+
+private:
+  struct Slot {
+    GLuint samples_query = 0;
+    GLuint invocations_query = 0;
+    bool pending = false;
+  };
+
+  // Adds the results of the slot if available
+  void collect(Slot &slot, bool wait);
+  double average(unsigned long long total) const {
+    return counted > 0 ? static_cast<double>(total) / counted : 0.0;
+  }
+
+  bool statistics;
+  std::vector<Slot> slots;
+  unsigned current = 0;
+  unsigned long long total_samples = 0;
+  unsigned long long total_invocations = 0;
+  unsigned long long counted = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Nearest-rank percentiles of a measure over the frames where it is known
+struct MeasurePercentiles {
+  size_t count = 0;
+  double p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+};
+
+struct FrameSample {
+  unsigned long long frame = 0;
+  // Time since the start of the previous frame
+  float frame_ms = 0.0f;
+  // CPU time spent preparing and submitting the frame
+  float cpu_ms = 0.0f;
+  // GPU time of the frame, negative until its results arrive
+  float gpu_ms = -1.0f;
+  // Draw calls and state changes (binds), as counted by the GL hooks.
+  // Negative when unknown, in the builds without the hooks
+  int draw_calls = -1;
+  unsigned long long triangles = 0;
+  int state_changes = -1;
+};
+
+// Keeps the samples of the last frames in a fixed ring, so recording a frame
+// never allocates nor locks, and reports their percentiles and spikes. The
+// ring must be used from a single thread (the one rendering the frames)
+class FrameStats {
+public:
+  explicit FrameStats(size_t capacity = 4096);
+
+  // Adds the sample of a new frame, replacing the oldest one if full
+  void record(const FrameSample &sample);
+
+  // Sets the GPU time of a recorded frame, if it is still in the ring
+  void set_gpu_time(unsigned long long frame, float gpu_ms);
+
+  size_t size() const { return count; }
+
+  // Percentiles of a measure, named as the fields of `FrameSample`
+  MeasurePercentiles percentiles(const std::string &measure) const;
+
+  // Prints the p50/p95/p99/max of each measure and the frame time spikes
+  void print_summary() const;
+
+  // One row per frame
+  bool write_csv(const std::string &filepath) const;
+  // Percentiles of each measure and the list of spikes
+  bool write_json(const std::string &filepath) const;
+
+private:
+  // Samples from the oldest to the newest
+  std::vector<FrameSample> samples() const;
+
+  std::vector<FrameSample> ring;
+  size_t next = 0;
+  size_t count = 0;
+};
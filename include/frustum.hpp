@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// View frustum described by its 6 planes (a, b, c, d) with the normals
+// pointing inside, so a point p is inside a plane if dot(plane, (p, 1)) >= 0
+struct Frustum {
+  enum Plane {
+    LEFT_PLANE,
+    RIGHT_PLANE,
+    BOTTOM_PLANE,
+    TOP_PLANE,
+    NEAR_PLANE,
+    FAR_PLANE
+  };
+  glm::vec4 planes[6];
+
+  Frustum() = default;
+
+  // Extracts the planes from a projection * view matrix (Gribb-Hartmann)
+  explicit Frustum(const glm::mat4 &view_projection) {
+    // GLM matrices are column-major, so build the rows first
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+      rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i],
+                          view_projection[2][i], view_projection[3][i]);
+    }
+    planes[LEFT_PLANE] = rows[3] + rows[0];
+    planes[RIGHT_PLANE] = rows[3] - rows[0];
+    planes[BOTTOM_PLANE] = rows[3] + rows[1];
+    planes[TOP_PLANE] = rows[3] - rows[1];
+    planes[NEAR_PLANE] = rows[3] + rows[2];
+    planes[FAR_PLANE] = rows[3] - rows[2];
+    // Normalize the planes to be able to compare distances with radiuses
+    for (glm::vec4 &plane : planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+  }
+
+  // Conservative test, returns true if the sphere is inside or intersecting
+  bool intersects_sphere(const glm::vec3 &center, float radius) const {
+    for (const glm::vec4 &plane : planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Geometry buffer of the deferred shading. The geometry pass writes the
+// surface of each pixel in a compact layout, that the lighting pass reads
+// back once per pixel:
+// - Albedo in RGBA8 (color attachment 0)
+// - View space normal in RG16, packed with an octahedral mapping (color
+//   attachment 1)
+// - Depth in a 24 bits texture, to rebuild the view space position
+class GBuffer {
+public:
+  // Bytes of a pixel over all the attachments
+  static constexpr size_t BYTES_PER_PIXEL = 4 + 4 + 4;
+
+  GBuffer(int width, int height);
+  ~GBuffer();
+
+  GBuffer(const GBuffer &) = delete;
+  GBuffer &operator=(const GBuffer &) = delete;
+
+  // Sets the size of the region that the passes draw and read, at the
+  // bottom-left of the attachments. They are only reallocated when they are
+  // too small, with a quarter more room than requested in each direction
+  // that grows, so dragging the window border reallocates them a few times
+  // instead of on every event. Empty sizes (minimized window) are ignored
+  void resize(int width, int height);
+
+  // Binds the framebuffer for the geometry pass and sets the viewport to the
+  // region
+  void bind() const;
+
+  // Binds the albedo, normal and depth textures to the units `first_unit` to
+  // `first_unit + 2`
+  void bind_textures(GLuint first_unit) const;
+
+  int width() const { return region_width; }
+  int height() const { return region_height; }
+  // Bytes of the region
+  size_t size_bytes() const {
+    return BYTES_PER_PIXEL * region_width * region_height;
+  }
+  // Bytes of the attachments
+  size_t allocated_bytes() const {
+    return BYTES_PER_PIXEL * buffer_width * buffer_height;
+  }
+  unsigned long long num_allocations() const { return allocations; }
+
+private:
+  void allocate();
+  void release();
+
+  GLuint fbo = 0;
+  GLuint albedo = 0;
+  GLuint normal = 0;
+  GLuint depth = 0;
+  int buffer_width;
+  int buffer_height;
+  int region_width;
+  int region_height;
+  unsigned long long allocations = 0;
+};
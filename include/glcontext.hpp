@@ -0,0 +1,31 @@
+#pragma once
+
+// OpenGL context without any window, to render offscreen in batch jobs or in
+// machines without display. It uses EGL, preferring the Mesa surfaceless
+// platform (which also works with llvmpipe on machines without GPU) and
+// falling back to the default display with a pbuffer surface
+class HeadlessContext {
+public:
+  HeadlessContext() = default;
+  ~HeadlessContext();
+
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  // Creates a core profile context of the given version, makes it current
+  // in the calling thread and loads the OpenGL functions
+  bool create(int major = 3, int minor = 3);
+
+  // Makes the context current in the calling thread or releases it
+  void make_current();
+  void release();
+
+  // False if the library was built without EGL support
+  static bool supported();
+
+private:
+  // EGL handles, kept opaque to avoid including the EGL (and X11) headers
+  void *display = nullptr;
+  void *context = nullptr;
+  void *surface = nullptr;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+// Instrumentation of the OpenGL calls, built with the GLUTILS_GL_HOOKS CMake
+// option. `load_gl` then replaces every function loaded by glad with a hook
+// that counts its calls, the draw calls and the state changes (program,
+// vertex array, texture, sampler, buffer and framebuffer binds) of each frame,
+// flags the redundant binds (binding again the program, vertex array, texture
+// or buffer already bound) and optionally checks glGetError after the call.
+// Without the option these functions do nothing and the GL calls go straight
+// to the driver. The hooks assume that the context is used from one thread at
+// a time
+
+#ifdef GLUTILS_GL_HOOKS
+
+// Replaces the functions loaded by glad with the hooks (done by `load_gl`)
+void gl_hooks_install();
+
+// Calls glGetError after each call and prints the first error of each entry
+// point. The errors are consumed, so the app's own glGetError sees none
+void gl_hooks_check_errors(bool enabled);
+
+// Ends the current frame, adding its counts to the totals
+void gl_hooks_frame_mark();
+
+// GL calls of the last completed frame, and how many were redundant
+unsigned long long gl_hooks_frame_calls();
+unsigned long long gl_hooks_frame_redundant();
+
+// Draw calls and state changes of the last completed frame, for the frame
+// stats. Negative (unknown) without the hooks
+int gl_hooks_frame_draw_calls();
+int gl_hooks_frame_state_changes();
+
+// Prints the calls per frame of each entry point, most called first
+void gl_hooks_print_summary();
+
+#else
+
+inline void gl_hooks_install() {}
+inline void gl_hooks_check_errors(bool) {}
+inline void gl_hooks_frame_mark() {}
+inline unsigned long long gl_hooks_frame_calls() { return 0; }
+inline unsigned long long gl_hooks_frame_redundant() { return 0; }
+inline int gl_hooks_frame_draw_calls() { return -1; }
+inline int gl_hooks_frame_state_changes() { return -1; }
+inline void gl_hooks_print_summary() {}
+
+#endif
@@ -3,11 +3,44 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include <ostream>
 #include <string>
+#include <vector>
+
+// Loads the OpenGL functions with glad, keeping the loader to be able to
+// resolve later the extensions that glad was not generated with
+bool load_gl(GLADloadproc loader);
+
+// Returns true if the current context supports the extension
+bool has_gl_extension(const std::string &name);
+
+// Returns true if the current context version is at least major.minor
+bool has_gl_version(int major, int minor);
+
+// Resolves an OpenGL function that glad doesn't load (requires `load_gl`)
+void *get_gl_proc(const char *name);
 
 GLuint make_module(const std::string &filepath, const GLuint module_type);
 
 GLuint make_shader(const std::string &vertex_filepath,
                    const std::string &fragment_filepath);
 
+// Connects the uniform block `name` of the program to a binding point
+void bind_uniform_block(GLuint program, const char *name, GLuint binding);
+
+// Reads the RGB pixels of the current read framebuffer, top row first
+std::vector<unsigned char> read_pixels_rgb(int width, int height);
+
+// Writes tightly packed RGB pixels (top row first) as a binary PPM image
+bool write_ppm(const std::string &filepath, int width, int height,
+               const unsigned char *pixels);
+
+// Writes the text as a JSON string, quoted and with the quotes, backslashes
+// and control characters escaped
+void write_json_string(std::ostream &out, const std::string &text);
+
+// Loads an RGB image as a mipmapped texture that repeats, left bound to the
+// texture unit 0
+GLuint texture_setup(const std::string &filepath);
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ProfileTrack;
+
+struct GpuPassTiming {
+  const char *name;
+  double milliseconds;
+};
+
+// Measures the GPU time of the render passes with timestamp queries. The
+// queries of a frame are read a few frames later, once the GPU has reached
+// them, so measuring never stalls the pipeline. If the results of the oldest
+// frame in flight are still not available, the new frame is not measured.
+// While the CPU profiler is enabled the passes are also recorded in its "GPU"
+// track, aligned with the CPU zones
+class GpuTimer {
+public:
+  explicit GpuTimer(unsigned frames_in_flight = 4);
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  // The frames are numbered from 0 in the order they begin
+  void begin_frame();
+  void end_frame();
+
+  // Called with the GPU time of each measured frame when its results arrive
+  using FrameCallback =
+      std::function<void(unsigned long long frame, double milliseconds)>;
+  void set_frame_callback(FrameCallback callback) {
+    frame_callback = std::move(callback);
+  }
+
+  // Measures the commands submitted between these calls. Passes can be nested
+  // and `name` must outlive the timer (use string literals)
+  void begin_pass(const char *name);
+  void end_pass();
+
+  // Waits for the frames in flight and reads their results
+  void finish();
+
+  // Passes of the most recent frame with results, and its total GPU time
+  const std::vector<GpuPassTiming> &latest_passes() const { return latest; }
+  double latest_frame_ms() const { return latest_frame_time; }
+  unsigned long long num_measured() const { return measured; }
+  // Frames not measured because the results were late
+  unsigned long long num_skipped() const { return skipped; }
+
+  // Prints the average and worst time of each pass
+  void print_summary() const;
+
+private:
+  struct Pass {
+    const char *name;
+    GLuint begin_query;
+    GLuint end_query;
+  };
+  struct Frame {
+    std::vector<Pass> passes;
+    // Last query submitted in the frame
+    GLuint last_query = 0;
+    unsigned long long index = 0;
+    // The queries were submitted but their results not read yet
+    bool pending = false;
+  };
+  struct PassStats {
+    double total = 0.0;
+    double worst = 0.0;
+    unsigned long long count = 0;
+  };
+
+  GLuint new_query();
+  bool results_available(const Frame &frame);
+  // Reads the results of the frame and returns its queries to the pool
+  void collect(Frame &frame);
+
+  std::vector<Frame> frames;
+  unsigned current = 0;
+  unsigned long long frames_begun = 0;
+  FrameCallback frame_callback;
+  // The current frame is being measured
+  bool recording = false;
+  // Passes begun and not ended yet, as indices in the current frame
+  std::vector<size_t> open_passes;
+  std::vector<GLuint> free_queries;
+  std::vector<GLuint> all_queries;
+
+  std::vector<GpuPassTiming> latest;
+  double latest_frame_time = 0.0;
+  unsigned long long measured = 0;
+  unsigned long long skipped = 0;
+  std::map<std::string, PassStats> stats;
+  PassStats frame_stats;
+
+  ProfileTrack *track = nullptr;
+  // Difference between the CPU profiler clock and the GPU timestamps
+  long long clock_offset = 0;
+};
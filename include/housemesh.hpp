@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Geometry of the house model: a pyramid roof over the cube walls, each one
+// drawn with its own vertex array and texture. The vertices have a position
+// (location 0), a color (location 1) and texture coordinates (location 2)
+
+// Indices (3 per triangle) of each part
+const GLsizei ROOF_NUM_INDICES = 12;
+const GLsizei WALLS_NUM_INDICES = 24;
+
+// Creates the buffers of the part and sets up its attributes in the bound
+// vertex array
+void set_up_roof();
+void set_up_walls();
+
+// Same as above with only the positions (location 0) in the vertex buffer,
+// for the passes that don't shade the houses, like the depth pre-pass
+void set_up_roof_positions();
+void set_up_walls_positions();
+
+// Sets up the per-instance model matrix (locations 3-6) in the bound vertex
+// array, read from `instance_VBO`
+void set_up_instances(GLuint instance_VBO);
+
+// Points the instance attributes of the bound vertex array to the matrices
+// starting at `offset` in `instance_VBO`
+void point_instances(GLuint instance_VBO, GLintptr offset);
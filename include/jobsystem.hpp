@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Job = std::function<void()>;
+
+// Tracks a group of jobs. Every job submitted with the counter increments it
+// and decrements it when finished, so reaching zero means the whole group is
+// done. Jobs can also be scheduled to start after a counter reaches zero,
+// which is how the dependencies between frame stages are expressed. A counter
+// must be waited on with `JobSystem::wait` before being destroyed
+class JobCounter {
+public:
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class JobSystem;
+  std::atomic<int> pending{0};
+  // Guards the decrements and the jobs waiting for the counter to reach zero
+  std::mutex mutex;
+  std::vector<std::pair<Job, JobCounter *>> continuations;
+};
+
+// Work-stealing job system. Each worker owns a deque: it pushes and pops jobs
+// at the back (LIFO, cache friendly) while idle threads steal from the front
+// of the other deques. Threads waiting on a counter help running jobs instead
+// of blocking
+class JobSystem {
+public:
+  // With `num_workers == 0` one worker per hardware thread is created, minus
+  // the calling thread that also takes part while waiting
+  explicit JobSystem(unsigned num_workers = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Number of threads that can execute jobs (workers + the waiting thread)
+  unsigned num_threads() const { return workers.size() + 1; }
+
+  void submit(Job job, JobCounter *counter = nullptr);
+
+  // Schedules `job` to run once all the jobs tracked by `dependency` are done
+  void submit_after(JobCounter &dependency, Job job,
+                    JobCounter *counter = nullptr);
+
+  // Runs jobs from the queues until the counter reaches zero
+  void wait(JobCounter &counter);
+
+  // Splits [0, count) in chunks of `chunk_size` elements and runs
+  // `fn(begin, end)` for each of them. The chunks are tracked by `counter`
+  // and, if provided, only start after `dependency` is done. Use
+  // `chunk_size == 0` to pick a size from the number of threads
+  void parallel_for(size_t count, size_t chunk_size,
+                    std::function<void(size_t, size_t)> fn,
+                    JobCounter &counter, JobCounter *dependency = nullptr);
+
+  // Blocking version of `parallel_for`
+  void parallel_for(size_t count, size_t chunk_size,
+                    std::function<void(size_t, size_t)> fn);
+
+  // Chunk size used by `parallel_for` when none is given
+  size_t default_chunk_size(size_t count) const;
+
+private:
+  struct QueuedJob {
+    Job job;
+    JobCounter *counter = nullptr;
+  };
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<QueuedJob> jobs;
+  };
+
+  void worker_loop(unsigned index);
+  // Index of the queue owned by the calling thread
+  unsigned local_queue() const;
+  void push(QueuedJob queued);
+  bool pop_or_steal(unsigned first_queue, QueuedJob &out);
+  void execute(QueuedJob &queued);
+  void finish(JobCounter *counter);
+
+  std::vector<std::thread> workers;
+  // One queue per worker plus a last one for the threads outside the pool
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  std::atomic<int> queued_jobs{0};
+  std::atomic<bool> stopping{false};
+  // Used to put idle workers to sleep
+  std::mutex sleep_mutex;
+  std::condition_variable wake_up;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <jobsystem.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Size of the cluster grid: screen tiles and depth slices. The slices split
+// the view depth exponentially, so the clusters are roughly cubic at any depth
+const unsigned CLUSTER_TILES_X = 16;
+const unsigned CLUSTER_TILES_Y = 9;
+const unsigned CLUSTER_SLICES = 24;
+const unsigned NUM_CLUSTER_TILES = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+const unsigned NUM_CLUSTERS = NUM_CLUSTER_TILES * CLUSTER_SLICES;
+
+// Point light whose contribution fades to zero at `radius` from its position
+struct PointLight {
+  glm::vec3 position;
+  float radius;
+  glm::vec3 color;
+};
+
+// Clustered forward shading. The view frustum is split in froxels (clusters
+// of a screen tile and a depth slice) and every frame the CPU finds the
+// lights that reach each of them, so the fragment shader only walks the
+// lights of its own cluster. The lights are culled in two stages, one job
+// per screen tile:
+// - The light spheres are tested against the sub-frustum of the tile, built
+//   from the projection, 4 lights at a time with SSE when available
+// - The lights of the tile are binned in the depth slices they overlap
+// The results are read by the shaders from texture buffers (GL 3.3 has no
+// storage buffers):
+// - `clusterLights` (RGBA32F): 2 texels per light, the view space position
+//   and radius, then the color
+// - `clusterRanges` (RG32UI): offset and count of each cluster in the list
+// - `clusterIndices` (R32UI): light indices of all the clusters
+// The cluster of a fragment is ((slice * TILES_Y) + tile.y) * TILES_X + tile.x
+class LightClusters {
+public:
+  LightClusters();
+  ~LightClusters();
+
+  LightClusters(const LightClusters &) = delete;
+  LightClusters &operator=(const LightClusters &) = delete;
+
+  // Sets the perspective projection of the view, rebuilding the sub-frusta
+  // of the tiles if it changed
+  void set_projection(const glm::mat4 &projection);
+
+  // Assigns the lights (in world space) to the clusters of the view and
+  // uploads the result. Blocks until done
+  void build(JobSystem &jobs, const std::vector<PointLight> &lights,
+             const glm::mat4 &view);
+
+  // Binds the texture buffers to the units `first_unit` to `first_unit + 2`
+  // (lights, ranges and indices)
+  void bind(GLuint first_unit) const;
+
+  // The slice of a view depth d is floor(log(d) * scale - bias)
+  float slice_scale() const { return depth_scale; }
+  float slice_bias() const { return depth_bias; }
+
+  unsigned long long num_builds() const { return builds; }
+  // Light indices of the last build, and the most lights of a cluster
+  size_t num_indices() const { return indices.size(); }
+  unsigned max_cluster_lights() const { return last_max; }
+
+  // Prints the average size of the light lists
+  void print_summary() const;
+
+private:
+  struct Tile {
+    // Planes of the sub-frustum in view space, with the Z coefficient
+    // negated to test positive depths
+    glm::vec4 planes[6];
+    // Lights that reach the tile
+    std::vector<uint32_t> lights;
+    // First and last slice of each light of the tile
+    std::vector<std::pair<uint8_t, uint8_t>> light_slices;
+    // Light lists of the clusters of the tile, slice after slice
+    std::vector<uint32_t> indices;
+    // Where the lists start in the uploaded indices
+    uint32_t offset = 0;
+  };
+
+  // Creates a texture buffer with its own storage and format
+  static void create_buffer(GLuint &buffer, GLuint &texture, GLenum format);
+  unsigned depth_slice(float depth) const;
+  void cull_tile(unsigned tile);
+  void upload();
+
+  std::vector<Tile> tiles;
+  float near_depth = 0.0f, far_depth = 0.0f;
+  float depth_scale = 0.0f, depth_bias = 0.0f;
+  glm::mat4 projection_key = glm::mat4(0.0f);
+
+  // Lights in view space (the depth positive), as separate arrays padded to
+  // a multiple of 4
+  std::vector<float> light_x, light_y, light_depth, light_radius;
+  // Texels of the lights buffer
+  std::vector<glm::vec4> light_texels;
+  std::vector<glm::uvec2> ranges;
+  std::vector<uint32_t> indices;
+
+  GLuint lights_buffer = 0, lights_texture = 0;
+  GLuint ranges_buffer = 0, ranges_texture = 0;
+  GLuint indices_buffer = 0, indices_texture = 0;
+
+  unsigned long long builds = 0;
+  unsigned long long total_tile_lights = 0;
+  unsigned long long total_indices = 0;
+  unsigned long long total_lit_clusters = 0;
+  unsigned last_max = 0;
+};
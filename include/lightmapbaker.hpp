@@ -0,0 +1,135 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <jobsystem.hpp>
+#include <lightclusters.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct LightmapSettings {
+  // Size of the square lightmap, in texels
+  int resolution = 512;
+  // Texels around each chart, so the bilinear and the first mip levels don't
+  // mix the lighting of neighbouring charts
+  int padding = 2;
+  // Rays per texel that find the occlusion of the ambient light, within
+  // `occlusion_distance`
+  unsigned occlusion_rays = 32;
+  float occlusion_distance = 1.0f;
+  // Light that reaches every surface, the AMBIENT of surface.frag
+  float ambient = 0.3f;
+};
+
+// Directional light, shining along `direction`. A black sun is not baked
+struct SunLight {
+  glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+  glm::vec3 color = glm::vec3(0.0f);
+};
+
+// Static geometry unwrapped in the lightmap. The vertices shared by several
+// charts are split, so the mesh has its own vertices and triangles
+struct LightmapMesh {
+  // Vertex of the input mesh of each vertex, to copy its other attributes
+  std::vector<uint32_t> vertex_map;
+  // Lightmap texture coordinates of each vertex
+  std::vector<glm::vec2> coords;
+  std::vector<uint32_t> indices;
+};
+
+// Offline baker of the lighting of the static geometry, done on the CPU:
+// - The triangles are grouped in planar charts (connected and coplanar),
+//   which are packed in shelves of the lightmap with a uniform texel density
+// - A BVH of the same triangles traces the shadow rays of the lights and the
+//   occlusion rays of the ambient light of every texel, in parallel jobs
+// - The result is written with its mip levels as a KTX file (RGBA16F), so
+//   surface.frag shades the static geometry with a single texture fetch
+// The unwrap is deterministic, so the lightmap coordinates of a baked file
+// are found again by unwrapping the same geometry without baking it. The
+// faces are lit on the side of their counter-clockwise winding
+class LightmapBaker {
+public:
+  explicit LightmapBaker(const LightmapSettings &settings = {});
+
+  LightmapBaker(const LightmapBaker &) = delete;
+  LightmapBaker &operator=(const LightmapBaker &) = delete;
+
+  // Unwraps the triangles (in world space) in charts of the lightmap, and
+  // keeps them as the occluders of the bake. Fails if the charts don't fit in
+  // the lightmap even with a single texel each
+  bool unwrap(const std::vector<glm::vec3> &positions,
+              const std::vector<uint32_t> &indices);
+
+  // Bakes the ambient, the point lights (with the falloff of surface.frag) and
+  // the sun into the lightmap. Blocks until done
+  void bake(JobSystem &jobs, const std::vector<PointLight> &lights,
+            const SunLight &sun);
+
+  // Writes the lightmap and its mip levels as a KTX file
+  bool write(const std::string &path) const;
+
+  const LightmapMesh &mesh() const { return unwrapped; }
+  size_t num_charts() const { return charts.size(); }
+
+  // Prints the packing and the cost of the last bake
+  void print_summary() const;
+
+private:
+  // Coplanar triangles mapped to a rectangle of the lightmap. The texel
+  // (x, y) of the lightmap is at u * tangent + v * bitangent + plane * normal,
+  // with u = uv_min.x + (x + 0.5 - rect_x - padding) / density, and the same
+  // for v
+  struct Chart {
+    std::vector<uint32_t> triangles;
+    glm::vec3 normal, tangent, bitangent;
+    float plane;
+    glm::vec2 uv_min, uv_max;
+    int rect_x = 0, rect_y = 0, rect_width = 0, rect_height = 0;
+  };
+  struct BvhNode {
+    glm::vec3 bounds_min;
+    // First triangle of a leaf, or the second child of an inner node (the
+    // first one follows the node)
+    uint32_t offset;
+    glm::vec3 bounds_max;
+    // Triangles of a leaf, 0 for inner nodes
+    uint32_t count;
+  };
+  // Triangle prepared for the intersection tests
+  struct Triangle {
+    glm::vec3 vertex, edge1, edge2;
+  };
+
+  void build_charts(const std::vector<glm::vec3> &positions,
+                    const std::vector<uint32_t> &indices);
+  bool pack(float density);
+  uint32_t build_bvh(uint32_t begin, uint32_t end);
+  // True if something is hit by the ray before `max_distance`
+  bool occluded(const glm::vec3 &origin, const glm::vec3 &direction,
+                float max_distance) const;
+  glm::vec3 bake_texel(const Chart &chart, int x, int y,
+                       const std::vector<PointLight> &lights,
+                       const SunLight &sun, uint64_t &rays) const;
+
+  LightmapSettings settings;
+  std::vector<Chart> charts;
+  float density = 0.0f;
+  LightmapMesh unwrapped;
+
+  std::vector<Triangle> triangles;
+  std::vector<BvhNode> nodes;
+
+  // Linear RGB of each texel, the first texel is the bottom left one
+  std::vector<glm::vec3> texels;
+
+  size_t used_texels = 0;
+  unsigned long long num_rays = 0;
+  double bake_ms = 0.0;
+  unsigned bake_threads = 0;
+};
+
+// Loads a lightmap written by LightmapBaker::write with all its mip levels,
+// returning 0 if the file can't be read
+GLuint load_lightmap(const std::string &path);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// CPU profiler of scoped zones. Each zone records its start and end time in a
+// buffer of the calling thread, so recording doesn't take any lock. The
+// recorded zones can be exported as a Chrome trace (open it in
+// chrome://tracing or https://ui.perfetto.dev) and summarized per frame.
+// Zones cost a single atomic load while the profiler is disabled
+//
+//   void update() {
+//     PROFILE_ZONE("Update");
+//     ...
+//   }
+
+extern std::atomic<bool> profiler_active;
+
+inline bool profiler_enabled() {
+  return profiler_active.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds since an arbitrary point in time
+inline uint64_t profiler_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void profiler_enable(bool enabled);
+
+// Records a zone. `name` must outlive the profiler (use string literals)
+void profiler_record(const char *name, uint64_t start, uint64_t end);
+
+// Timeline of zones not measured by a thread, like the GPU passes. The zones
+// of a track must be recorded by one thread at a time
+struct ProfileTrack;
+ProfileTrack *profiler_track(const std::string &name);
+void profiler_record(ProfileTrack *track, const char *name, uint64_t start,
+                     uint64_t end);
+
+// Name shown for the calling thread in the trace
+void profiler_thread_name(const std::string &name);
+
+// Marks the start of a new frame, to summarize the zones per frame
+void profiler_frame_mark();
+
+// Writes the recorded zones as Chrome trace JSON. Call it when the profiled
+// threads are done or paused
+bool profiler_write_chrome_trace(const std::string &filepath);
+
+// Prints the average and worst time per frame of each zone
+void profiler_print_summary();
+
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name)
+      : name(name), start(profiler_enabled() ? profiler_now() : 0) {}
+  ~ProfileZone() {
+    if (start != 0) {
+      profiler_record(name, start, profiler_now());
+    }
+  }
+
+  ProfileZone(const ProfileZone &) = delete;
+  ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+  const char *name;
+  uint64_t start;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+// Times the rest of the enclosing scope
+#define PROFILE_ZONE(name)                                                     \
+  ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
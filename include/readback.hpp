@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <vector>
+
+// Reads rendered frames back to the CPU without stalling the pipeline. Each
+// capture copies the current read framebuffer into one of a ring of pixel
+// pack buffers, which returns immediately, and the pixels are handed to the
+// consumer once a fence tells the copy is done, usually a few frames later.
+// The capture only blocks if all the buffers are still waiting for the GPU
+class FrameReadback {
+public:
+  // Receives the RGBA pixels of a frame, bottom row first. The pointer is only
+  // valid during the call, so slow consumers should copy the data and process
+  // it in another thread
+  using Consumer =
+      std::function<void(const unsigned char *rgba, int width, int height,
+                         unsigned long long frame)>;
+
+  FrameReadback(int width, int height, Consumer consumer,
+                unsigned num_buffers = 3);
+  ~FrameReadback();
+
+  FrameReadback(const FrameReadback &) = delete;
+  FrameReadback &operator=(const FrameReadback &) = delete;
+
+  // Starts copying the current read framebuffer. Call it after drawing the
+  // frame and before swapping the buffers
+  void capture(unsigned long long frame);
+
+  // Delivers the frames whose copy is done, without waiting
+  void poll();
+
+  // Waits for all the pending copies and delivers them
+  void flush();
+
+  // Changes the size of the captured frames, delivering the pending ones
+  void resize(int width, int height);
+
+  int width() const { return frame_width; }
+  int height() const { return frame_height; }
+  unsigned pending() const { return in_flight; }
+  // Number of captures that had to wait for the GPU because the ring was full
+  unsigned long long num_stalls() const { return stalls; }
+
+private:
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    unsigned long long frame = 0;
+  };
+
+  void allocate_buffers();
+  // Maps the oldest pending slot and passes its pixels to the consumer
+  void deliver_oldest();
+  bool oldest_ready();
+  unsigned oldest_slot() const {
+    return (next_slot + slots.size() - in_flight) % slots.size();
+  }
+
+  Consumer consumer;
+  int frame_width;
+  int frame_height;
+  std::vector<Slot> slots;
+  // Next slot to capture into and number of slots waiting for the GPU
+  unsigned next_slot = 0;
+  unsigned in_flight = 0;
+  unsigned long long stalls = 0;
+};
+
+// Converts the pixels delivered by `FrameReadback` to tightly packed RGB, top
+// row first, as expected by the image writers
+std::vector<unsigned char> readback_to_rgb(const unsigned char *rgba, int width,
+                                           int height);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <vector>
+
+// Offscreen framebuffer with a RGBA8 color texture and a depth texture
+class RenderTarget {
+public:
+  RenderTarget(int width, int height);
+  ~RenderTarget();
+
+  RenderTarget(const RenderTarget &) = delete;
+  RenderTarget &operator=(const RenderTarget &) = delete;
+
+  // Binds the framebuffer for drawing and sets the viewport
+  void bind() const;
+
+  // Restricts the drawing and the copies to the bottom-left `width` x
+  // `height` region (the whole target by default), to draw at a lower
+  // resolution without reallocating
+  void set_viewport(int width, int height);
+
+  // Copies the color of the viewport to `framebuffer`, scaled to `width` x
+  // `height`, and leaves `framebuffer` bound
+  void blit_to(GLuint framebuffer, int width, int height,
+               GLenum filter = GL_LINEAR) const;
+
+  GLuint framebuffer() const { return fbo; }
+  GLuint color_texture() const { return color; }
+  GLuint depth_texture() const { return depth; }
+  int width() const { return target_width; }
+  int height() const { return target_height; }
+  int viewport_width() const { return region_width; }
+  int viewport_height() const { return region_height; }
+
+private:
+  GLuint fbo = 0;
+  GLuint color = 0;
+  GLuint depth = 0;
+  int target_width;
+  int target_height;
+  int region_width;
+  int region_height;
+};
+
+// Render target that follows the size of the window. A resize only records
+// the requested size, and the target is reallocated when a frame begins once
+// that size has not changed for `settle_frames` frames, so dragging the window
+// border reallocates it once instead of on every event. Meanwhile the frames
+// are drawn at the previous size. The replaced targets are released when a
+// fence tells that the frames in flight that used them are done
+class ResizableTarget {
+public:
+  ResizableTarget(int width, int height, unsigned settle_frames = 3);
+  ~ResizableTarget();
+
+  ResizableTarget(const ResizableTarget &) = delete;
+  ResizableTarget &operator=(const ResizableTarget &) = delete;
+
+  // Requests a new size. Empty sizes (minimized window) are ignored
+  void resize(int width, int height);
+
+  // Returns the target to draw the next frame into, reallocated if the
+  // requested size has settled, and releases the retired targets that the
+  // GPU is done with
+  RenderTarget &begin_frame();
+
+  RenderTarget &current() const { return *target; }
+  unsigned long long num_allocations() const { return allocations; }
+  // Replaced targets still waiting for the GPU
+  size_t num_retired() const { return retired.size(); }
+
+private:
+  struct Retired {
+    std::unique_ptr<RenderTarget> target;
+    GLsync fence;
+  };
+
+  void release_finished();
+
+  std::unique_ptr<RenderTarget> target;
+  std::vector<Retired> retired;
+  int requested_width;
+  int requested_height;
+  unsigned settle_frames;
+  // Frames begun since the requested size last changed
+  unsigned stable_frames = 0;
+  unsigned long long allocations = 1;
+};
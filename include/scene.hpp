@@ -0,0 +1,104 @@
+#pragma once
+
+#include <frustum.hpp>
+#include <glm/glm.hpp>
+#include <jobsystem.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Config for the turn animation speed of the houses
+const int HOUSE_MIN_SPEED = 2;
+const int HOUSE_MAX_SPEED = 5;
+// Radius of the sphere that contains a house (walls + roof) centered in its
+// position, for any rotation over the Y axis
+const float HOUSE_BOUNDING_RADIUS = 0.87f;
+
+// Animated houses stored as separate arrays, so that each stage of the frame
+// update only touches the data it needs and can be split in chunks
+struct HouseInstances {
+  std::vector<glm::vec3> positions;
+  // Signed rotation speed over the Y axis in radians per second
+  std::vector<float> turn_speeds;
+  // Model matrices computed by `update_transforms`
+  std::vector<glm::mat4> models;
+
+  size_t size() const { return positions.size(); }
+  void add(const glm::vec3 &position, float turn_speed);
+};
+
+// Houses that passed the culling stage. The visibility is computed per chunk
+// so that the instance data can be filled in parallel without locks
+struct VisibleSet {
+  std::vector<uint8_t> flags;
+  size_t chunk_size = 0;
+  // Visible houses in each chunk and where they start in the instance data
+  std::vector<uint32_t> chunk_counts;
+  std::vector<uint32_t> chunk_offsets;
+  // Total number of visible houses, available after `fill_instances`
+  size_t count = 0;
+};
+
+// Houses ordered front to back from the camera, so drawing the closest first
+// lets early depth testing reject the hidden fragments of the others. All the
+// houses are sorted, not only the visible ones, so the order stays valid for
+// any visible set and is reused while the camera barely moves
+struct DrawOrder {
+  // House indices by increasing depth from the camera
+  std::vector<uint32_t> sorted;
+  // Visible houses in that order
+  std::vector<uint32_t> visible;
+  // Camera of the last sort
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec3 forward = glm::vec3(0.0f);
+  unsigned long long num_sorts = 0;
+  unsigned long long num_reused = 0;
+  // Scratch of the radix sort, kept between frames
+  std::vector<uint16_t> keys, keys_scratch;
+  std::vector<uint32_t> sorted_scratch;
+  std::vector<uint32_t> histograms;
+};
+
+// Turn speed of the house `index`, alternating the direction between houses
+float house_turn_speed(size_t index);
+
+// Places `count` houses in a square grid centered in the origin
+HouseInstances make_house_grid(size_t count, float spacing);
+
+// Places `count` houses at random in the square that the grid would cover.
+// The same seed gives the same positions on every platform
+HouseInstances make_house_random(size_t count, float spacing, uint32_t seed);
+
+// Stage 1: computes the model matrix of every house at the given time
+void update_transforms(JobSystem &jobs, HouseInstances &houses, float time,
+                       JobCounter &counter);
+
+// Stage 2: tests the bounding sphere of every house against the frustum. It
+// only reads the positions, so it can run at the same time as stage 1. The
+// frustum is copied, but `houses` and `visible` must outlive the jobs
+void cull_houses(JobSystem &jobs, const HouseInstances &houses,
+                 const Frustum &frustum, VisibleSet &visible,
+                 JobCounter &counter);
+
+// Stage 2b: orders the visible houses front to back by their depth from the
+// camera at `position` looking along `forward`, quantized in 16 bits up to
+// `max_depth`, with a parallel radix sort. The order of the last sort is
+// reused if the camera moved or turned only a little since. The culling must
+// be finished before calling it, and it returns once the order is ready
+void sort_front_to_back(JobSystem &jobs, const HouseInstances &houses,
+                        const VisibleSet &visible, const glm::vec3 &position,
+                        const glm::vec3 &forward, float max_depth,
+                        DrawOrder &order);
+
+// Stage 3: copies the model matrices of the visible houses into `instances`,
+// which must have space for all the houses. The culling must be finished
+// before calling it and the jobs start after `transforms` is done
+void fill_instances(JobSystem &jobs, const HouseInstances &houses,
+                    VisibleSet &visible, glm::mat4 *instances,
+                    JobCounter &counter, JobCounter &transforms);
+
+// Same as `fill_instances` in the order of `sort_front_to_back`
+void fill_sorted_instances(JobSystem &jobs, const HouseInstances &houses,
+                           VisibleSet &visible, const DrawOrder &order,
+                           glm::mat4 *instances, JobCounter &counter,
+                           JobCounter &transforms);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Features of a shader variant, each one a #define of the sources
+enum ShaderFeature : unsigned {
+  // The vertex colors (location 1) tint the texture
+  SHADER_VERTEX_COLOR = 1u << 0,
+  // Lit by the clustered point lights and the shadowed sun
+  SHADER_LIGHTING = 1u << 1,
+  // The model matrices are instance attributes (locations 3 to 6)
+  SHADER_INSTANCED = 1u << 2,
+  // Lit by the baked lightmap (coordinates at location 7)
+  SHADER_LIGHTMAP = 1u << 3,
+};
+
+const unsigned NUM_SHADER_FEATURES = 4;
+
+// Variants of a pair of shader sources, selected by a mask of ShaderFeature.
+// Each variant is compiled the first time it is requested, with the defines
+// of its features inserted after the #version directive, and kept until the
+// cache is destroyed. With a `binary_dir`, the linked programs are also saved
+// there, and loaded instead of compiled by the next runs while the sources
+// and the driver are the same (requires GL 4.1 or ARB_get_program_binary)
+class ShaderCache {
+public:
+  // Called once for every new variant, after it is linked or loaded, to set
+  // its uniform block bindings and sampler units
+  using ProgramSetup = std::function<void(GLuint program, unsigned features)>;
+
+  ShaderCache(const std::string &vertex_path, const std::string &fragment_path,
+              const std::string &binary_dir = "");
+  ~ShaderCache();
+
+  ShaderCache(const ShaderCache &) = delete;
+  ShaderCache &operator=(const ShaderCache &) = delete;
+
+  void set_program_setup(ProgramSetup setup) { program_setup = setup; }
+
+  // Program of the variant with the features, built if it's the first use
+  GLuint program(unsigned features);
+  void use(unsigned features) { glUseProgram(program(features)); }
+
+  // Prints how the variants were built
+  void print_summary() const;
+
+private:
+  GLuint build(unsigned features);
+  GLuint compile(unsigned features, const std::string &defines);
+  GLuint load_binary(const std::string &path, uint64_t source_hash);
+  void save_binary(GLuint program, const std::string &path,
+                   uint64_t source_hash);
+
+  std::string name;
+  std::string vertex_source;
+  std::string fragment_source;
+  std::string binary_dir;
+  bool binaries_supported = false;
+  ProgramSetup program_setup;
+
+  // Program of each mask of features, 0 until first used
+  GLuint programs[1u << NUM_SHADER_FEATURES] = {};
+
+  unsigned compiled = 0;
+  unsigned loaded = 0;
+  double build_ms = 0.0;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Most cascades of a shadow atlas, laid out in a 2x2 grid
+const unsigned MAX_SHADOW_CASCADES = 4;
+
+struct ShadowSettings {
+  unsigned cascades = 1;
+  // Size of each cascade in the atlas, in texels
+  int resolution = 1024;
+  // View depth covered by the cascades, beyond it nothing is shadowed
+  float max_distance = 20.0f;
+};
+
+// Cascaded shadow maps of a directional light, with the shadows of the static
+// geometry cached. Each cascade covers a depth range of the view with an
+// orthographic projection that only moves when the view leaves it, snapped
+// to whole texels. The static casters are drawn into a static atlas only when
+// that projection, the light or the static set change. Every frame the static
+// depth of each cascade is copied into the atlas sampled by the shaders, and
+// the dynamic casters are drawn on top of it. A frame is drawn as:
+//
+//   shadows.update(view, projection, light_direction, static_version);
+//   for (unsigned c = 0; c < shadows.num_cascades(); c++) {
+//     if (shadows.begin_static(c))
+//       // Draw the static casters with light_matrix(c)
+//     shadows.begin_dynamic(c);
+//     // Draw the dynamic casters with light_matrix(c)
+//   }
+//   shadows.end();
+class ShadowMaps {
+public:
+  explicit ShadowMaps(const ShadowSettings &settings);
+  ~ShadowMaps();
+
+  ShadowMaps(const ShadowMaps &) = delete;
+  ShadowMaps &operator=(const ShadowMaps &) = delete;
+
+  // Fits the cascades to the view for a light shining along
+  // `light_direction` (in world space). Increase `static_version` when the
+  // static geometry changes
+  void update(const glm::mat4 &view, const glm::mat4 &projection,
+              const glm::vec3 &light_direction,
+              unsigned long long static_version);
+
+  // Prepares to draw the static casters of the cascade, returning false if
+  // its cached shadows are still valid and nothing needs to be drawn
+  bool begin_static(unsigned cascade);
+  // Copies the static shadows of the cascade and prepares to draw the
+  // dynamic casters over them
+  void begin_dynamic(unsigned cascade);
+  // Restores the state changed by the shadow passes. The framebuffer and the
+  // viewport must be bound again
+  void end();
+
+  // Binds the atlas, sampled with depth comparison, to the texture unit
+  void bind(GLuint unit) const;
+
+  unsigned num_cascades() const { return settings.cascades; }
+  // World space to the clip space of the cascade, for the casters
+  const glm::mat4 &light_matrix(unsigned cascade) const {
+    return cascades[cascade].light_matrix;
+  }
+  // View space to the atlas texture coordinates and depth, for the shaders
+  const glm::mat4 &shadow_matrix(unsigned cascade) const {
+    return cascades[cascade].shadow_matrix;
+  }
+  // Farthest view depth of each cascade
+  glm::vec4 cascade_splits() const { return splits; }
+
+  unsigned long long num_updates() const { return updates; }
+  // Cascades whose static shadows were drawn again
+  unsigned long long num_static_draws() const { return static_draws; }
+  // Cascades that moved to follow the view
+  unsigned long long num_moves() const { return moves; }
+
+  // Prints how often the static shadows were drawn
+  void print_summary() const;
+
+private:
+  struct Cascade {
+    // Light space center of the projection, and the half size of the box
+    glm::vec3 center = glm::vec3(0.0f);
+    float extent = 0.0f;
+    bool placed = false;
+    glm::mat4 light_matrix = glm::mat4(1.0f);
+    glm::mat4 shadow_matrix = glm::mat4(1.0f);
+    // Projection and static version of the cached static shadows
+    glm::mat4 static_matrix = glm::mat4(0.0f);
+    unsigned long long static_version = 0;
+    bool static_valid = false;
+  };
+
+  // Sets the viewport and scissor to the region of the cascade in the atlas
+  void select_region(unsigned cascade) const;
+
+  ShadowSettings settings;
+  int columns;
+  int rows;
+  GLuint static_fbo = 0, static_depth = 0;
+  GLuint dynamic_fbo = 0, dynamic_depth = 0;
+  Cascade cascades[MAX_SHADOW_CASCADES];
+  glm::vec4 splits = glm::vec4(0.0f);
+  glm::vec3 direction = glm::vec3(0.0f);
+  unsigned long long static_version = 0;
+
+  unsigned long long updates = 0;
+  unsigned long long static_draws = 0;
+  unsigned long long moves = 0;
+};
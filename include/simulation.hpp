@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Advances a `State` with a constant time step, independently of the frame
+// rate, so the simulation is deterministic and its cost per second bounded.
+// The last two states are kept to render an interpolation between them using
+// the real elapsed time, which requires a function
+// `State interpolate(const State &a, const State &b, float alpha)`.
+// The ticks run in the thread calling `update`, or in a dedicated thread
+template <typename State> class Simulation {
+public:
+  using TickFn = std::function<void(State &state, double dt)>;
+
+  Simulation(double tick_rate, const State &initial, TickFn tick,
+             bool threaded = false, unsigned max_ticks_per_update = 8)
+      : tick_fn(std::move(tick)), dt(1.0 / tick_rate),
+        max_ticks(max_ticks_per_update), previous(initial), current(initial),
+        next_tick_time(dt), start(std::chrono::steady_clock::now()) {
+    if (threaded) {
+      tick_thread = std::thread(&Simulation::thread_loop, this);
+    }
+  }
+
+  ~Simulation() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    stop_requested.notify_all();
+    if (tick_thread.joinable()) {
+      tick_thread.join();
+    }
+  }
+
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  double tick_duration() const { return dt; }
+
+  // Seconds elapsed since the simulation was created
+  double time() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+
+  // Runs the ticks that are due. Does nothing if the ticks run in a thread
+  void update() {
+    if (!tick_thread.joinable()) {
+      run_due_ticks(time());
+    }
+  }
+
+  // State to render now, interpolated between the last two ticks
+  State sample() {
+    const double now = time();
+    std::lock_guard<std::mutex> lock(mutex);
+    const float alpha = std::clamp((now - last_tick_time) / dt, 0.0, 1.0);
+    return interpolate(previous, current, alpha);
+  }
+
+  unsigned long long num_ticks() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ticks;
+  }
+
+private:
+  void run_due_ticks(double now) {
+    unsigned due_ticks = 0;
+    while (next_tick_time <= now) {
+      if (due_ticks == max_ticks) {
+        // Too far behind (e.g. after a stall): drop the remaining time instead
+        // of trying to catch up, which would make the next frames even slower
+        next_tick_time = now + dt;
+        break;
+      }
+      // Only this thread writes `current`, so it can be read without the lock
+      State next = current;
+      tick_fn(next, dt);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        previous = current;
+        current = next;
+        last_tick_time = next_tick_time;
+        ticks++;
+      }
+      next_tick_time += dt;
+      due_ticks++;
+    }
+  }
+
+  void thread_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      lock.unlock();
+      run_due_ticks(time());
+      lock.lock();
+      // Sleep until the next tick is due
+      const std::chrono::duration<double> wake_offset(next_tick_time);
+      const auto wake_time =
+          start +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              wake_offset);
+      stop_requested.wait_until(lock, wake_time, [this]() { return stopping; });
+    }
+  }
+
+  TickFn tick_fn;
+  const double dt;
+  const unsigned max_ticks;
+  // States of the last two ticks and the time of the last one
+  State previous;
+  State current;
+  double last_tick_time = 0.0;
+  unsigned long long ticks = 0;
+  // Only accessed by the thread running the ticks
+  double next_tick_time;
+  const std::chrono::steady_clock::time_point start;
+  std::thread tick_thread;
+  bool stopping = false;
+  std::mutex mutex;
+  std::condition_variable stop_requested;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+// Hands frames from a producer thread to a consumer thread using 3 slots: the
+// producer writes into one slot while the consumer reads another one, and the
+// third holds the latest published frame. The producer never blocks on the
+// consumer, and if it publishes faster the older frames are dropped
+template <typename T> class TripleBuffer {
+public:
+  // Producer: slot where the next frame has to be written
+  T &write_slot() { return slots[write_index]; }
+
+  // Producer: makes the written frame the latest one available
+  void publish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::swap(write_index, ready_index);
+      if (has_new) {
+        dropped++;
+      }
+      has_new = true;
+      published++;
+    }
+    changed.notify_all();
+  }
+
+  // Producer: waits until the consumer takes the last published frame or the
+  // timeout expires. Returns true if the frame was taken
+  template <typename Rep, typename Period>
+  bool wait_consumed(std::chrono::duration<Rep, Period> timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, timeout,
+                            [this]() { return !has_new || closed; });
+  }
+
+  // Consumer: blocks until a new frame is published and returns it. Returns
+  // nullptr once the buffer is closed
+  const T *acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return has_new || closed; });
+    if (!has_new) {
+      return nullptr;
+    }
+    std::swap(read_index, ready_index);
+    has_new = false;
+    lock.unlock();
+    changed.notify_all();
+    return &slots[read_index];
+  }
+
+  // Wakes up both sides to stop the handoff
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    changed.notify_all();
+  }
+
+  // Frames published by the producer and frames replaced before being read
+  unsigned long long num_published() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return published;
+  }
+  unsigned long long num_dropped() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+  }
+
+private:
+  T slots[3];
+  int write_index = 0;
+  int ready_index = 1;
+  int read_index = 2;
+  bool has_new = false;
+  bool closed = false;
+  unsigned long long published = 0;
+  unsigned long long dropped = 0;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
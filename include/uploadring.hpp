@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// Flags of GL_ARB_buffer_storage, not included in the glad loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// Ring buffer to stream per-frame data (instances, uniforms) to the GPU. The
+// buffer is split in one region per frame in flight, and the CPU writes the
+// data of a frame directly into its region, without driver copies:
+// - With GL_ARB_buffer_storage (or GL 4.4) the whole buffer is mapped once
+//   as persistent and coherent, and a fence per region ensures the GPU is
+//   done with it before it is written again
+// - Otherwise each region is mapped unsynchronized every frame, orphaning the
+//   buffer when going back to the first region so the driver hands new
+//   storage instead of waiting for the GPU
+// Requires `load_gl` to resolve glBufferStorage
+class UploadRing {
+public:
+  struct Allocation {
+    void *data;
+    // Offset from the start of the buffer, to bind or point attributes to it
+    GLintptr offset;
+  };
+
+  UploadRing(GLenum target, size_t frame_size, unsigned num_frames = 3);
+  ~UploadRing();
+
+  UploadRing(const UploadRing &) = delete;
+  UploadRing &operator=(const UploadRing &) = delete;
+
+  // Moves to the next region, waiting only if the GPU is still using it
+  void begin_frame();
+
+  // Reserves space in the current region. Returns a null `data` if the
+  // region is full
+  Allocation allocate(size_t size, size_t alignment = 16);
+
+  // Makes the data written in the frame visible to the GPU. Call it before
+  // the draw calls that read it
+  void commit();
+
+  // Fences the commands that read the region. Call it after submitting the
+  // draw calls that use the frame data
+  void end_frame();
+
+  GLuint buffer() const { return buffer_id; }
+  GLenum target() const { return buffer_target; }
+  bool persistent() const { return persistent_map != nullptr; }
+  size_t frame_size() const { return region_size; }
+
+private:
+  GLuint buffer_id = 0;
+  GLenum buffer_target;
+  size_t region_size;
+  unsigned num_regions;
+  unsigned current_region = 0;
+  // Write position inside the current region
+  size_t region_used = 0;
+  // Pointer to the whole buffer when mapped persistently
+  char *persistent_map = nullptr;
+  // Pointer to the current region in the fallback path
+  char *region_map = nullptr;
+  std::vector<GLsync> fences;
+  bool first_frame = true;
+};
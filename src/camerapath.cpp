@@ -0,0 +1,121 @@
+#include <camerapath.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Header of the binary log
+const char MAGIC[4] = {'C', 'P', 'T', 'H'};
+const uint32_t VERSION = 1;
+// Floats stored per pose
+const size_t POSE_FLOATS = 7;
+
+static bool same_pose(const CameraPose &a, const CameraPose &b) {
+  return a.position == b.position && a.yaw == b.yaw && a.pitch == b.pitch &&
+         a.zoom == b.zoom;
+}
+
+void CameraPath::record(float time, const Camera &camera) {
+  const CameraPose pose = {time, camera.Position, camera.Yaw, camera.Pitch,
+                           camera.Zoom};
+  // Extend the last pose instead of adding another one while still
+  const size_t count = poses.size();
+  if (count >= 2 && same_pose(pose, poses[count - 1]) &&
+      same_pose(pose, poses[count - 2])) {
+    poses.back().time = time;
+    return;
+  }
+  poses.push_back(pose);
+}
+
+void CameraPath::apply(float time, Camera &camera) const {
+  if (poses.empty()) {
+    return;
+  }
+  // First pose after `time`, interpolating from the previous one
+  const auto next = std::upper_bound(
+      poses.begin(), poses.end(), time,
+      [](float time, const CameraPose &pose) { return time < pose.time; });
+  CameraPose pose;
+  if (next == poses.begin()) {
+    pose = poses.front();
+  } else if (next == poses.end()) {
+    pose = poses.back();
+  } else {
+    const CameraPose &a = *(next - 1);
+    const CameraPose &b = *next;
+    const float alpha = (time - a.time) / (b.time - a.time);
+    pose.position = glm::mix(a.position, b.position, alpha);
+    pose.yaw = a.yaw + (b.yaw - a.yaw) * alpha;
+    pose.pitch = a.pitch + (b.pitch - a.pitch) * alpha;
+    pose.zoom = a.zoom + (b.zoom - a.zoom) * alpha;
+  }
+  camera.Position = pose.position;
+  camera.Zoom = pose.zoom;
+  camera.SetOrientation(pose.yaw, pose.pitch);
+}
+
+bool CameraPath::save(const std::string &filepath) const {
+  std::ofstream file(filepath, std::ios::binary);
+  if (!file) {
+    std::cout << "Could not open " << filepath << " for writing" << std::endl;
+    return false;
+  }
+  const uint32_t count = poses.size();
+  file.write(MAGIC, sizeof(MAGIC));
+  file.write(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+  file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (const CameraPose &pose : poses) {
+    const float values[POSE_FLOATS] = {pose.time,       pose.position.x,
+                                       pose.position.y, pose.position.z,
+                                       pose.yaw,        pose.pitch,
+                                       pose.zoom};
+    file.write(reinterpret_cast<const char *>(values), sizeof(values));
+  }
+  return file.good();
+}
+
+bool CameraPath::load(const std::string &filepath) {
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file) {
+    std::cout << "Could not open " << filepath << std::endl;
+    return false;
+  }
+  char magic[sizeof(MAGIC)];
+  uint32_t version = 0, count = 0;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&count), sizeof(count));
+  if (!file || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      version != VERSION) {
+    std::cout << filepath << " is not a camera path" << std::endl;
+    return false;
+  }
+  // Check the count against the size of the file before allocating the poses
+  const std::streampos poses_begin = file.tellg();
+  file.seekg(0, std::ios::end);
+  const std::streamoff remaining = file.tellg() - poses_begin;
+  file.seekg(poses_begin);
+  if (!file || static_cast<uint64_t>(remaining) <
+                   uint64_t{count} * POSE_FLOATS * sizeof(float)) {
+    std::cout << "The camera path " << filepath << " is truncated"
+              << std::endl;
+    return false;
+  }
+  std::vector<CameraPose> loaded(count);
+  for (CameraPose &pose : loaded) {
+    float values[POSE_FLOATS];
+    file.read(reinterpret_cast<char *>(values), sizeof(values));
+    pose = {values[0], glm::vec3(values[1], values[2], values[3]), values[4],
+            values[5], values[6]};
+  }
+  if (!file) {
+    std::cout << "The camera path " << filepath << " is truncated"
+              << std::endl;
+    return false;
+  }
+  poses = std::move(loaded);
+  return true;
+}
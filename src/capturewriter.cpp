@@ -0,0 +1,233 @@
+#include <capturewriter.hpp>
+#include <glutils.hpp>
+#include <readback.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+// Splits `path` in the part before the extension and the extension (with the
+// dot), which is lower case
+static void split_extension(const std::string &path, std::string &stem,
+                            std::string &extension) {
+  const size_t slash = path.find_last_of("/\\");
+  const size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    stem = path;
+    extension.clear();
+    return;
+  }
+  stem = path.substr(0, dot);
+  extension = path.substr(dot);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+}
+
+CaptureWriter::CaptureWriter(const std::string &path, int frame_rate,
+                             unsigned num_threads, size_t max_queued_frames)
+    : output_path(path), fps(frame_rate),
+      max_queued(std::max<size_t>(max_queued_frames, 1)) {
+  std::string stem, extension;
+  split_extension(path, stem, extension);
+  if (extension == ".ppm") {
+    capture_format = CaptureFormat::PPM;
+  } else if (extension == ".png") {
+    capture_format = CaptureFormat::PNG;
+  } else if (extension == ".y4m") {
+    capture_format = CaptureFormat::Y4M;
+    video_file = std::fopen(path.c_str(), "wb");
+    if (!video_file) {
+      std::cout << "Could not open " << path << " for writing" << std::endl;
+      is_valid = false;
+    }
+  } else {
+    std::cout << "Unknown capture format " << path
+              << " (use .ppm, .png or .y4m)" << std::endl;
+    capture_format = CaptureFormat::PPM;
+    is_valid = false;
+  }
+
+  if (is_valid) {
+    for (unsigned i = 0; i < std::max(num_threads, 1u); i++) {
+      workers.emplace_back(&CaptureWriter::worker_loop, this);
+    }
+  }
+}
+
+CaptureWriter::~CaptureWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  frame_queued.notify_all();
+  // The workers empty the queue before exiting
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  if (video_file) {
+    std::fclose(video_file);
+  }
+}
+
+void CaptureWriter::submit(const unsigned char *rgba, int width, int height,
+                           unsigned long long frame) {
+  if (!is_valid) {
+    return;
+  }
+  std::vector<unsigned char> buffer;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size() >= max_queued) {
+      blocked++;
+      frame_done.wait(lock, [this]() { return queue.size() < max_queued; });
+    }
+    if (!free_buffers.empty()) {
+      buffer = std::move(free_buffers.back());
+      free_buffers.pop_back();
+    }
+  }
+  // Copy the pixels without blocking the writers
+  buffer.assign(rgba, rgba + static_cast<size_t>(width) * height * 4);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(
+        {std::move(buffer), width, height, frame, next_sequence++});
+  }
+  frame_queued.notify_one();
+}
+
+void CaptureWriter::finish() {
+  std::unique_lock<std::mutex> lock(mutex);
+  frame_done.wait(lock,
+                  [this]() { return queue.empty() && busy_workers == 0; });
+}
+
+unsigned long long CaptureWriter::num_written() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return written;
+}
+
+unsigned long long CaptureWriter::num_blocked() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return blocked;
+}
+
+void CaptureWriter::worker_loop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    frame_queued.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    QueuedFrame frame = std::move(queue.front());
+    queue.pop_front();
+    busy_workers++;
+    lock.unlock();
+    // There is room in the queue for another frame
+    frame_done.notify_all();
+
+    if (capture_format == CaptureFormat::Y4M) {
+      write_video_frame(frame);
+    } else {
+      write_image(frame);
+    }
+
+    lock.lock();
+    busy_workers--;
+    written++;
+    free_buffers.push_back(std::move(frame.rgba));
+    frame_done.notify_all();
+  }
+}
+
+void CaptureWriter::write_image(const QueuedFrame &frame) {
+  std::string stem, extension;
+  split_extension(output_path, stem, extension);
+  char number[32];
+  std::snprintf(number, sizeof(number), "_%06llu", frame.frame);
+  const std::string path = stem + number + extension;
+
+  const std::vector<unsigned char> rgb =
+      readback_to_rgb(frame.rgba.data(), frame.width, frame.height);
+  bool saved;
+  if (capture_format == CaptureFormat::PNG) {
+    saved = stbi_write_png(path.c_str(), frame.width, frame.height, 3,
+                           rgb.data(), frame.width * 3) != 0;
+  } else {
+    saved = write_ppm(path, frame.width, frame.height, rgb.data());
+  }
+  if (!saved) {
+    std::cout << "Could not write " << path << std::endl;
+  }
+}
+
+void CaptureWriter::write_video_frame(const QueuedFrame &frame) {
+  // Convert to YUV 4:2:0 (full range BT.601, as declared by `C420jpeg`) in
+  // parallel with the other writers
+  const int width = frame.width, height = frame.height;
+  const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  std::vector<unsigned char> yuv(static_cast<size_t>(width) * height +
+                                 2 * chroma_width * chroma_height);
+  unsigned char *y_plane = yuv.data();
+  unsigned char *u_plane = y_plane + static_cast<size_t>(width) * height;
+  unsigned char *v_plane = u_plane + chroma_width * chroma_height;
+  // The rows of the frame are bottom first
+  auto pixel = [&](int x, int y) {
+    return frame.rgba.data() +
+           (static_cast<size_t>(height - 1 - y) * width + x) * 4;
+  };
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const unsigned char *p = pixel(x, y);
+      y_plane[y * width + x] = static_cast<unsigned char>(
+          0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f);
+    }
+  }
+  for (int cy = 0; cy < chroma_height; cy++) {
+    for (int cx = 0; cx < chroma_width; cx++) {
+      // Average the 2x2 block, clamped at the right and bottom edges
+      float r = 0.0f, g = 0.0f, b = 0.0f;
+      for (int dy = 0; dy < 2; dy++) {
+        for (int dx = 0; dx < 2; dx++) {
+          const unsigned char *p = pixel(std::min(cx * 2 + dx, width - 1),
+                                         std::min(cy * 2 + dy, height - 1));
+          r += p[0];
+          g += p[1];
+          b += p[2];
+        }
+      }
+      r *= 0.25f;
+      g *= 0.25f;
+      b *= 0.25f;
+      const float u = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b;
+      const float v = 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b;
+      u_plane[cy * chroma_width + cx] =
+          static_cast<unsigned char>(std::clamp(u + 0.5f, 0.0f, 255.0f));
+      v_plane[cy * chroma_width + cx] =
+          static_cast<unsigned char>(std::clamp(v + 0.5f, 0.0f, 255.0f));
+    }
+  }
+
+  // Wait for the turn of this frame, since the video is a single stream
+  std::unique_lock<std::mutex> lock(video_mutex);
+  video_turn.wait(lock,
+                  [&]() { return next_video_sequence == frame.sequence; });
+  if (video_width == 0) {
+    video_width = width;
+    video_height = height;
+    std::fprintf(video_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                 width, height, fps);
+  }
+  if (width == video_width && height == video_height) {
+    std::fputs("FRAME\n", video_file);
+    std::fwrite(yuv.data(), 1, yuv.size(), video_file);
+  } else {
+    std::cout << "Skipping captured frame " << frame.frame
+              << " with a different size than the video" << std::endl;
+  }
+  next_video_sequence++;
+  lock.unlock();
+  video_turn.notify_all();
+}
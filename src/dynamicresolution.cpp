@@ -0,0 +1,48 @@
+#include <dynamicresolution.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Frames whose scale is remembered, more than the GPU timer keeps in flight
+const size_t REMEMBERED_FRAMES = 16;
+// Fraction of the budget that the scale aims for, leaving room for noise
+const double HEADROOM = 0.9;
+// Weight of a new time below the smoothed one (times above replace it)
+const double SMOOTHING = 0.1;
+// Largest increase of the scale for each measured frame
+const float MAX_SCALE_STEP = 0.02f;
+
+DynamicResolution::DynamicResolution(const DynamicResolutionSettings &settings)
+    : config(settings), current_scale(settings.max_scale),
+      frame_scales(REMEMBERED_FRAMES) {}
+
+float DynamicResolution::begin_frame(unsigned long long frame) {
+  frame_scales[frame % frame_scales.size()] = {frame, current_scale};
+  return current_scale;
+}
+
+void DynamicResolution::update(unsigned long long frame, double gpu_ms) {
+  const FrameScale &measured = frame_scales[frame % frame_scales.size()];
+  if (measured.frame != frame || measured.scale <= 0.0f || gpu_ms <= 0.0) {
+    return;
+  }
+  // Estimate the time at scale 1, following the increases at once
+  const double full_ms = gpu_ms / (measured.scale * measured.scale);
+  if (full_scale_ms < 0.0 || full_ms > full_scale_ms) {
+    full_scale_ms = full_ms;
+  } else {
+    full_scale_ms += (full_ms - full_scale_ms) * SMOOTHING;
+  }
+
+  // Scale whose time is expected to fit in the budget
+  const double fitting_scale =
+      std::sqrt(config.target_ms * HEADROOM / full_scale_ms);
+  const float fitting = std::clamp(static_cast<float>(fitting_scale),
+                                   config.min_scale, config.max_scale);
+  if (fitting < current_scale) {
+    drops++;
+    current_scale = fitting;
+  } else {
+    current_scale = std::min(fitting, current_scale + MAX_SCALE_STEP);
+  }
+}
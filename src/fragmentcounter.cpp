@@ -0,0 +1,84 @@
+#include <fragmentcounter.hpp>
+#include <glutils.hpp>
+
+FragmentCounter::FragmentCounter(unsigned frames_in_flight)
+    : statistics(has_gl_version(4, 6) ||
+                 has_gl_extension("GL_ARB_pipeline_statistics_query")),
+      slots(frames_in_flight > 0 ? frames_in_flight : 1) {
+  for (Slot &slot : slots) {
+    glGenQueries(1, &slot.samples_query);
+    if (statistics) {
+      glGenQueries(1, &slot.invocations_query);
+    }
+  }
+}
+
+FragmentCounter::~FragmentCounter() {
+  for (Slot &slot : slots) {
+    glDeleteQueries(1, &slot.samples_query);
+    if (statistics) {
+      glDeleteQueries(1, &slot.invocations_query);
+    }
+  }
+}
+
+void FragmentCounter::begin() {
+  // Reuse the slot of the oldest frame, which should be done by now
+  Slot &slot = slots[current];
+  collect(slot, false);
+  glBeginQuery(GL_SAMPLES_PASSED, slot.samples_query);
+  if (statistics) {
+    glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, slot.invocations_query);
+  }
+}
+
+void FragmentCounter::end() {
+  glEndQuery(GL_SAMPLES_PASSED);
+  if (statistics) {
+    glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+  }
+  slots[current].pending = true;
+  current = (current + 1) % slots.size();
+}
+
+void FragmentCounter::finish() {
+  for (size_t i = 0; i < slots.size(); i++) {
+    collect(slots[(current + i) % slots.size()], true);
+  }
+}
+
+void FragmentCounter::reset() {
+  for (Slot &slot : slots) {
+    slot.pending = false;
+  }
+  total_samples = 0;
+  total_invocations = 0;
+  counted = 0;
+}
+
+void FragmentCounter::collect(Slot &slot, bool wait) {
+  if (!slot.pending) {
+    return;
+  }
+  slot.pending = false;
+  // The invocations query ended last, so its result comes last
+  const GLuint last_query =
+      statistics ? slot.invocations_query : slot.samples_query;
+  if (!wait) {
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      return;
+    }
+  }
+  GLuint64 samples = 0;
+  glGetQueryObjectui64v(slot.samples_query, GL_QUERY_RESULT, &samples);
+  total_samples += samples;
+  if (statistics) {
+    GLuint64 invocations = 0;
+    glGetQueryObjectui64v(slot.invocations_query, GL_QUERY_RESULT,
+                          &invocations);
+    total_invocations += invocations;
+  }
+  counted++;
+}
@@ -0,0 +1,211 @@
+#include <framestats.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+// A frame is a spike if it takes this many times the median frame time
+const float SPIKE_FACTOR = 2.0f;
+
+// Nearest-rank percentiles of the values
+static MeasurePercentiles nearest_rank(std::vector<double> values) {
+  MeasurePercentiles result;
+  result.count = values.size();
+  if (values.empty()) {
+    return result;
+  }
+  std::sort(values.begin(), values.end());
+  auto rank = [&values](double percentile) {
+    const size_t index = std::ceil(percentile * values.size()) - 1;
+    return values[std::min(index, values.size() - 1)];
+  };
+  result.p50 = rank(0.50);
+  result.p95 = rank(0.95);
+  result.p99 = rank(0.99);
+  result.max = values.back();
+  return result;
+}
+
+// The measures reported, with a function to get them from a sample. Samples
+// for which a measure is unknown (negative) are ignored
+struct Measure {
+  const char *name;
+  std::function<double(const FrameSample &)> get;
+};
+
+static const Measure MEASURES[] = {
+    {"frame_ms", [](const FrameSample &s) { return s.frame_ms; }},
+    {"cpu_ms", [](const FrameSample &s) { return s.cpu_ms; }},
+    {"gpu_ms", [](const FrameSample &s) { return s.gpu_ms; }},
+    {"draw_calls", [](const FrameSample &s) { return s.draw_calls; }},
+    {"triangles",
+     [](const FrameSample &s) { return static_cast<double>(s.triangles); }},
+    {"state_changes", [](const FrameSample &s) { return s.state_changes; }},
+};
+
+static MeasurePercentiles
+measure_percentiles(const std::vector<FrameSample> &samples,
+                    const Measure &measure) {
+  std::vector<double> values;
+  values.reserve(samples.size());
+  for (const FrameSample &sample : samples) {
+    const double value = measure.get(sample);
+    if (value >= 0.0) {
+      values.push_back(value);
+    }
+  }
+  return nearest_rank(std::move(values));
+}
+
+static std::vector<FrameSample> find_spikes(
+    const std::vector<FrameSample> &samples, double median_frame_ms) {
+  std::vector<FrameSample> spikes;
+  for (const FrameSample &sample : samples) {
+    if (sample.frame_ms > SPIKE_FACTOR * median_frame_ms) {
+      spikes.push_back(sample);
+    }
+  }
+  return spikes;
+}
+
+FrameStats::FrameStats(size_t capacity) : ring(std::max<size_t>(capacity, 1)) {}
+
+void FrameStats::record(const FrameSample &sample) {
+  ring[next] = sample;
+  next = (next + 1) % ring.size();
+  count = std::min(count + 1, ring.size());
+}
+
+void FrameStats::set_gpu_time(unsigned long long frame, float gpu_ms) {
+  if (count == 0) {
+    return;
+  }
+  // The frames are recorded in order, so the age of the frame gives its slot
+  const size_t newest = (next + ring.size() - 1) % ring.size();
+  const unsigned long long age = ring[newest].frame - frame;
+  if (frame > ring[newest].frame || age >= count) {
+    return;
+  }
+  FrameSample &sample = ring[(newest + ring.size() - age) % ring.size()];
+  if (sample.frame == frame) {
+    sample.gpu_ms = gpu_ms;
+  }
+}
+
+MeasurePercentiles FrameStats::percentiles(const std::string &measure) const {
+  for (const Measure &known : MEASURES) {
+    if (measure == known.name) {
+      return measure_percentiles(samples(), known);
+    }
+  }
+  return {};
+}
+
+std::vector<FrameSample> FrameStats::samples() const {
+  std::vector<FrameSample> result;
+  result.reserve(count);
+  const size_t oldest = (next + ring.size() - count) % ring.size();
+  for (size_t i = 0; i < count; i++) {
+    result.push_back(ring[(oldest + i) % ring.size()]);
+  }
+  return result;
+}
+
+void FrameStats::print_summary() const {
+  const std::vector<FrameSample> all = samples();
+  if (all.empty()) {
+    return;
+  }
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "Stats of the last " << all.size()
+            << " frames (p50 / p95 / p99 / max)" << std::endl;
+  for (const Measure &measure : MEASURES) {
+    const MeasurePercentiles result = measure_percentiles(all, measure);
+    if (result.count == 0) {
+      continue;
+    }
+    std::cout << "  " << measure.name << ": " << result.p50 << " / "
+              << result.p95 << " / " << result.p99 << " / " << result.max
+              << std::endl;
+  }
+
+  const MeasurePercentiles frame = measure_percentiles(all, MEASURES[0]);
+  const MeasurePercentiles cpu = measure_percentiles(all, MEASURES[1]);
+  const MeasurePercentiles gpu = measure_percentiles(all, MEASURES[2]);
+  if (gpu.count > 0) {
+    std::cout << "  Mostly " << (gpu.p50 > cpu.p50 ? "GPU" : "CPU")
+              << " bound" << std::endl;
+  }
+  const std::vector<FrameSample> spikes = find_spikes(all, frame.p50);
+  std::cout << "  " << spikes.size() << " spikes over " << std::defaultfloat
+            << SPIKE_FACTOR << std::fixed << "x the median frame time";
+  if (!spikes.empty()) {
+    const FrameSample &worst = *std::max_element(
+        spikes.begin(), spikes.end(), [](const auto &a, const auto &b) {
+          return a.frame_ms < b.frame_ms;
+        });
+    std::cout << " (worst: frame " << worst.frame << ", " << worst.frame_ms
+              << " ms)";
+  }
+  std::cout << std::endl << std::defaultfloat;
+}
+
+bool FrameStats::write_csv(const std::string &filepath) const {
+  std::ofstream file(filepath);
+  if (!file) {
+    std::cout << "Could not open " << filepath << " for writing" << std::endl;
+    return false;
+  }
+  file << "frame,frame_ms,cpu_ms,gpu_ms,draw_calls,triangles,state_changes\n";
+  for (const FrameSample &sample : samples()) {
+    file << sample.frame << "," << sample.frame_ms << "," << sample.cpu_ms
+         << ",";
+    // Leave the GPU time empty if unknown
+    if (sample.gpu_ms >= 0.0f) {
+      file << sample.gpu_ms;
+    }
+    // Same for the counts of the GL hooks
+    file << ",";
+    if (sample.draw_calls >= 0) {
+      file << sample.draw_calls;
+    }
+    file << "," << sample.triangles << ",";
+    if (sample.state_changes >= 0) {
+      file << sample.state_changes;
+    }
+    file << "\n";
+  }
+  return file.good();
+}
+
+bool FrameStats::write_json(const std::string &filepath) const {
+  std::ofstream file(filepath);
+  if (!file) {
+    std::cout << "Could not open " << filepath << " for writing" << std::endl;
+    return false;
+  }
+  const std::vector<FrameSample> all = samples();
+  file << "{\n  \"frames\": " << all.size() << ",\n";
+  MeasurePercentiles frame;
+  for (const Measure &measure : MEASURES) {
+    const MeasurePercentiles result = measure_percentiles(all, measure);
+    if (&measure == &MEASURES[0]) {
+      frame = result;
+    }
+    file << "  \"" << measure.name << "\": {\"count\": " << result.count
+         << ", \"p50\": " << result.p50 << ", \"p95\": " << result.p95
+         << ", \"p99\": " << result.p99 << ", \"max\": " << result.max
+         << "},\n";
+  }
+  file << "  \"spike_factor\": " << SPIKE_FACTOR << ",\n  \"spikes\": [";
+  const std::vector<FrameSample> spikes = find_spikes(all, frame.p50);
+  for (size_t i = 0; i < spikes.size(); i++) {
+    file << (i == 0 ? "\n" : ",\n") << "    {\"frame\": " << spikes[i].frame
+         << ", \"frame_ms\": " << spikes[i].frame_ms << "}";
+  }
+  file << (spikes.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  return file.good();
+}
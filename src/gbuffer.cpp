@@ -0,0 +1,92 @@
+#include <gbuffer.hpp>
+
+#include <iostream>
+
+// Creates a texture read with texelFetch, one texel per pixel
+static GLuint make_texture(GLint internal_format, int width, int height,
+                           GLenum format, GLenum type) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format,
+               type, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+GBuffer::GBuffer(int width, int height)
+    : buffer_width(width), buffer_height(height), region_width(width),
+      region_height(height) {
+  allocate();
+}
+
+GBuffer::~GBuffer() { release(); }
+
+void GBuffer::allocate() {
+  albedo = make_texture(GL_RGBA8, buffer_width, buffer_height, GL_RGBA,
+                        GL_UNSIGNED_BYTE);
+  normal = make_texture(GL_RG16, buffer_width, buffer_height, GL_RG,
+                        GL_UNSIGNED_SHORT);
+  depth = make_texture(GL_DEPTH_COMPONENT24, buffer_width, buffer_height,
+                       GL_DEPTH_COMPONENT, GL_FLOAT);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         albedo, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         normal, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         depth, 0);
+  const GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, draw_buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "G-buffer framebuffer is not complete" << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  allocations++;
+}
+
+void GBuffer::release() {
+  glDeleteFramebuffers(1, &fbo);
+  const GLuint textures[] = {albedo, normal, depth};
+  glDeleteTextures(3, textures);
+}
+
+void GBuffer::resize(int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  region_width = width;
+  region_height = height;
+  if (width <= buffer_width && height <= buffer_height) {
+    return;
+  }
+  // The driver keeps the old attachments alive while the GPU uses them
+  release();
+  if (width > buffer_width) {
+    buffer_width = width + width / 4;
+  }
+  if (height > buffer_height) {
+    buffer_height = height + height / 4;
+  }
+  allocate();
+}
+
+void GBuffer::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, region_width, region_height);
+}
+
+void GBuffer::bind_textures(GLuint first_unit) const {
+  const GLuint textures[] = {albedo, normal, depth};
+  for (GLuint i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + first_unit + i);
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
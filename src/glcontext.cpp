@@ -0,0 +1,160 @@
+#include <glcontext.hpp>
+#include <glutils.hpp>
+#include <iostream>
+
+#ifdef GLUTILS_HAS_EGL
+// Don't let the EGL headers pull the X11 ones
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+
+// Checks if a space separated EGL extensions string contains `name`
+static bool has_egl_extension(const char *extensions, const char *name) {
+  if (!extensions) {
+    return false;
+  }
+  const size_t length = std::strlen(name);
+  for (const char *start = std::strstr(extensions, name); start;
+       start = std::strstr(start + length, name)) {
+    const bool starts_word = start == extensions || start[-1] == ' ';
+    const bool ends_word = start[length] == ' ' || start[length] == '\0';
+    if (starts_word && ends_word) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static EGLDisplay open_display() {
+  // Client extensions are queried without a display
+  const char *client_extensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (has_egl_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    auto getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) {
+      EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+      if (display != EGL_NO_DISPLAY) {
+        return display;
+      }
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessContext::~HeadlessContext() {
+  if (!display) {
+    return;
+  }
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (surface) {
+    eglDestroySurface(display, surface);
+  }
+  if (context) {
+    eglDestroyContext(display, context);
+  }
+  eglTerminate(display);
+}
+
+bool HeadlessContext::create(int major, int minor) {
+  display = open_display();
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+    std::cout << "EGL display could not be initialized" << std::endl;
+    display = nullptr;
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::cout << "EGL doesn't support desktop OpenGL" << std::endl;
+    return false;
+  }
+
+  // A pbuffer config is only needed if the context can't be made current
+  // without surfaces, but it is requested anyway since most drivers have one
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+                                   EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                   EGL_RED_SIZE,        8,
+                                   EGL_GREEN_SIZE,      8,
+                                   EGL_BLUE_SIZE,       8,
+                                   EGL_DEPTH_SIZE,      24,
+                                   EGL_NONE};
+  EGLConfig config = NULL;
+  EGLint num_configs = 0;
+  eglChooseConfig(display, config_attribs, &config, 1, &num_configs);
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+  const bool surfaceless =
+      has_egl_extension(extensions, "EGL_KHR_surfaceless_context");
+  if (num_configs == 0) {
+    if (!surfaceless ||
+        !has_egl_extension(extensions, "EGL_KHR_no_config_context")) {
+      std::cout << "No EGL config available for offscreen rendering"
+                << std::endl;
+      return false;
+    }
+    config = EGL_NO_CONFIG_KHR;
+  }
+
+  const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION,       major,
+      EGL_CONTEXT_MINOR_VERSION,       minor,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    std::cout << "EGL context could not be created (error 0x" << std::hex
+              << eglGetError() << std::dec << ")" << std::endl;
+    context = nullptr;
+    return false;
+  }
+
+  // All the rendering goes to framebuffer objects, so the default surface
+  // (if any) is just a placeholder
+  if (!surfaceless) {
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    if (surface == EGL_NO_SURFACE) {
+      std::cout << "EGL pbuffer could not be created" << std::endl;
+      surface = nullptr;
+      return false;
+    }
+  }
+  make_current();
+
+  // Load OpenGL
+  if (!load_gl((GLADloadproc)eglGetProcAddress)) {
+    std::cout << "OpenGL could not be loaded" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void HeadlessContext::make_current() {
+  EGLSurface draw_surface = surface ? surface : EGL_NO_SURFACE;
+  eglMakeCurrent(display, draw_surface, draw_surface, context);
+}
+
+void HeadlessContext::release() {
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+bool HeadlessContext::supported() { return true; }
+
+#else
+
+HeadlessContext::~HeadlessContext() {}
+
+bool HeadlessContext::create(int, int) {
+  std::cout << "Headless rendering requires building with EGL" << std::endl;
+  return false;
+}
+
+void HeadlessContext::make_current() {}
+
+void HeadlessContext::release() {}
+
+bool HeadlessContext::supported() { return false; }
+
+#endif
@@ -0,0 +1,423 @@
+// Entry points loaded by glad, listed from glad/glad.h with
+//   grep -o '^GLAPI PFN[A-Z0-9_]*PROC glad_gl[A-Za-z0-9_]*' glad.h
+// Regenerate it whenever glad is regenerated
+GL_ENTRY_POINT(glCullFace)
+GL_ENTRY_POINT(glFrontFace)
+GL_ENTRY_POINT(glHint)
+GL_ENTRY_POINT(glLineWidth)
+GL_ENTRY_POINT(glPointSize)
+GL_ENTRY_POINT(glPolygonMode)
+GL_ENTRY_POINT(glScissor)
+GL_ENTRY_POINT(glTexParameterf)
+GL_ENTRY_POINT(glTexParameterfv)
+GL_ENTRY_POINT(glTexParameteri)
+GL_ENTRY_POINT(glTexParameteriv)
+GL_ENTRY_POINT(glTexImage1D)
+GL_ENTRY_POINT(glTexImage2D)
+GL_ENTRY_POINT(glDrawBuffer)
+GL_ENTRY_POINT(glClear)
+GL_ENTRY_POINT(glClearColor)
+GL_ENTRY_POINT(glClearStencil)
+GL_ENTRY_POINT(glClearDepth)
+GL_ENTRY_POINT(glStencilMask)
+GL_ENTRY_POINT(glColorMask)
+GL_ENTRY_POINT(glDepthMask)
+GL_ENTRY_POINT(glDisable)
+GL_ENTRY_POINT(glEnable)
+GL_ENTRY_POINT(glFinish)
+GL_ENTRY_POINT(glFlush)
+GL_ENTRY_POINT(glBlendFunc)
+GL_ENTRY_POINT(glLogicOp)
+GL_ENTRY_POINT(glStencilFunc)
+GL_ENTRY_POINT(glStencilOp)
+GL_ENTRY_POINT(glDepthFunc)
+GL_ENTRY_POINT(glPixelStoref)
+GL_ENTRY_POINT(glPixelStorei)
+GL_ENTRY_POINT(glReadBuffer)
+GL_ENTRY_POINT(glReadPixels)
+GL_ENTRY_POINT(glGetBooleanv)
+GL_ENTRY_POINT(glGetDoublev)
+GL_ENTRY_POINT(glGetError)
+GL_ENTRY_POINT(glGetFloatv)
+GL_ENTRY_POINT(glGetIntegerv)
+GL_ENTRY_POINT(glGetString)
+GL_ENTRY_POINT(glGetTexImage)
+GL_ENTRY_POINT(glGetTexParameterfv)
+GL_ENTRY_POINT(glGetTexParameteriv)
+GL_ENTRY_POINT(glGetTexLevelParameterfv)
+GL_ENTRY_POINT(glGetTexLevelParameteriv)
+GL_ENTRY_POINT(glIsEnabled)
+GL_ENTRY_POINT(glDepthRange)
+GL_ENTRY_POINT(glViewport)
+GL_ENTRY_POINT(glDrawArrays)
+GL_ENTRY_POINT(glDrawElements)
+GL_ENTRY_POINT(glPolygonOffset)
+GL_ENTRY_POINT(glCopyTexImage1D)
+GL_ENTRY_POINT(glCopyTexImage2D)
+GL_ENTRY_POINT(glCopyTexSubImage1D)
+GL_ENTRY_POINT(glCopyTexSubImage2D)
+GL_ENTRY_POINT(glTexSubImage1D)
+GL_ENTRY_POINT(glTexSubImage2D)
+GL_ENTRY_POINT(glBindTexture)
+GL_ENTRY_POINT(glDeleteTextures)
+GL_ENTRY_POINT(glGenTextures)
+GL_ENTRY_POINT(glIsTexture)
+GL_ENTRY_POINT(glDrawRangeElements)
+GL_ENTRY_POINT(glTexImage3D)
+GL_ENTRY_POINT(glTexSubImage3D)
+GL_ENTRY_POINT(glCopyTexSubImage3D)
+GL_ENTRY_POINT(glActiveTexture)
+GL_ENTRY_POINT(glSampleCoverage)
+GL_ENTRY_POINT(glCompressedTexImage3D)
+GL_ENTRY_POINT(glCompressedTexImage2D)
+GL_ENTRY_POINT(glCompressedTexImage1D)
+GL_ENTRY_POINT(glCompressedTexSubImage3D)
+GL_ENTRY_POINT(glCompressedTexSubImage2D)
+GL_ENTRY_POINT(glCompressedTexSubImage1D)
+GL_ENTRY_POINT(glGetCompressedTexImage)
+GL_ENTRY_POINT(glBlendFuncSeparate)
+GL_ENTRY_POINT(glMultiDrawArrays)
+GL_ENTRY_POINT(glMultiDrawElements)
+GL_ENTRY_POINT(glPointParameterf)
+GL_ENTRY_POINT(glPointParameterfv)
+GL_ENTRY_POINT(glPointParameteri)
+GL_ENTRY_POINT(glPointParameteriv)
+GL_ENTRY_POINT(glBlendColor)
+GL_ENTRY_POINT(glBlendEquation)
+GL_ENTRY_POINT(glGenQueries)
+GL_ENTRY_POINT(glDeleteQueries)
+GL_ENTRY_POINT(glIsQuery)
+GL_ENTRY_POINT(glBeginQuery)
+GL_ENTRY_POINT(glEndQuery)
+GL_ENTRY_POINT(glGetQueryiv)
+GL_ENTRY_POINT(glGetQueryObjectiv)
+GL_ENTRY_POINT(glGetQueryObjectuiv)
+GL_ENTRY_POINT(glBindBuffer)
+GL_ENTRY_POINT(glDeleteBuffers)
+GL_ENTRY_POINT(glGenBuffers)
+GL_ENTRY_POINT(glIsBuffer)
+GL_ENTRY_POINT(glBufferData)
+GL_ENTRY_POINT(glBufferSubData)
+GL_ENTRY_POINT(glGetBufferSubData)
+GL_ENTRY_POINT(glMapBuffer)
+GL_ENTRY_POINT(glUnmapBuffer)
+GL_ENTRY_POINT(glGetBufferParameteriv)
+GL_ENTRY_POINT(glGetBufferPointerv)
+GL_ENTRY_POINT(glBlendEquationSeparate)
+GL_ENTRY_POINT(glDrawBuffers)
+GL_ENTRY_POINT(glStencilOpSeparate)
+GL_ENTRY_POINT(glStencilFuncSeparate)
+GL_ENTRY_POINT(glStencilMaskSeparate)
+GL_ENTRY_POINT(glAttachShader)
+GL_ENTRY_POINT(glBindAttribLocation)
+GL_ENTRY_POINT(glCompileShader)
+GL_ENTRY_POINT(glCreateProgram)
+GL_ENTRY_POINT(glCreateShader)
+GL_ENTRY_POINT(glDeleteProgram)
+GL_ENTRY_POINT(glDeleteShader)
+GL_ENTRY_POINT(glDetachShader)
+GL_ENTRY_POINT(glDisableVertexAttribArray)
+GL_ENTRY_POINT(glEnableVertexAttribArray)
+GL_ENTRY_POINT(glGetActiveAttrib)
+GL_ENTRY_POINT(glGetActiveUniform)
+GL_ENTRY_POINT(glGetAttachedShaders)
+GL_ENTRY_POINT(glGetAttribLocation)
+GL_ENTRY_POINT(glGetProgramiv)
+GL_ENTRY_POINT(glGetProgramInfoLog)
+GL_ENTRY_POINT(glGetShaderiv)
+GL_ENTRY_POINT(glGetShaderInfoLog)
+GL_ENTRY_POINT(glGetShaderSource)
+GL_ENTRY_POINT(glGetUniformLocation)
+GL_ENTRY_POINT(glGetUniformfv)
+GL_ENTRY_POINT(glGetUniformiv)
+GL_ENTRY_POINT(glGetVertexAttribdv)
+GL_ENTRY_POINT(glGetVertexAttribfv)
+GL_ENTRY_POINT(glGetVertexAttribiv)
+GL_ENTRY_POINT(glGetVertexAttribPointerv)
+GL_ENTRY_POINT(glIsProgram)
+GL_ENTRY_POINT(glIsShader)
+GL_ENTRY_POINT(glLinkProgram)
+GL_ENTRY_POINT(glShaderSource)
+GL_ENTRY_POINT(glUseProgram)
+GL_ENTRY_POINT(glUniform1f)
+GL_ENTRY_POINT(glUniform2f)
+GL_ENTRY_POINT(glUniform3f)
+GL_ENTRY_POINT(glUniform4f)
+GL_ENTRY_POINT(glUniform1i)
+GL_ENTRY_POINT(glUniform2i)
+GL_ENTRY_POINT(glUniform3i)
+GL_ENTRY_POINT(glUniform4i)
+GL_ENTRY_POINT(glUniform1fv)
+GL_ENTRY_POINT(glUniform2fv)
+GL_ENTRY_POINT(glUniform3fv)
+GL_ENTRY_POINT(glUniform4fv)
+GL_ENTRY_POINT(glUniform1iv)
+GL_ENTRY_POINT(glUniform2iv)
+GL_ENTRY_POINT(glUniform3iv)
+GL_ENTRY_POINT(glUniform4iv)
+GL_ENTRY_POINT(glUniformMatrix2fv)
+GL_ENTRY_POINT(glUniformMatrix3fv)
+GL_ENTRY_POINT(glUniformMatrix4fv)
+GL_ENTRY_POINT(glValidateProgram)
+GL_ENTRY_POINT(glVertexAttrib1d)
+GL_ENTRY_POINT(glVertexAttrib1dv)
+GL_ENTRY_POINT(glVertexAttrib1f)
+GL_ENTRY_POINT(glVertexAttrib1fv)
+GL_ENTRY_POINT(glVertexAttrib1s)
+GL_ENTRY_POINT(glVertexAttrib1sv)
+GL_ENTRY_POINT(glVertexAttrib2d)
+GL_ENTRY_POINT(glVertexAttrib2dv)
+GL_ENTRY_POINT(glVertexAttrib2f)
+GL_ENTRY_POINT(glVertexAttrib2fv)
+GL_ENTRY_POINT(glVertexAttrib2s)
+GL_ENTRY_POINT(glVertexAttrib2sv)
+GL_ENTRY_POINT(glVertexAttrib3d)
+GL_ENTRY_POINT(glVertexAttrib3dv)
+GL_ENTRY_POINT(glVertexAttrib3f)
+GL_ENTRY_POINT(glVertexAttrib3fv)
+GL_ENTRY_POINT(glVertexAttrib3s)
+GL_ENTRY_POINT(glVertexAttrib3sv)
+GL_ENTRY_POINT(glVertexAttrib4Nbv)
+GL_ENTRY_POINT(glVertexAttrib4Niv)
+GL_ENTRY_POINT(glVertexAttrib4Nsv)
+GL_ENTRY_POINT(glVertexAttrib4Nub)
+GL_ENTRY_POINT(glVertexAttrib4Nubv)
+GL_ENTRY_POINT(glVertexAttrib4Nuiv)
+GL_ENTRY_POINT(glVertexAttrib4Nusv)
+GL_ENTRY_POINT(glVertexAttrib4bv)
+GL_ENTRY_POINT(glVertexAttrib4d)
+GL_ENTRY_POINT(glVertexAttrib4dv)
+GL_ENTRY_POINT(glVertexAttrib4f)
+GL_ENTRY_POINT(glVertexAttrib4fv)
+GL_ENTRY_POINT(glVertexAttrib4iv)
+GL_ENTRY_POINT(glVertexAttrib4s)
+GL_ENTRY_POINT(glVertexAttrib4sv)
+GL_ENTRY_POINT(glVertexAttrib4ubv)
+GL_ENTRY_POINT(glVertexAttrib4uiv)
+GL_ENTRY_POINT(glVertexAttrib4usv)
+GL_ENTRY_POINT(glVertexAttribPointer)
+GL_ENTRY_POINT(glUniformMatrix2x3fv)
+GL_ENTRY_POINT(glUniformMatrix3x2fv)
+GL_ENTRY_POINT(glUniformMatrix2x4fv)
+GL_ENTRY_POINT(glUniformMatrix4x2fv)
+GL_ENTRY_POINT(glUniformMatrix3x4fv)
+GL_ENTRY_POINT(glUniformMatrix4x3fv)
+GL_ENTRY_POINT(glColorMaski)
+GL_ENTRY_POINT(glGetBooleani_v)
+GL_ENTRY_POINT(glGetIntegeri_v)
+GL_ENTRY_POINT(glEnablei)
+GL_ENTRY_POINT(glDisablei)
+GL_ENTRY_POINT(glIsEnabledi)
+GL_ENTRY_POINT(glBeginTransformFeedback)
+GL_ENTRY_POINT(glEndTransformFeedback)
+GL_ENTRY_POINT(glBindBufferRange)
+GL_ENTRY_POINT(glBindBufferBase)
+GL_ENTRY_POINT(glTransformFeedbackVaryings)
+GL_ENTRY_POINT(glGetTransformFeedbackVarying)
+GL_ENTRY_POINT(glClampColor)
+GL_ENTRY_POINT(glBeginConditionalRender)
+GL_ENTRY_POINT(glEndConditionalRender)
+GL_ENTRY_POINT(glVertexAttribIPointer)
+GL_ENTRY_POINT(glGetVertexAttribIiv)
+GL_ENTRY_POINT(glGetVertexAttribIuiv)
+GL_ENTRY_POINT(glVertexAttribI1i)
+GL_ENTRY_POINT(glVertexAttribI2i)
+GL_ENTRY_POINT(glVertexAttribI3i)
+GL_ENTRY_POINT(glVertexAttribI4i)
+GL_ENTRY_POINT(glVertexAttribI1ui)
+GL_ENTRY_POINT(glVertexAttribI2ui)
+GL_ENTRY_POINT(glVertexAttribI3ui)
+GL_ENTRY_POINT(glVertexAttribI4ui)
+GL_ENTRY_POINT(glVertexAttribI1iv)
+GL_ENTRY_POINT(glVertexAttribI2iv)
+GL_ENTRY_POINT(glVertexAttribI3iv)
+GL_ENTRY_POINT(glVertexAttribI4iv)
+GL_ENTRY_POINT(glVertexAttribI1uiv)
+GL_ENTRY_POINT(glVertexAttribI2uiv)
+GL_ENTRY_POINT(glVertexAttribI3uiv)
+GL_ENTRY_POINT(glVertexAttribI4uiv)
+GL_ENTRY_POINT(glVertexAttribI4bv)
+GL_ENTRY_POINT(glVertexAttribI4sv)
+GL_ENTRY_POINT(glVertexAttribI4ubv)
+GL_ENTRY_POINT(glVertexAttribI4usv)
+GL_ENTRY_POINT(glGetUniformuiv)
+GL_ENTRY_POINT(glBindFragDataLocation)
+GL_ENTRY_POINT(glGetFragDataLocation)
+GL_ENTRY_POINT(glUniform1ui)
+GL_ENTRY_POINT(glUniform2ui)
+GL_ENTRY_POINT(glUniform3ui)
+GL_ENTRY_POINT(glUniform4ui)
+GL_ENTRY_POINT(glUniform1uiv)
+GL_ENTRY_POINT(glUniform2uiv)
+GL_ENTRY_POINT(glUniform3uiv)
+GL_ENTRY_POINT(glUniform4uiv)
+GL_ENTRY_POINT(glTexParameterIiv)
+GL_ENTRY_POINT(glTexParameterIuiv)
+GL_ENTRY_POINT(glGetTexParameterIiv)
+GL_ENTRY_POINT(glGetTexParameterIuiv)
+GL_ENTRY_POINT(glClearBufferiv)
+GL_ENTRY_POINT(glClearBufferuiv)
+GL_ENTRY_POINT(glClearBufferfv)
+GL_ENTRY_POINT(glClearBufferfi)
+GL_ENTRY_POINT(glGetStringi)
+GL_ENTRY_POINT(glIsRenderbuffer)
+GL_ENTRY_POINT(glBindRenderbuffer)
+GL_ENTRY_POINT(glDeleteRenderbuffers)
+GL_ENTRY_POINT(glGenRenderbuffers)
+GL_ENTRY_POINT(glRenderbufferStorage)
+GL_ENTRY_POINT(glGetRenderbufferParameteriv)
+GL_ENTRY_POINT(glIsFramebuffer)
+GL_ENTRY_POINT(glBindFramebuffer)
+GL_ENTRY_POINT(glDeleteFramebuffers)
+GL_ENTRY_POINT(glGenFramebuffers)
+GL_ENTRY_POINT(glCheckFramebufferStatus)
+GL_ENTRY_POINT(glFramebufferTexture1D)
+GL_ENTRY_POINT(glFramebufferTexture2D)
+GL_ENTRY_POINT(glFramebufferTexture3D)
+GL_ENTRY_POINT(glFramebufferRenderbuffer)
+GL_ENTRY_POINT(glGetFramebufferAttachmentParameteriv)
+GL_ENTRY_POINT(glGenerateMipmap)
+GL_ENTRY_POINT(glBlitFramebuffer)
+GL_ENTRY_POINT(glRenderbufferStorageMultisample)
+GL_ENTRY_POINT(glFramebufferTextureLayer)
+GL_ENTRY_POINT(glMapBufferRange)
+GL_ENTRY_POINT(glFlushMappedBufferRange)
+GL_ENTRY_POINT(glBindVertexArray)
+GL_ENTRY_POINT(glDeleteVertexArrays)
+GL_ENTRY_POINT(glGenVertexArrays)
+GL_ENTRY_POINT(glIsVertexArray)
+GL_ENTRY_POINT(glDrawArraysInstanced)
+GL_ENTRY_POINT(glDrawElementsInstanced)
+GL_ENTRY_POINT(glTexBuffer)
+GL_ENTRY_POINT(glPrimitiveRestartIndex)
+GL_ENTRY_POINT(glCopyBufferSubData)
+GL_ENTRY_POINT(glGetUniformIndices)
+GL_ENTRY_POINT(glGetActiveUniformsiv)
+GL_ENTRY_POINT(glGetActiveUniformName)
+GL_ENTRY_POINT(glGetUniformBlockIndex)
+GL_ENTRY_POINT(glGetActiveUniformBlockiv)
+GL_ENTRY_POINT(glGetActiveUniformBlockName)
+GL_ENTRY_POINT(glUniformBlockBinding)
+GL_ENTRY_POINT(glDrawElementsBaseVertex)
+GL_ENTRY_POINT(glDrawRangeElementsBaseVertex)
+GL_ENTRY_POINT(glDrawElementsInstancedBaseVertex)
+GL_ENTRY_POINT(glMultiDrawElementsBaseVertex)
+GL_ENTRY_POINT(glProvokingVertex)
+GL_ENTRY_POINT(glFenceSync)
+GL_ENTRY_POINT(glIsSync)
+GL_ENTRY_POINT(glDeleteSync)
+GL_ENTRY_POINT(glClientWaitSync)
+GL_ENTRY_POINT(glWaitSync)
+GL_ENTRY_POINT(glGetInteger64v)
+GL_ENTRY_POINT(glGetSynciv)
+GL_ENTRY_POINT(glGetInteger64i_v)
+GL_ENTRY_POINT(glGetBufferParameteri64v)
+GL_ENTRY_POINT(glFramebufferTexture)
+GL_ENTRY_POINT(glTexImage2DMultisample)
+GL_ENTRY_POINT(glTexImage3DMultisample)
+GL_ENTRY_POINT(glGetMultisamplefv)
+GL_ENTRY_POINT(glSampleMaski)
+GL_ENTRY_POINT(glBindFragDataLocationIndexed)
+GL_ENTRY_POINT(glGetFragDataIndex)
+GL_ENTRY_POINT(glGenSamplers)
+GL_ENTRY_POINT(glDeleteSamplers)
+GL_ENTRY_POINT(glIsSampler)
+GL_ENTRY_POINT(glBindSampler)
+GL_ENTRY_POINT(glSamplerParameteri)
+GL_ENTRY_POINT(glSamplerParameteriv)
+GL_ENTRY_POINT(glSamplerParameterf)
+GL_ENTRY_POINT(glSamplerParameterfv)
+GL_ENTRY_POINT(glSamplerParameterIiv)
+GL_ENTRY_POINT(glSamplerParameterIuiv)
+GL_ENTRY_POINT(glGetSamplerParameteriv)
+GL_ENTRY_POINT(glGetSamplerParameterIiv)
+GL_ENTRY_POINT(glGetSamplerParameterfv)
+GL_ENTRY_POINT(glGetSamplerParameterIuiv)
+GL_ENTRY_POINT(glQueryCounter)
+GL_ENTRY_POINT(glGetQueryObjecti64v)
+GL_ENTRY_POINT(glGetQueryObjectui64v)
+GL_ENTRY_POINT(glVertexAttribDivisor)
+GL_ENTRY_POINT(glVertexAttribP1ui)
+GL_ENTRY_POINT(glVertexAttribP1uiv)
+GL_ENTRY_POINT(glVertexAttribP2ui)
+GL_ENTRY_POINT(glVertexAttribP2uiv)
+GL_ENTRY_POINT(glVertexAttribP3ui)
+GL_ENTRY_POINT(glVertexAttribP3uiv)
+GL_ENTRY_POINT(glVertexAttribP4ui)
+GL_ENTRY_POINT(glVertexAttribP4uiv)
+GL_ENTRY_POINT(glVertexP2ui)
+GL_ENTRY_POINT(glVertexP2uiv)
+GL_ENTRY_POINT(glVertexP3ui)
+GL_ENTRY_POINT(glVertexP3uiv)
+GL_ENTRY_POINT(glVertexP4ui)
+GL_ENTRY_POINT(glVertexP4uiv)
+GL_ENTRY_POINT(glTexCoordP1ui)
+GL_ENTRY_POINT(glTexCoordP1uiv)
+GL_ENTRY_POINT(glTexCoordP2ui)
+GL_ENTRY_POINT(glTexCoordP2uiv)
+GL_ENTRY_POINT(glTexCoordP3ui)
+GL_ENTRY_POINT(glTexCoordP3uiv)
+GL_ENTRY_POINT(glTexCoordP4ui)
+GL_ENTRY_POINT(glTexCoordP4uiv)
+GL_ENTRY_POINT(glMultiTexCoordP1ui)
+GL_ENTRY_POINT(glMultiTexCoordP1uiv)
+GL_ENTRY_POINT(glMultiTexCoordP2ui)
+GL_ENTRY_POINT(glMultiTexCoordP2uiv)
+GL_ENTRY_POINT(glMultiTexCoordP3ui)
+GL_ENTRY_POINT(glMultiTexCoordP3uiv)
+GL_ENTRY_POINT(glMultiTexCoordP4ui)
+GL_ENTRY_POINT(glMultiTexCoordP4uiv)
+GL_ENTRY_POINT(glNormalP3ui)
+GL_ENTRY_POINT(glNormalP3uiv)
+GL_ENTRY_POINT(glColorP3ui)
+GL_ENTRY_POINT(glColorP3uiv)
+GL_ENTRY_POINT(glColorP4ui)
+GL_ENTRY_POINT(glColorP4uiv)
+GL_ENTRY_POINT(glSecondaryColorP3ui)
+GL_ENTRY_POINT(glSecondaryColorP3uiv)
+GL_ENTRY_POINT(glMinSampleShading)
+GL_ENTRY_POINT(glBlendEquationi)
+GL_ENTRY_POINT(glBlendEquationSeparatei)
+GL_ENTRY_POINT(glBlendFunci)
+GL_ENTRY_POINT(glBlendFuncSeparatei)
+GL_ENTRY_POINT(glDrawArraysIndirect)
+GL_ENTRY_POINT(glDrawElementsIndirect)
+GL_ENTRY_POINT(glUniform1d)
+GL_ENTRY_POINT(glUniform2d)
+GL_ENTRY_POINT(glUniform3d)
+GL_ENTRY_POINT(glUniform4d)
+GL_ENTRY_POINT(glUniform1dv)
+GL_ENTRY_POINT(glUniform2dv)
+GL_ENTRY_POINT(glUniform3dv)
+GL_ENTRY_POINT(glUniform4dv)
+GL_ENTRY_POINT(glUniformMatrix2dv)
+GL_ENTRY_POINT(glUniformMatrix3dv)
+GL_ENTRY_POINT(glUniformMatrix4dv)
+GL_ENTRY_POINT(glUniformMatrix2x3dv)
+GL_ENTRY_POINT(glUniformMatrix2x4dv)
+GL_ENTRY_POINT(glUniformMatrix3x2dv)
+GL_ENTRY_POINT(glUniformMatrix3x4dv)
+GL_ENTRY_POINT(glUniformMatrix4x2dv)
+GL_ENTRY_POINT(glUniformMatrix4x3dv)
+GL_ENTRY_POINT(glGetUniformdv)
+GL_ENTRY_POINT(glGetSubroutineUniformLocation)
+GL_ENTRY_POINT(glGetSubroutineIndex)
+GL_ENTRY_POINT(glGetActiveSubroutineUniformiv)
+GL_ENTRY_POINT(glGetActiveSubroutineUniformName)
+GL_ENTRY_POINT(glGetActiveSubroutineName)
+GL_ENTRY_POINT(glUniformSubroutinesuiv)
+GL_ENTRY_POINT(glGetUniformSubroutineuiv)
+GL_ENTRY_POINT(glGetProgramStageiv)
+GL_ENTRY_POINT(glPatchParameteri)
+GL_ENTRY_POINT(glPatchParameterfv)
+GL_ENTRY_POINT(glBindTransformFeedback)
+GL_ENTRY_POINT(glDeleteTransformFeedbacks)
+GL_ENTRY_POINT(glGenTransformFeedbacks)
+GL_ENTRY_POINT(glIsTransformFeedback)
+GL_ENTRY_POINT(glPauseTransformFeedback)
+GL_ENTRY_POINT(glResumeTransformFeedback)
+GL_ENTRY_POINT(glDrawTransformFeedback)
+GL_ENTRY_POINT(glDrawTransformFeedbackStream)
+GL_ENTRY_POINT(glBeginQueryIndexed)
+GL_ENTRY_POINT(glEndQueryIndexed)
+GL_ENTRY_POINT(glGetQueryIndexediv)
@@ -0,0 +1,310 @@
+#include <glad/glad.h>
+#include <glhooks.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Entry points counted apart for the frame stats: the ones that draw, and the
+// ones that bind an object (the state changes)
+#define GL_DRAW_ENTRY_POINTS(X)                                                \
+  X(glDrawArrays)                                                              \
+  X(glDrawElements)                                                            \
+  X(glDrawRangeElements)                                                       \
+  X(glMultiDrawArrays)                                                         \
+  X(glMultiDrawElements)                                                       \
+  X(glDrawArraysInstanced)                                                     \
+  X(glDrawElementsInstanced)                                                   \
+  X(glDrawElementsBaseVertex)                                                  \
+  X(glDrawRangeElementsBaseVertex)                                             \
+  X(glDrawElementsInstancedBaseVertex)                                         \
+  X(glMultiDrawElementsBaseVertex)                                             \
+  X(glDrawArraysIndirect)                                                      \
+  X(glDrawElementsIndirect)                                                    \
+  X(glDrawTransformFeedback)                                                   \
+  X(glDrawTransformFeedbackStream)
+#define GL_BIND_ENTRY_POINTS(X)                                                \
+  X(glUseProgram)                                                              \
+  X(glBindVertexArray)                                                         \
+  X(glActiveTexture)                                                           \
+  X(glBindTexture)                                                             \
+  X(glBindSampler)                                                             \
+  X(glBindBuffer)                                                              \
+  X(glBindBufferBase)                                                          \
+  X(glBindBufferRange)                                                         \
+  X(glBindFramebuffer)
+
+// True if `Slot` is the glad function pointer `slot`
+template <auto *Slot> constexpr bool is_slot(const void *slot) {
+  return static_cast<const void *>(Slot) == slot;
+}
+
+#define GL_IS_SLOT(name) || is_slot<Slot>(&glad_##name)
+template <auto *Slot> constexpr bool is_draw_call() {
+  return false GL_DRAW_ENTRY_POINTS(GL_IS_SLOT);
+}
+template <auto *Slot> constexpr bool is_state_change() {
+  return false GL_BIND_ENTRY_POINTS(GL_IS_SLOT);
+}
+#undef GL_IS_SLOT
+
+struct EntryPoint {
+  const char *name;
+  unsigned long long frame_calls = 0;
+  unsigned long long frame_redundant = 0;
+  unsigned long long total_calls = 0;
+  unsigned long long total_redundant = 0;
+  unsigned long long errors = 0;
+};
+
+static std::vector<EntryPoint> entries;
+static unsigned long long frames = 0;
+static unsigned long long last_frame_calls = 0;
+static unsigned long long last_frame_redundant = 0;
+static int frame_draw_calls = 0;
+static int frame_state_changes = 0;
+static int last_frame_draw_calls = 0;
+static int last_frame_state_changes = 0;
+
+static bool check_errors = false;
+// glGetError of the driver, called after each hook while checking errors
+static PFNGLGETERRORPROC get_error = nullptr;
+
+// Value last bound to each binding point, unknown if missing. The key is the
+// kind of binding, its target and index (texture unit or indexed binding)
+enum BindingKind {
+  PROGRAM,
+  VERTEX_ARRAY,
+  ACTIVE_TEXTURE,
+  TEXTURE,
+  SAMPLER,
+  BUFFER,
+  BUFFER_RANGE,
+  FRAMEBUFFER
+};
+using BindingKey = std::tuple<BindingKind, GLenum, GLuint>;
+using BindingValue = std::tuple<GLuint, GLintptr, GLsizeiptr>;
+static std::map<BindingKey, BindingValue> bindings;
+static GLenum active_texture = GL_TEXTURE0;
+
+// Binds the value, returning true if it was already bound
+static bool rebind(BindingKind kind, GLenum target, GLuint index,
+                   GLuint name, GLintptr offset = 0, GLsizeiptr size = 0) {
+  const BindingValue value = {name, offset, size};
+  const auto [binding, inserted] =
+      bindings.try_emplace({kind, target, index}, value);
+  if (inserted) {
+    return false;
+  }
+  if (binding->second == value) {
+    return true;
+  }
+  binding->second = value;
+  return false;
+}
+
+// Updates the bindings changed by the call of the entry point `Slot`, and
+// returns true if the call didn't change anything
+template <auto *Slot, typename... Args>
+static bool track_bindings(Args... args) {
+  [[maybe_unused]] const std::tuple<Args...> arg(args...);
+
+  if constexpr (is_slot<Slot>(&glad_glUseProgram)) {
+    return rebind(PROGRAM, 0, 0, std::get<0>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindVertexArray)) {
+    // The element array buffer is part of the vertex array state
+    const bool redundant = rebind(VERTEX_ARRAY, 0, 0, std::get<0>(arg));
+    if (!redundant) {
+      bindings.erase({BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0});
+    }
+    return redundant;
+  } else if constexpr (is_slot<Slot>(&glad_glActiveTexture)) {
+    active_texture = std::get<0>(arg);
+    return rebind(ACTIVE_TEXTURE, 0, 0, std::get<0>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindTexture)) {
+    return rebind(TEXTURE, std::get<0>(arg), active_texture, std::get<1>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindSampler)) {
+    return rebind(SAMPLER, 0, std::get<0>(arg), std::get<1>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindBuffer)) {
+    return rebind(BUFFER, std::get<0>(arg), 0, std::get<1>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindBufferBase)) {
+    // Also binds the generic binding point of the target
+    rebind(BUFFER, std::get<0>(arg), 0, std::get<2>(arg));
+    return rebind(BUFFER_RANGE, std::get<0>(arg), std::get<1>(arg),
+                  std::get<2>(arg), 0, -1);
+  } else if constexpr (is_slot<Slot>(&glad_glBindBufferRange)) {
+    rebind(BUFFER, std::get<0>(arg), 0, std::get<2>(arg));
+    return rebind(BUFFER_RANGE, std::get<0>(arg), std::get<1>(arg),
+                  std::get<2>(arg), std::get<3>(arg), std::get<4>(arg));
+  } else if constexpr (is_slot<Slot>(&glad_glBindFramebuffer)) {
+    if (std::get<0>(arg) != GL_FRAMEBUFFER) {
+      return rebind(FRAMEBUFFER, std::get<0>(arg), 0, std::get<1>(arg));
+    }
+    const GLuint framebuffer = std::get<1>(arg);
+    const bool draw = rebind(FRAMEBUFFER, GL_DRAW_FRAMEBUFFER, 0, framebuffer);
+    const bool read = rebind(FRAMEBUFFER, GL_READ_FRAMEBUFFER, 0, framebuffer);
+    return draw && read;
+  } else if constexpr (is_slot<Slot>(&glad_glDeleteVertexArrays) ||
+                       is_slot<Slot>(&glad_glDeleteTextures) ||
+                       is_slot<Slot>(&glad_glDeleteSamplers) ||
+                       is_slot<Slot>(&glad_glDeleteBuffers) ||
+                       is_slot<Slot>(&glad_glDeleteFramebuffers)) {
+    // Deleting a bound object unbinds it, so forget what is bound
+    bindings.clear();
+    return false;
+  } else {
+    return false;
+  }
+}
+
+static void count_call(size_t entry, bool redundant) {
+  EntryPoint &entry_point = entries[entry];
+  entry_point.frame_calls++;
+  if (redundant) {
+    entry_point.frame_redundant++;
+  }
+}
+
+static void check_error(size_t entry) {
+  const GLenum error = get_error();
+  if (error == GL_NO_ERROR) {
+    return;
+  }
+  EntryPoint &entry_point = entries[entry];
+  if (entry_point.errors == 0) {
+    std::cout << "GL error 0x" << std::hex << error << std::dec << " after "
+              << entry_point.name << std::endl;
+  }
+  entry_point.errors++;
+}
+
+static size_t add_entry(const char *name) {
+  entries.push_back({name});
+  return entries.size() - 1;
+}
+
+// Replaces the glad function pointer `*Slot` with `call`, which forwards to
+// the driver function
+template <auto *Slot, typename Function = std::remove_pointer_t<decltype(Slot)>>
+struct Hook;
+
+template <auto *Slot, typename Result, typename... Args>
+struct Hook<Slot, Result(APIENTRYP)(Args...)> {
+  static inline Result(APIENTRYP original)(Args...) = nullptr;
+  static inline size_t entry = 0;
+  static inline bool registered = false;
+
+  static Result APIENTRY call(Args... args) {
+    if constexpr (is_draw_call<Slot>()) {
+      frame_draw_calls++;
+    } else if constexpr (is_state_change<Slot>()) {
+      frame_state_changes++;
+    }
+    count_call(entry, track_bindings<Slot>(args...));
+    constexpr bool checked = !is_slot<Slot>(&glad_glGetError);
+    if constexpr (std::is_void_v<Result>) {
+      original(args...);
+      if (checked && check_errors) {
+        check_error(entry);
+      }
+    } else {
+      const Result result = original(args...);
+      if (checked && check_errors) {
+        check_error(entry);
+      }
+      return result;
+    }
+  }
+
+  static void install(const char *name) {
+    // Skip the functions that the driver doesn't provide
+    if (*Slot == nullptr || *Slot == &call) {
+      return;
+    }
+    if (!registered) {
+      entry = add_entry(name);
+      registered = true;
+    }
+    original = *Slot;
+    *Slot = &call;
+  }
+};
+
+void gl_hooks_install() {
+  get_error = glad_glGetError;
+  bindings.clear();
+  active_texture = GL_TEXTURE0;
+#define GL_ENTRY_POINT(name) Hook<&glad_##name>::install(#name);
+#include "glentrypoints.inl"
+#undef GL_ENTRY_POINT
+}
+
+void gl_hooks_check_errors(bool enabled) { check_errors = enabled; }
+
+void gl_hooks_frame_mark() {
+  last_frame_draw_calls = frame_draw_calls;
+  last_frame_state_changes = frame_state_changes;
+  frame_draw_calls = 0;
+  frame_state_changes = 0;
+  last_frame_calls = 0;
+  last_frame_redundant = 0;
+  for (EntryPoint &entry_point : entries) {
+    last_frame_calls += entry_point.frame_calls;
+    last_frame_redundant += entry_point.frame_redundant;
+    entry_point.total_calls += entry_point.frame_calls;
+    entry_point.total_redundant += entry_point.frame_redundant;
+    entry_point.frame_calls = 0;
+    entry_point.frame_redundant = 0;
+  }
+  frames++;
+}
+
+unsigned long long gl_hooks_frame_calls() { return last_frame_calls; }
+
+unsigned long long gl_hooks_frame_redundant() { return last_frame_redundant; }
+
+int gl_hooks_frame_draw_calls() { return last_frame_draw_calls; }
+
+int gl_hooks_frame_state_changes() { return last_frame_state_changes; }
+
+void gl_hooks_print_summary() {
+  if (frames == 0) {
+    return;
+  }
+  std::vector<const EntryPoint *> called;
+  unsigned long long calls = 0, redundant = 0;
+  for (const EntryPoint &entry_point : entries) {
+    if (entry_point.total_calls > 0) {
+      called.push_back(&entry_point);
+      calls += entry_point.total_calls;
+      redundant += entry_point.total_redundant;
+    }
+  }
+  std::sort(called.begin(), called.end(), [](const auto *a, const auto *b) {
+    return a->total_calls > b->total_calls;
+  });
+
+  const double per_frame = 1.0 / frames;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "GL calls per frame over " << frames << " frames: "
+            << calls * per_frame << " (" << redundant * per_frame
+            << " redundant)" << std::endl;
+  for (const EntryPoint *entry_point : called) {
+    std::cout << "  " << entry_point->name << ": "
+              << entry_point->total_calls * per_frame;
+    if (entry_point->total_redundant > 0) {
+      std::cout << " (" << entry_point->total_redundant * per_frame
+                << " redundant)";
+    }
+    if (entry_point->errors > 0) {
+      std::cout << " [" << entry_point->errors << " errors]";
+    }
+    std::cout << std::endl;
+  }
+  std::cout << std::defaultfloat;
+}
@@ -1,8 +1,47 @@
+#include <algorithm>
 #include <fstream>
+#include <glhooks.hpp>
 #include <glutils.hpp>
 #include <iostream>
 #include <sstream>
 #include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+// Loader used to initialize glad, kept to resolve extension functions
+static GLADloadproc gl_loader = nullptr;
+
+bool load_gl(GLADloadproc loader) {
+  gl_loader = loader;
+  if (!gladLoadGLLoader(loader)) {
+    return false;
+  }
+  // Instrument the loaded functions (only in builds with GLUTILS_GL_HOOKS)
+  gl_hooks_install();
+  return true;
+}
+
+bool has_gl_extension(const std::string &name) {
+  GLint num_extensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+  for (GLint i = 0; i < num_extensions; i++) {
+    const char *extension =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (name == extension) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool has_gl_version(int major, int minor) {
+  return GLVersion.major > major ||
+         (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+void *get_gl_proc(const char *name) {
+  return gl_loader ? gl_loader(name) : nullptr;
+}
 
 GLuint make_module(const std::string &filepath, const GLuint module_type) {
   std::ifstream file;
@@ -67,6 +106,89 @@ GLuint make_shader(const std::string &vertex_filepath,
   return shader;
 }
 
+void bind_uniform_block(GLuint program, const char *name, GLuint binding) {
+  const GLuint index = glGetUniformBlockIndex(program, name);
+  if (index == GL_INVALID_INDEX) {
+    std::cout << "Uniform block " << name << " not found" << std::endl;
+    return;
+  }
+  glUniformBlockBinding(program, index, binding);
+}
+
+std::vector<unsigned char> read_pixels_rgb(int width, int height) {
+  const size_t row_size = width * 3;
+  std::vector<unsigned char> pixels(row_size * height);
+  // Rows are tightly packed, without padding to 4 bytes
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+  // OpenGL returns the bottom row first
+  for (int row = 0; row < height / 2; row++) {
+    std::swap_ranges(pixels.begin() + row * row_size,
+                     pixels.begin() + (row + 1) * row_size,
+                     pixels.begin() + (height - 1 - row) * row_size);
+  }
+  return pixels;
+}
+
+bool write_ppm(const std::string &filepath, int width, int height,
+               const unsigned char *pixels) {
+  std::ofstream file(filepath, std::ios::binary);
+  if (!file) {
+    std::cout << "Could not open " << filepath << " for writing" << std::endl;
+    return false;
+  }
+  file << "P6\n" << width << " " << height << "\n255\n";
+  file.write(reinterpret_cast<const char *>(pixels), width * height * 3);
+  return file.good();
+}
+
+void write_json_string(std::ostream &out, const std::string &text) {
+  out << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      // Control characters are only allowed as escapes
+      const char *digits = "0123456789abcdef";
+      out << "\\u00" << digits[c >> 4] << digits[c & 0xf];
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+GLuint texture_setup(const std::string &filepath) {
+  // Generate the OpenGL texture object
+  GLuint texture;
+  glGenTextures(1, &texture);
+  // Bind the texture to the texture unit 0
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  // Set the texture wrapping/filtering options
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Load the texture data from file
+  int width, height, nrChannels;
+  unsigned char *data =
+      stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
+  if (data) {
+    // Generate the 2D texture by setting the data and format
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, data);
+    // Generate all the Mipmap levels up to 1-pixel-size
+    glGenerateMipmap(GL_TEXTURE_2D);
+  } else {
+    std::cout << "Error during texture data loading" << std::endl;
+  }
+  // Now we can free the source texture data
+  stbi_image_free(data);
+  return texture;
+}
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   glViewport(0, 0, width, height);
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include <gputimer.hpp>
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+GpuTimer::GpuTimer(unsigned frames_in_flight)
+    : frames(std::max(frames_in_flight, 2u)) {
+  if (profiler_enabled()) {
+    track = profiler_track("GPU");
+    // Align both clocks once. They may drift apart slowly in long runs
+    GLint64 gpu_time;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+    clock_offset = static_cast<long long>(profiler_now()) - gpu_time;
+  }
+}
+
+GpuTimer::~GpuTimer() {
+  glDeleteQueries(all_queries.size(), all_queries.data());
+}
+
+GLuint GpuTimer::new_query() {
+  if (free_queries.empty()) {
+    GLuint query;
+    glGenQueries(1, &query);
+    all_queries.push_back(query);
+    return query;
+  }
+  const GLuint query = free_queries.back();
+  free_queries.pop_back();
+  return query;
+}
+
+bool GpuTimer::results_available(const Frame &frame) {
+  if (frame.passes.empty()) {
+    return true;
+  }
+  // The queries finish in order, so the last one tells for the whole frame
+  GLint available = 0;
+  glGetQueryObjectiv(frame.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+  return available;
+}
+
+void GpuTimer::collect(Frame &frame) {
+  latest.clear();
+  GLuint64 frame_begin = 0, frame_end = 0;
+  for (size_t i = 0; i < frame.passes.size(); i++) {
+    const Pass &pass = frame.passes[i];
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(pass.begin_query, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(pass.end_query, GL_QUERY_RESULT, &end);
+    frame_begin = i == 0 ? begin : std::min(frame_begin, begin);
+    frame_end = std::max(frame_end, end);
+
+    const double milliseconds = (end - begin) / 1e6;
+    latest.push_back({pass.name, milliseconds});
+    PassStats &pass_stats = stats[pass.name];
+    pass_stats.total += milliseconds;
+    pass_stats.worst = std::max(pass_stats.worst, milliseconds);
+    pass_stats.count++;
+    if (track) {
+      profiler_record(track, pass.name, begin + clock_offset,
+                      end + clock_offset);
+    }
+
+    free_queries.push_back(pass.begin_query);
+    free_queries.push_back(pass.end_query);
+  }
+  latest_frame_time = (frame_end - frame_begin) / 1e6;
+  frame_stats.total += latest_frame_time;
+  frame_stats.worst = std::max(frame_stats.worst, latest_frame_time);
+  frame_stats.count++;
+  measured++;
+  if (frame_callback) {
+    frame_callback(frame.index, latest_frame_time);
+  }
+  frame.passes.clear();
+  frame.pending = false;
+}
+
+void GpuTimer::begin_frame() {
+  // Read the frames that the GPU finished, oldest first
+  for (unsigned i = 1; i <= frames.size(); i++) {
+    Frame &frame = frames[(current + i) % frames.size()];
+    if (!frame.pending) {
+      continue;
+    }
+    if (!results_available(frame)) {
+      break;
+    }
+    collect(frame);
+  }
+
+  current = (current + 1) % frames.size();
+  // Only measure the frame if its slot is free, instead of waiting
+  recording = !frames[current].pending;
+  if (recording) {
+    frames[current].index = frames_begun;
+  } else {
+    skipped++;
+  }
+  frames_begun++;
+  open_passes.clear();
+}
+
+void GpuTimer::finish() {
+  for (unsigned i = 1; i <= frames.size(); i++) {
+    Frame &frame = frames[(current + i) % frames.size()];
+    if (frame.pending) {
+      collect(frame);
+    }
+  }
+}
+
+void GpuTimer::end_frame() {
+  // Close the passes left open
+  while (!open_passes.empty()) {
+    end_pass();
+  }
+  if (recording) {
+    frames[current].pending = true;
+  }
+  recording = false;
+}
+
+void GpuTimer::begin_pass(const char *name) {
+  if (!recording) {
+    return;
+  }
+  Frame &frame = frames[current];
+  const GLuint query = new_query();
+  glQueryCounter(query, GL_TIMESTAMP);
+  frame.passes.push_back({name, query, 0});
+  frame.last_query = query;
+  open_passes.push_back(frame.passes.size() - 1);
+}
+
+void GpuTimer::end_pass() {
+  if (!recording || open_passes.empty()) {
+    return;
+  }
+  Frame &frame = frames[current];
+  Pass &pass = frame.passes[open_passes.back()];
+  open_passes.pop_back();
+  pass.end_query = new_query();
+  glQueryCounter(pass.end_query, GL_TIMESTAMP);
+  frame.last_query = pass.end_query;
+}
+
+void GpuTimer::print_summary() const {
+  if (frame_stats.count == 0) {
+    return;
+  }
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "GPU time of " << measured << " frames (" << skipped
+            << " skipped), avg / max ms" << std::endl;
+  std::cout << "  Frame: " << frame_stats.total / frame_stats.count << " / "
+            << frame_stats.worst << std::endl;
+  for (const auto &[name, pass_stats] : stats) {
+    std::cout << "  " << name << ": " << pass_stats.total / pass_stats.count
+              << " / " << pass_stats.worst << std::endl;
+  }
+  std::cout << std::defaultfloat;
+}
@@ -0,0 +1,134 @@
+#include <housemesh.hpp>
+
+#include <glm/glm.hpp>
+
+// Vertices of the roof
+// Format: postion(x, y, z), color(r, g, b), texCoord(x, y)
+constexpr float ROOF_VERTICES[40] = {
+    -0.5f, 0.0f, 0.5f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f, // Left-front, Red
+    0.5f,  0.0f, 0.5f,  0.0f, 1.0f, 0.0f, 1.0f, 0.0f, // Right-front, Green
+    0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f, 0.5f, 1.0f, // Top-center, Blue
+    -0.5f, 0.0f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, // Left-back, Red
+    0.5f,  0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, // Right-back, Green
+};
+// Order to draw the unique vertices to form the roof pyramid
+constexpr GLuint ROOF_INDICES[ROOF_NUM_INDICES] = {
+    0, 2, 1, // Front
+    1, 2, 4, // Right
+    4, 2, 3, // Back
+    3, 2, 0  // Left
+};
+
+// Rectangle walls unique vertices data
+// Format: postion(x, y, z), color(r, g, b), texCoord(x, y)
+constexpr float WALLS_VERTICES[64] = {
+    0.5f,  0.0f,  0.5f,  0.0f, 1.0f, 0.0f, 1.0f, 1.0f, // Top-right-front
+    0.5f,  -0.5f, 0.5f,  0.0f, 1.0f, 1.0f, 1.0f, 0.0f, // Bottom-right-front
+    -0.5f, -0.5f, 0.5f,  1.0f, 0.0f, 1.0f, 0.0f, 0.0f, // Bottom-left-front
+    -0.5f, 0.0f,  0.5f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, // Top-left-front
+    0.5f,  0.0f,  -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, // Top-right-back
+    0.5f,  -0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, // Bottom-right-back
+    -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, // Bottom-left-back
+    -0.5f, 0.0f,  -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f  // Top-left-back
+};
+// Order to draw the unique vertices to form the walls cube
+constexpr GLuint WALLS_INDICES[WALLS_NUM_INDICES] = {
+    0, 1, 3, // Top-front triangle
+    1, 2, 3, // Bottom-front triangle
+    4, 5, 7, // Top-back triangle
+    5, 6, 7, // Bottom-back triangle
+    0, 4, 1, // Top-right triangle
+    1, 4, 5, // Bottom-right triangle
+    3, 2, 7, // Top-left triangle
+    2, 6, 7  // Bottom-left triangle
+};
+
+// Floats of each vertex in the vertices data
+const int VERTEX_FLOATS = 8;
+
+// Creates the index buffer of a part in the bound vertex array
+template <size_t N> static void set_up_indices(const GLuint (&indices)[N]) {
+  // Prepare the Element Buffer Object for `index drawing`
+  GLuint EBO;
+  glGenBuffers(1, &EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  // Push the vertex indexes into the buffer
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+               GL_STATIC_DRAW);
+}
+
+template <size_t N> static void set_up_vertices(const float (&vertices)[N]) {
+  // Prepare the buffer to send the vertex data
+  GLuint VBO;
+  glGenBuffers(1, &VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  // Push the vertex data into the buffer
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  // Prepare the vertex position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float),
+                        (void *)0);
+  glEnableVertexAttribArray(0);
+  // Prepare the vertex color attribute
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float),
+                        (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  // Prepare the texture coordinates attribute
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float),
+                        (void *)(6 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+}
+
+template <size_t N> static void set_up_positions(const float (&vertices)[N]) {
+  // Keep only the position of each vertex, tightly packed
+  constexpr size_t NUM_VERTICES = N / VERTEX_FLOATS;
+  float positions[3 * NUM_VERTICES];
+  for (size_t i = 0; i < NUM_VERTICES; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      positions[3 * i + j] = vertices[VERTEX_FLOATS * i + j];
+    }
+  }
+  GLuint VBO;
+  glGenBuffers(1, &VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+}
+
+void set_up_roof() {
+  set_up_indices(ROOF_INDICES);
+  set_up_vertices(ROOF_VERTICES);
+}
+
+void set_up_walls() {
+  set_up_indices(WALLS_INDICES);
+  set_up_vertices(WALLS_VERTICES);
+}
+
+void set_up_roof_positions() {
+  set_up_indices(ROOF_INDICES);
+  set_up_positions(ROOF_VERTICES);
+}
+
+void set_up_walls_positions() {
+  set_up_indices(WALLS_INDICES);
+  set_up_positions(WALLS_VERTICES);
+}
+
+void point_instances(GLuint instance_VBO, GLintptr offset) {
+  // Each instance reads its model matrix as 4 column vectors (locations 3-6)
+  glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+  for (int col = 0; col < 4; col++) {
+    glVertexAttribPointer(3 + col, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void *)(offset + col * sizeof(glm::vec4)));
+  }
+}
+
+void set_up_instances(GLuint instance_VBO) {
+  point_instances(instance_VBO, 0);
+  for (int col = 0; col < 4; col++) {
+    glEnableVertexAttribArray(3 + col);
+    // Advance the attribute once per instance instead of once per vertex
+    glVertexAttribDivisor(3 + col, 1);
+  }
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <jobsystem.hpp>
+#include <profiler.hpp>
+
+// Identifies the worker running in the current thread, if any
+thread_local const JobSystem *current_system = nullptr;
+thread_local unsigned current_worker = 0;
+
+// Minimum number of elements processed by each `parallel_for` job, to keep
+// the scheduling overhead small compared to the work done
+const size_t MIN_CHUNK_SIZE = 64;
+// Number of chunks per thread created by default, so that threads finishing
+// early can steal the remaining work
+const size_t CHUNKS_PER_THREAD = 4;
+
+JobSystem::JobSystem(unsigned num_workers) {
+  if (num_workers == 0) {
+    const unsigned hw_threads = std::thread::hardware_concurrency();
+    num_workers = hw_threads > 1 ? hw_threads - 1 : 1;
+  }
+  // The queues must exist before any worker starts looking for jobs
+  for (unsigned i = 0; i <= num_workers; i++) {
+    queues.push_back(std::make_unique<WorkerQueue>());
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    workers.emplace_back(&JobSystem::worker_loop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake_up.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void JobSystem::submit(Job job, JobCounter *counter) {
+  if (counter) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  push({std::move(job), counter});
+}
+
+void JobSystem::submit_after(JobCounter &dependency, Job job,
+                             JobCounter *counter) {
+  // Count the job from now on, so waiting on `counter` also waits for it
+  if (counter) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(dependency.mutex);
+    if (!dependency.done()) {
+      dependency.continuations.emplace_back(std::move(job), counter);
+      return;
+    }
+  }
+  push({std::move(job), counter});
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  const unsigned queue = local_queue();
+  while (!counter.done()) {
+    QueuedJob queued;
+    if (pop_or_steal(queue, queued)) {
+      execute(queued);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // Synchronize with the thread that finished the last job, which could
+  // still be releasing the counter lock
+  std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallel_for(size_t count, size_t chunk_size,
+                             std::function<void(size_t, size_t)> fn,
+                             JobCounter &counter, JobCounter *dependency) {
+  if (chunk_size == 0) {
+    chunk_size = default_chunk_size(count);
+  }
+  // Share the function between the chunks instead of copying it in each job
+  auto shared_fn =
+      std::make_shared<std::function<void(size_t, size_t)>>(std::move(fn));
+  for (size_t begin = 0; begin < count; begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, count);
+    Job job = [shared_fn, begin, end]() { (*shared_fn)(begin, end); };
+    if (dependency) {
+      submit_after(*dependency, std::move(job), &counter);
+    } else {
+      submit(std::move(job), &counter);
+    }
+  }
+}
+
+void JobSystem::parallel_for(size_t count, size_t chunk_size,
+                             std::function<void(size_t, size_t)> fn) {
+  JobCounter counter;
+  parallel_for(count, chunk_size, std::move(fn), counter);
+  wait(counter);
+}
+
+size_t JobSystem::default_chunk_size(size_t count) const {
+  const size_t num_chunks = num_threads() * CHUNKS_PER_THREAD;
+  return std::max(MIN_CHUNK_SIZE, (count + num_chunks - 1) / num_chunks);
+}
+
+void JobSystem::worker_loop(unsigned index) {
+  current_system = this;
+  current_worker = index;
+  profiler_thread_name("Worker " + std::to_string(index));
+  while (true) {
+    QueuedJob queued;
+    if (pop_or_steal(index, queued)) {
+      execute(queued);
+      continue;
+    }
+    // Sleep until new jobs are pushed or the system is destroyed
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake_up.wait(lock, [this]() { return stopping || queued_jobs > 0; });
+    if (stopping && queued_jobs == 0) {
+      return;
+    }
+  }
+}
+
+unsigned JobSystem::local_queue() const {
+  return current_system == this ? current_worker : workers.size();
+}
+
+void JobSystem::push(QueuedJob queued) {
+  WorkerQueue &queue = *queues[local_queue()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(queued));
+  }
+  queued_jobs.fetch_add(1, std::memory_order_release);
+  // Taking the lock ensures a worker can't miss the notification between
+  // checking `queued_jobs` and going to sleep
+  { std::lock_guard<std::mutex> lock(sleep_mutex); }
+  wake_up.notify_one();
+}
+
+bool JobSystem::pop_or_steal(unsigned first_queue, QueuedJob &out) {
+  const size_t num_queues = queues.size();
+  for (size_t i = 0; i < num_queues; i++) {
+    WorkerQueue &queue = *queues[(first_queue + i) % num_queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      // Own queue: take the most recent job, its data is likely still cached
+      out = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    } else {
+      // Steal the oldest job, which usually represents the biggest work left
+      out = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::execute(QueuedJob &queued) {
+  queued.job();
+  finish(queued.counter);
+}
+
+void JobSystem::finish(JobCounter *counter) {
+  if (!counter) {
+    return;
+  }
+  // The counter is only modified under its lock, so once `wait` acquires it
+  // after seeing zero no thread can touch the counter anymore
+  std::vector<std::pair<Job, JobCounter *>> ready;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // Last job of the group: release the jobs that depend on it
+      ready.swap(counter->continuations);
+    }
+  }
+  for (auto &[job, job_counter] : ready) {
+    push({std::move(job), job_counter});
+  }
+}
@@ -0,0 +1,278 @@
+#include <frustum.hpp>
+#include <lightclusters.hpp>
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Rounds up to the width of the SIMD tests
+static size_t padded_size(size_t count) { return (count + 3) / 4 * 4; }
+
+// Calls `fn(i)` for the lights `i` in [0, count) whose sphere is not fully
+// outside one of the planes, with the lights given as separate padded arrays
+template <typename Function>
+static void for_each_inside(const float *x, const float *y, const float *z,
+                            const float *radius, size_t count,
+                            const glm::vec4 (&planes)[6], Function fn) {
+#if defined(__SSE2__)
+  __m128 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+  for (int p = 0; p < 6; p++) {
+    plane_a[p] = _mm_set1_ps(planes[p].x);
+    plane_b[p] = _mm_set1_ps(planes[p].y);
+    plane_c[p] = _mm_set1_ps(planes[p].z);
+    plane_d[p] = _mm_set1_ps(planes[p].w);
+  }
+  for (size_t i = 0; i < count; i += 4) {
+    const __m128 lx = _mm_loadu_ps(x + i);
+    const __m128 ly = _mm_loadu_ps(y + i);
+    const __m128 lz = _mm_loadu_ps(z + i);
+    const __m128 minus_r =
+        _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      const __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(plane_a[p], lx), _mm_mul_ps(plane_b[p], ly)),
+          _mm_add_ps(_mm_mul_ps(plane_c[p], lz), plane_d[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, minus_r));
+    }
+    unsigned mask = _mm_movemask_ps(inside);
+    while (mask != 0) {
+      fn(i + std::countr_zero(mask));
+      mask &= mask - 1;
+    }
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    bool inside = true;
+    for (const glm::vec4 &plane : planes) {
+      inside &= plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w >=
+                -radius[i];
+    }
+    if (inside) {
+      fn(i);
+    }
+  }
+#endif
+}
+
+LightClusters::LightClusters()
+    : tiles(NUM_CLUSTER_TILES), ranges(NUM_CLUSTERS) {
+  create_buffer(lights_buffer, lights_texture, GL_RGBA32F);
+  create_buffer(ranges_buffer, ranges_texture, GL_RG32UI);
+  create_buffer(indices_buffer, indices_texture, GL_R32UI);
+}
+
+LightClusters::~LightClusters() {
+  const GLuint textures[] = {lights_texture, ranges_texture, indices_texture};
+  const GLuint buffers[] = {lights_buffer, ranges_buffer, indices_buffer};
+  glDeleteTextures(3, textures);
+  glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::create_buffer(GLuint &buffer, GLuint &texture,
+                                  GLenum format) {
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  // A texel of storage, so the texture is complete before the first build
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_BUFFER, texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::set_projection(const glm::mat4 &projection) {
+  if (projection == projection_key) {
+    return;
+  }
+  projection_key = projection;
+
+  // Planes of the perspective projection, from its depth terms
+  near_depth = projection[3][2] / (projection[2][2] - 1.0f);
+  far_depth = projection[3][2] / (projection[2][2] + 1.0f);
+  const float log_range = std::log(far_depth / near_depth);
+  depth_scale = CLUSTER_SLICES / log_range;
+  depth_bias = CLUSTER_SLICES * std::log(near_depth) / log_range;
+
+  // The sub-frustum of a tile is the frustum of the projection followed by
+  // a scale and offset that maps the tile to the whole clip space
+  for (unsigned tile_y = 0; tile_y < CLUSTER_TILES_Y; tile_y++) {
+    for (unsigned tile_x = 0; tile_x < CLUSTER_TILES_X; tile_x++) {
+      glm::mat4 tile_transform(1.0f);
+      tile_transform[0][0] = CLUSTER_TILES_X;
+      tile_transform[1][1] = CLUSTER_TILES_Y;
+      tile_transform[3][0] = CLUSTER_TILES_X - 1.0f - 2.0f * tile_x;
+      tile_transform[3][1] = CLUSTER_TILES_Y - 1.0f - 2.0f * tile_y;
+      const Frustum frustum(tile_transform * projection);
+      Tile &tile = tiles[tile_y * CLUSTER_TILES_X + tile_x];
+      for (int p = 0; p < 6; p++) {
+        tile.planes[p] = frustum.planes[p];
+        tile.planes[p].z = -tile.planes[p].z;
+      }
+    }
+  }
+}
+
+unsigned LightClusters::depth_slice(float depth) const {
+  const float slice = std::floor(std::log(depth) * depth_scale - depth_bias);
+  return std::clamp(slice, 0.0f, CLUSTER_SLICES - 1.0f);
+}
+
+void LightClusters::build(JobSystem &jobs,
+                          const std::vector<PointLight> &lights,
+                          const glm::mat4 &view) {
+  PROFILE_ZONE("Light clusters");
+  if (depth_scale == 0.0f) {
+    return;
+  }
+
+  // Move the lights to view space. The padding lights have a negative
+  // infinite radius, so no plane keeps them
+  const size_t count = lights.size();
+  const size_t padded = padded_size(count);
+  light_x.assign(padded, 0.0f);
+  light_y.assign(padded, 0.0f);
+  light_depth.assign(padded, 0.0f);
+  light_radius.assign(padded, -std::numeric_limits<float>::infinity());
+  light_texels.resize(std::max<size_t>(count, 1) * 2);
+  jobs.parallel_for(count, 0, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const glm::vec3 position =
+          glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+      light_x[i] = position.x;
+      light_y[i] = position.y;
+      light_depth[i] = -position.z;
+      light_radius[i] = lights[i].radius;
+      light_texels[2 * i] = glm::vec4(position, lights[i].radius);
+      light_texels[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+    }
+  });
+
+  // Each tile writes the lists of its clusters on its own
+  jobs.parallel_for(NUM_CLUSTER_TILES, 1, [this](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      cull_tile(tile);
+    }
+  });
+
+  // Place the lists of the tiles one after another, and make the offsets of
+  // their clusters global
+  uint32_t offset = 0;
+  for (Tile &tile : tiles) {
+    tile.offset = offset;
+    offset += tile.indices.size();
+    total_tile_lights += tile.lights.size();
+  }
+  indices.resize(offset);
+  jobs.parallel_for(NUM_CLUSTER_TILES, 1, [this](size_t begin, size_t end) {
+    for (size_t index = begin; index < end; index++) {
+      const Tile &tile = tiles[index];
+      std::copy(tile.indices.begin(), tile.indices.end(),
+                indices.begin() + tile.offset);
+      for (unsigned slice = 0; slice < CLUSTER_SLICES; slice++) {
+        ranges[slice * NUM_CLUSTER_TILES + index].x += tile.offset;
+      }
+    }
+  });
+  upload();
+  builds++;
+}
+
+void LightClusters::cull_tile(unsigned index) {
+  Tile &tile = tiles[index];
+  tile.lights.clear();
+  tile.light_slices.clear();
+  tile.indices.clear();
+  for_each_inside(light_x.data(), light_y.data(), light_depth.data(),
+                  light_radius.data(), light_x.size(), tile.planes,
+                  [&](size_t i) { tile.lights.push_back(i); });
+
+  // Count the lights of each slice, from the depth range of their spheres
+  uint32_t counts[CLUSTER_SLICES] = {};
+  for (uint32_t light : tile.lights) {
+    const float depth = light_depth[light], radius = light_radius[light];
+    const unsigned first = depth_slice(std::max(depth - radius, near_depth));
+    const unsigned last = depth_slice(std::min(depth + radius, far_depth));
+    tile.light_slices.emplace_back(first, last);
+    for (unsigned slice = first; slice <= last; slice++) {
+      counts[slice]++;
+    }
+  }
+  // Then fill the lists, with offsets local to the tile until the upload
+  uint32_t cursors[CLUSTER_SLICES];
+  uint32_t offset = 0;
+  for (unsigned slice = 0; slice < CLUSTER_SLICES; slice++) {
+    ranges[slice * NUM_CLUSTER_TILES + index] =
+        glm::uvec2(offset, counts[slice]);
+    cursors[slice] = offset;
+    offset += counts[slice];
+  }
+  tile.indices.resize(offset);
+  for (size_t i = 0; i < tile.lights.size(); i++) {
+    const auto [first, last] = tile.light_slices[i];
+    for (unsigned slice = first; slice <= last; slice++) {
+      tile.indices[cursors[slice]++] = tile.lights[i];
+    }
+  }
+}
+
+void LightClusters::upload() {
+  unsigned max_lights = 0;
+  for (const glm::uvec2 &range : ranges) {
+    max_lights = std::max(max_lights, range.y);
+    total_lit_clusters += range.y > 0;
+  }
+  last_max = max_lights;
+  total_indices += indices.size();
+
+  // Orphan the buffers, so the driver hands new storage instead of waiting
+  // for the draws of the previous frame
+  glBindBuffer(GL_TEXTURE_BUFFER, lights_buffer);
+  glBufferData(GL_TEXTURE_BUFFER, light_texels.size() * sizeof(glm::vec4),
+               light_texels.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, ranges_buffer);
+  glBufferData(GL_TEXTURE_BUFFER, ranges.size() * sizeof(glm::uvec2),
+               ranges.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, indices_buffer);
+  glBufferData(GL_TEXTURE_BUFFER,
+               std::max<size_t>(indices.size(), 1) * sizeof(uint32_t),
+               indices.empty() ? nullptr : indices.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind(GLuint first_unit) const {
+  const GLuint textures[] = {lights_texture, ranges_texture, indices_texture};
+  for (GLuint i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + first_unit + i);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::print_summary() const {
+  if (builds == 0) {
+    return;
+  }
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Light clusters: "
+            << static_cast<double>(total_tile_lights) / builds /
+                   NUM_CLUSTER_TILES
+            << " lights per screen tile, "
+            << static_cast<double>(total_indices) / builds
+            << " light indices per frame, "
+            << (total_lit_clusters > 0 ? static_cast<double>(total_indices) /
+                                             total_lit_clusters
+                                       : 0.0)
+            << " lights per lit cluster (max " << last_max
+            << " in the last frame)" << std::endl;
+  std::cout << std::defaultfloat;
+}
@@ -0,0 +1,621 @@
+#include <lightmapbaker.hpp>
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <glm/gtc/constants.hpp>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+// Triangles that share a vertex belong to the same chart if their normals
+// are closer than this
+const float CHART_NORMAL_COS = 0.999f;
+// Fraction of the lightmap that the charts are expected to fill, to choose
+// the first texel density tried
+const float PACKING_FILL = 0.8f;
+// Texel density kept by each packing retry
+const float PACKING_SHRINK = 0.95f;
+// Most triangles of a BVH leaf
+const uint32_t BVH_LEAF_TRIANGLES = 4;
+// Distance that the rays start off the surface, against self intersections
+const float RAY_OFFSET = 1e-3f;
+// Smallest magnitude of the direction components in the slab tests, so the
+// axis-aligned rays don't divide zero by zero
+const float RAY_MIN_COMPONENT = 1e-9f;
+
+// Header of a KTX 1 file, all fields in native endianness
+struct KtxHeader {
+  uint8_t identifier[12];
+  uint32_t endianness;
+  uint32_t gl_type;
+  uint32_t gl_type_size;
+  uint32_t gl_format;
+  uint32_t gl_internal_format;
+  uint32_t gl_base_internal_format;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t array_elements;
+  uint32_t faces;
+  uint32_t mip_levels;
+  uint32_t key_value_bytes;
+};
+const uint8_t KTX_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31,
+                                    0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+// Converts to a half float, rounding to nearest. Values too small for a
+// normal half are flushed to zero, and too big ones are clamped
+static uint16_t to_half(float value) {
+  const uint32_t sign = (std::bit_cast<uint32_t>(value) >> 16) & 0x8000;
+  const float magnitude = std::min(std::abs(value), 65504.0f);
+  // Also catches NaN
+  if (!(magnitude >= 6.103515625e-05f)) {
+    return sign;
+  }
+  // Move the exponent from the float bias (127) to the half one (15)
+  const uint32_t bits = std::bit_cast<uint32_t>(magnitude) - (112u << 23);
+  return sign | ((bits + 0x1000) >> 13);
+}
+
+// Hashes the integer into well distributed bits (a PCG output permutation)
+static uint32_t hash(uint32_t value) {
+  const uint32_t state = value * 747796405u + 2891336453u;
+  const uint32_t word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+  return (word >> 22) ^ word;
+}
+
+// Point `i` of a Hammersley set of `count` points in [0, 1)^2
+static glm::vec2 hammersley(uint32_t i, uint32_t count) {
+  uint32_t bits = i;
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+  bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+  bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+  bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+  return glm::vec2((i + 0.5f) / count, bits * 2.3283064365386963e-10f);
+}
+
+LightmapBaker::LightmapBaker(const LightmapSettings &settings)
+    : settings(settings) {}
+
+bool LightmapBaker::unwrap(const std::vector<glm::vec3> &positions,
+                           const std::vector<uint32_t> &indices) {
+  PROFILE_ZONE("Lightmap unwrap");
+  build_charts(positions, indices);
+
+  // Start from the density that fills the expected fraction of the lightmap
+  // and lower it until all the charts fit
+  float area = 0.0f;
+  float max_extent = 0.0f;
+  for (const Chart &chart : charts) {
+    const glm::vec2 size = chart.uv_max - chart.uv_min;
+    area += size.x * size.y;
+    max_extent = std::max({max_extent, size.x, size.y});
+  }
+  density = area > 0.0f
+                ? settings.resolution * std::sqrt(PACKING_FILL / area)
+                : 1.0f;
+  unwrapped = LightmapMesh();
+  triangles.clear();
+  nodes.clear();
+  while (!pack(density)) {
+    // Once every chart is a single texel, a lower density doesn't make them
+    // any smaller
+    if (density * max_extent <= 1.0f) {
+      std::cout << "The " << charts.size()
+                << " lightmap charts don't fit in " << settings.resolution
+                << "x" << settings.resolution << " texels" << std::endl;
+      charts.clear();
+      used_texels = 0;
+      return false;
+    }
+    density *= PACKING_SHRINK;
+  }
+
+  // Give each chart its own vertices, with the coordinates of the lightmap
+  std::vector<int64_t> chart_vertex(positions.size(), -1);
+  for (const Chart &chart : charts) {
+    for (uint32_t triangle : chart.triangles) {
+      for (int corner = 0; corner < 3; corner++) {
+        const uint32_t vertex = indices[3 * triangle + corner];
+        if (chart_vertex[vertex] < 0) {
+          chart_vertex[vertex] = unwrapped.vertex_map.size();
+          const glm::vec2 uv(glm::dot(positions[vertex], chart.tangent),
+                             glm::dot(positions[vertex], chart.bitangent));
+          const glm::vec2 texel =
+              glm::vec2(chart.rect_x + settings.padding,
+                        chart.rect_y + settings.padding) +
+              (uv - chart.uv_min) * density;
+          unwrapped.vertex_map.push_back(vertex);
+          unwrapped.coords.push_back(texel / float(settings.resolution));
+        }
+        unwrapped.indices.push_back(chart_vertex[vertex]);
+      }
+    }
+    // Forget the vertices, so the next charts split them
+    for (uint32_t triangle : chart.triangles) {
+      for (int corner = 0; corner < 3; corner++) {
+        chart_vertex[indices[3 * triangle + corner]] = -1;
+      }
+    }
+  }
+
+  // The same triangles occlude the light
+  for (const Chart &chart : charts) {
+    for (uint32_t triangle : chart.triangles) {
+      const glm::vec3 &a = positions[indices[3 * triangle]];
+      const glm::vec3 &b = positions[indices[3 * triangle + 1]];
+      const glm::vec3 &c = positions[indices[3 * triangle + 2]];
+      triangles.push_back({a, b - a, c - a});
+    }
+  }
+  if (!triangles.empty()) {
+    build_bvh(0, triangles.size());
+  }
+  return true;
+}
+
+void LightmapBaker::build_charts(const std::vector<glm::vec3> &positions,
+                                 const std::vector<uint32_t> &indices) {
+  charts.clear();
+  const size_t num_triangles = indices.size() / 3;
+  std::vector<glm::vec3> normals(num_triangles);
+  // Triangles of each vertex
+  std::vector<std::vector<uint32_t>> vertex_triangles(positions.size());
+  for (size_t t = 0; t < num_triangles; t++) {
+    const glm::vec3 &a = positions[indices[3 * t]];
+    const glm::vec3 &b = positions[indices[3 * t + 1]];
+    const glm::vec3 &c = positions[indices[3 * t + 2]];
+    const glm::vec3 normal = glm::cross(b - a, c - a);
+    // Degenerate triangles are not lit nor drawn
+    if (glm::dot(normal, normal) == 0.0f) {
+      continue;
+    }
+    normals[t] = glm::normalize(normal);
+    for (int corner = 0; corner < 3; corner++) {
+      vertex_triangles[indices[3 * t + corner]].push_back(t);
+    }
+  }
+
+  // Grow the charts from the first triangle not taken, through the shared
+  // vertices
+  std::vector<bool> taken(num_triangles, false);
+  for (size_t seed = 0; seed < num_triangles; seed++) {
+    if (taken[seed] || normals[seed] == glm::vec3(0.0f)) {
+      continue;
+    }
+    Chart chart;
+    chart.normal = normals[seed];
+    taken[seed] = true;
+    chart.triangles.push_back(seed);
+    for (size_t next = 0; next < chart.triangles.size(); next++) {
+      const uint32_t triangle = chart.triangles[next];
+      for (int corner = 0; corner < 3; corner++) {
+        const uint32_t vertex = indices[3 * triangle + corner];
+        for (uint32_t other : vertex_triangles[vertex]) {
+          if (!taken[other] &&
+              glm::dot(normals[other], chart.normal) > CHART_NORMAL_COS) {
+            taken[other] = true;
+            chart.triangles.push_back(other);
+          }
+        }
+      }
+    }
+
+    // Project the chart on its plane
+    const glm::vec3 &normal = chart.normal;
+    const glm::vec3 axis = std::abs(normal.y) < 0.999f
+                               ? glm::vec3(0.0f, 1.0f, 0.0f)
+                               : glm::vec3(1.0f, 0.0f, 0.0f);
+    chart.tangent = glm::normalize(glm::cross(axis, normal));
+    chart.bitangent = glm::cross(normal, chart.tangent);
+    chart.plane = glm::dot(normal, positions[indices[3 * seed]]);
+    chart.uv_min = glm::vec2(std::numeric_limits<float>::max());
+    chart.uv_max = glm::vec2(std::numeric_limits<float>::lowest());
+    for (uint32_t triangle : chart.triangles) {
+      for (int corner = 0; corner < 3; corner++) {
+        const glm::vec3 &position = positions[indices[3 * triangle + corner]];
+        const glm::vec2 uv(glm::dot(position, chart.tangent),
+                           glm::dot(position, chart.bitangent));
+        chart.uv_min = glm::min(chart.uv_min, uv);
+        chart.uv_max = glm::max(chart.uv_max, uv);
+      }
+    }
+    charts.push_back(std::move(chart));
+  }
+}
+
+bool LightmapBaker::pack(float density) {
+  const int padding = settings.padding;
+  for (Chart &chart : charts) {
+    const glm::vec2 size = (chart.uv_max - chart.uv_min) * density;
+    chart.rect_width = std::max(1, int(std::ceil(size.x))) + 2 * padding;
+    chart.rect_height = std::max(1, int(std::ceil(size.y))) + 2 * padding;
+  }
+  // Fill shelves from the bottom, tallest charts first
+  std::vector<Chart *> order;
+  for (Chart &chart : charts) {
+    order.push_back(&chart);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const Chart *a, const Chart *b) {
+                     return a->rect_height > b->rect_height;
+                   });
+  int x = 0, shelf_y = 0, shelf_height = 0;
+  used_texels = 0;
+  for (Chart *chart : order) {
+    if (x + chart->rect_width > settings.resolution) {
+      x = 0;
+      shelf_y += shelf_height;
+      shelf_height = 0;
+    }
+    if (chart->rect_width > settings.resolution ||
+        shelf_y + chart->rect_height > settings.resolution) {
+      return false;
+    }
+    chart->rect_x = x;
+    chart->rect_y = shelf_y;
+    x += chart->rect_width;
+    shelf_height = std::max(shelf_height, chart->rect_height);
+    used_texels += size_t(chart->rect_width) * chart->rect_height;
+  }
+  return true;
+}
+
+uint32_t LightmapBaker::build_bvh(uint32_t begin, uint32_t end) {
+  const uint32_t index = nodes.size();
+  nodes.emplace_back();
+  glm::vec3 bounds_min(std::numeric_limits<float>::max());
+  glm::vec3 bounds_max(std::numeric_limits<float>::lowest());
+  glm::vec3 centers_min = bounds_min, centers_max = bounds_max;
+  for (uint32_t i = begin; i < end; i++) {
+    const Triangle &triangle = triangles[i];
+    for (const glm::vec3 &vertex :
+         {triangle.vertex, triangle.vertex + triangle.edge1,
+          triangle.vertex + triangle.edge2}) {
+      bounds_min = glm::min(bounds_min, vertex);
+      bounds_max = glm::max(bounds_max, vertex);
+    }
+    const glm::vec3 center =
+        triangle.vertex + (triangle.edge1 + triangle.edge2) / 3.0f;
+    centers_min = glm::min(centers_min, center);
+    centers_max = glm::max(centers_max, center);
+  }
+  nodes[index].bounds_min = bounds_min;
+  nodes[index].bounds_max = bounds_max;
+  if (end - begin <= BVH_LEAF_TRIANGLES) {
+    nodes[index].offset = begin;
+    nodes[index].count = end - begin;
+    return index;
+  }
+
+  // Split at the median of the centers, along their longest extent
+  const glm::vec3 extent = centers_max - centers_min;
+  const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+  const uint32_t middle = (begin + end) / 2;
+  std::nth_element(triangles.begin() + begin, triangles.begin() + middle,
+                   triangles.begin() + end,
+                   [axis](const Triangle &a, const Triangle &b) {
+                     return 3.0f * a.vertex[axis] + a.edge1[axis] +
+                                a.edge2[axis] <
+                            3.0f * b.vertex[axis] + b.edge1[axis] +
+                                b.edge2[axis];
+                   });
+  build_bvh(begin, middle);
+  const uint32_t second = build_bvh(middle, end);
+  nodes[index].offset = second;
+  nodes[index].count = 0;
+  return index;
+}
+
+bool LightmapBaker::occluded(const glm::vec3 &origin,
+                             const glm::vec3 &direction,
+                             float max_distance) const {
+  if (nodes.empty()) {
+    return false;
+  }
+  glm::vec3 inverse;
+  for (int axis = 0; axis < 3; axis++) {
+    const float component = std::abs(direction[axis]) < RAY_MIN_COMPONENT
+                                ? std::copysign(RAY_MIN_COMPONENT,
+                                                direction[axis])
+                                : direction[axis];
+    inverse[axis] = 1.0f / component;
+  }
+  uint32_t stack[64];
+  unsigned size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const uint32_t index = stack[--size];
+    const BvhNode &node = nodes[index];
+    // Slab test of the bounds
+    const glm::vec3 t0 = (node.bounds_min - origin) * inverse;
+    const glm::vec3 t1 = (node.bounds_max - origin) * inverse;
+    const glm::vec3 near_t = glm::min(t0, t1), far_t = glm::max(t0, t1);
+    const float enter = std::max({near_t.x, near_t.y, near_t.z, 0.0f});
+    const float exit = std::min({far_t.x, far_t.y, far_t.z, max_distance});
+    if (enter > exit) {
+      continue;
+    }
+    if (node.count == 0) {
+      stack[size++] = node.offset;
+      stack[size++] = index + 1;
+      continue;
+    }
+    // Moller-Trumbore intersection with the triangles of the leaf
+    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+      const Triangle &triangle = triangles[i];
+      const glm::vec3 p = glm::cross(direction, triangle.edge2);
+      const float determinant = glm::dot(triangle.edge1, p);
+      if (std::abs(determinant) < 1e-12f) {
+        continue;
+      }
+      const float inverse_determinant = 1.0f / determinant;
+      const glm::vec3 s = origin - triangle.vertex;
+      const float u = glm::dot(s, p) * inverse_determinant;
+      if (u < 0.0f || u > 1.0f) {
+        continue;
+      }
+      const glm::vec3 q = glm::cross(s, triangle.edge1);
+      const float v = glm::dot(direction, q) * inverse_determinant;
+      if (v < 0.0f || u + v > 1.0f) {
+        continue;
+      }
+      const float t = glm::dot(triangle.edge2, q) * inverse_determinant;
+      if (t > 0.0f && t < max_distance) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+glm::vec3 LightmapBaker::bake_texel(const Chart &chart, int x, int y,
+                                    const std::vector<PointLight> &lights,
+                                    const SunLight &sun,
+                                    uint64_t &rays) const {
+  // Position of the center of the texel on the plane of the chart. The
+  // padding texels continue the plane past the edges of the triangles
+  const glm::vec2 uv =
+      chart.uv_min + (glm::vec2(x - chart.rect_x - settings.padding,
+                                y - chart.rect_y - settings.padding) +
+                      0.5f) /
+                         density;
+  const glm::vec3 &normal = chart.normal;
+  const glm::vec3 position = uv.x * chart.tangent + uv.y * chart.bitangent +
+                             chart.plane * normal;
+  const glm::vec3 origin = position + normal * RAY_OFFSET;
+
+  // Occlusion of the ambient light, from rays around the normal with a
+  // cosine distribution. Each texel rotates the same set of points
+  const uint32_t seed = hash(y * settings.resolution + x);
+  const glm::vec2 rotation(hash(seed) * 2.3283064365386963e-10f,
+                           hash(seed + 1) * 2.3283064365386963e-10f);
+  unsigned visible = 0;
+  for (unsigned i = 0; i < settings.occlusion_rays; i++) {
+    const glm::vec2 point =
+        glm::fract(hammersley(i, settings.occlusion_rays) + rotation);
+    const float radius = std::sqrt(point.x);
+    const float angle = 2.0f * glm::pi<float>() * point.y;
+    const glm::vec3 direction =
+        chart.tangent * (radius * std::cos(angle)) +
+        chart.bitangent * (radius * std::sin(angle)) +
+        normal * std::sqrt(std::max(1.0f - point.x, 0.0f));
+    visible += !occluded(origin, direction, settings.occlusion_distance);
+  }
+  rays += settings.occlusion_rays;
+  glm::vec3 light(settings.ambient);
+  if (settings.occlusion_rays > 0) {
+    light *= static_cast<float>(visible) / settings.occlusion_rays;
+  }
+
+  for (const PointLight &point : lights) {
+    const glm::vec3 to_light = point.position - position;
+    const float distance = std::max(glm::length(to_light), 1e-4f);
+    const float cosine = glm::dot(normal, to_light) / distance;
+    if (distance >= point.radius || cosine <= 0.0f) {
+      continue;
+    }
+    rays++;
+    if (occluded(origin, to_light / distance, distance - RAY_OFFSET)) {
+      continue;
+    }
+    // Inverse square falloff, windowed to reach zero at the radius
+    const float ratio = distance / point.radius;
+    const float window =
+        std::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+    const float attenuation = window * window / (distance * distance + 1.0f);
+    light += point.color * attenuation * cosine;
+  }
+
+  if (sun.color != glm::vec3(0.0f)) {
+    const glm::vec3 to_sun = -glm::normalize(sun.direction);
+    const float cosine = glm::dot(normal, to_sun);
+    if (cosine > 0.0f) {
+      rays++;
+      if (!occluded(origin, to_sun, std::numeric_limits<float>::max())) {
+        light += sun.color * cosine;
+      }
+    }
+  }
+  return light;
+}
+
+void LightmapBaker::bake(JobSystem &jobs,
+                         const std::vector<PointLight> &lights,
+                         const SunLight &sun) {
+  PROFILE_ZONE("Lightmap bake");
+  const auto start = std::chrono::steady_clock::now();
+  const int resolution = settings.resolution;
+  texels.assign(size_t(resolution) * resolution, glm::vec3(0.0f));
+
+  // One job per row of texels of a chart, as the charts vary a lot in size
+  std::vector<std::pair<uint32_t, int>> rows;
+  for (uint32_t c = 0; c < charts.size(); c++) {
+    for (int y = 0; y < charts[c].rect_height; y++) {
+      rows.emplace_back(c, charts[c].rect_y + y);
+    }
+  }
+  std::atomic<unsigned long long> rays = 0;
+  jobs.parallel_for(rows.size(), 0, [&](size_t begin, size_t end) {
+    uint64_t job_rays = 0;
+    for (size_t row = begin; row < end; row++) {
+      const Chart &chart = charts[rows[row].first];
+      const int y = rows[row].second;
+      for (int x = chart.rect_x; x < chart.rect_x + chart.rect_width; x++) {
+        texels[size_t(y) * resolution + x] =
+            bake_texel(chart, x, y, lights, sun, job_rays);
+      }
+    }
+    rays += job_rays;
+  });
+
+  num_rays = rays;
+  bake_threads = jobs.num_threads();
+  bake_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+}
+
+bool LightmapBaker::write(const std::string &path) const {
+  if (texels.empty()) {
+    std::cout << "The lightmap was not baked" << std::endl;
+    return false;
+  }
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    std::cout << "Could not open " << path << " to write the lightmap"
+              << std::endl;
+    return false;
+  }
+  const uint32_t levels =
+      std::bit_width(static_cast<uint32_t>(settings.resolution));
+  KtxHeader header = {};
+  std::copy(std::begin(KTX_IDENTIFIER), std::end(KTX_IDENTIFIER),
+            header.identifier);
+  header.endianness = KTX_ENDIANNESS;
+  header.gl_type = GL_HALF_FLOAT;
+  header.gl_type_size = 2;
+  header.gl_format = GL_RGBA;
+  header.gl_internal_format = GL_RGBA16F;
+  header.gl_base_internal_format = GL_RGBA;
+  header.pixel_width = settings.resolution;
+  header.pixel_height = settings.resolution;
+  header.faces = 1;
+  header.mip_levels = levels;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // Each level averages 2x2 texels of the previous one
+  std::vector<glm::vec3> level = texels;
+  int size = settings.resolution;
+  std::vector<uint16_t> halves;
+  for (uint32_t l = 0; l < levels; l++) {
+    halves.resize(size_t(size) * size * 4);
+    for (size_t i = 0; i < level.size(); i++) {
+      halves[4 * i] = to_half(level[i].x);
+      halves[4 * i + 1] = to_half(level[i].y);
+      halves[4 * i + 2] = to_half(level[i].z);
+      halves[4 * i + 3] = to_half(1.0f);
+    }
+    const uint32_t image_size = halves.size() * sizeof(uint16_t);
+    file.write(reinterpret_cast<const char *>(&image_size),
+               sizeof(image_size));
+    file.write(reinterpret_cast<const char *>(halves.data()), image_size);
+
+    const int next_size = std::max(size / 2, 1);
+    std::vector<glm::vec3> next(size_t(next_size) * next_size);
+    for (int y = 0; y < next_size; y++) {
+      for (int x = 0; x < next_size; x++) {
+        const int x0 = std::min(2 * x, size - 1);
+        const int x1 = std::min(2 * x + 1, size - 1);
+        const int y0 = std::min(2 * y, size - 1);
+        const int y1 = std::min(2 * y + 1, size - 1);
+        next[size_t(y) * next_size + x] =
+            (level[size_t(y0) * size + x0] + level[size_t(y0) * size + x1] +
+             level[size_t(y1) * size + x0] + level[size_t(y1) * size + x1]) *
+            0.25f;
+      }
+    }
+    level = std::move(next);
+    size = next_size;
+  }
+  if (!file) {
+    std::cout << "Could not write the lightmap to " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void LightmapBaker::print_summary() const {
+  const double area = double(settings.resolution) * settings.resolution;
+  const std::streamsize precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Lightmap: " << settings.resolution << "x"
+            << settings.resolution << ", " << charts.size()
+            << " charts covering " << 100.0 * used_texels / area
+            << "% of the texels, " << density << " texels per unit"
+            << std::endl;
+  if (bake_threads > 0) {
+    std::cout << "Lightmap bake: " << num_rays / 1e6 << "M rays in "
+              << bake_ms << " ms on " << bake_threads << " threads ("
+              << num_rays / 1e3 / std::max(bake_ms, 1e-3)
+              << "M rays/s)" << std::endl;
+  }
+  std::cout << std::defaultfloat << std::setprecision(precision);
+}
+
+GLuint load_lightmap(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  KtxHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      !std::equal(std::begin(KTX_IDENTIFIER), std::end(KTX_IDENTIFIER),
+                  header.identifier)) {
+    std::cout << "Could not read the lightmap " << path << std::endl;
+    return 0;
+  }
+  // Only the files written by the baker are supported
+  if (header.endianness != KTX_ENDIANNESS ||
+      header.gl_type != GL_HALF_FLOAT || header.gl_format != GL_RGBA ||
+      header.pixel_depth != 0 || header.faces != 1 ||
+      header.mip_levels == 0) {
+    std::cout << "Unsupported lightmap format in " << path << std::endl;
+    return 0;
+  }
+  file.ignore(header.key_value_bytes);
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  std::vector<char> data;
+  int width = header.pixel_width, height = header.pixel_height;
+  for (uint32_t level = 0; level < header.mip_levels; level++) {
+    uint32_t image_size = 0;
+    file.read(reinterpret_cast<char *>(&image_size), sizeof(image_size));
+    if (!file || image_size != size_t(width) * height * 8) {
+      std::cout << "Truncated lightmap " << path << std::endl;
+      glDeleteTextures(1, &texture);
+      return 0;
+    }
+    data.resize(image_size);
+    file.read(data.data(), image_size);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA16F, width, height, 0, GL_RGBA,
+                 GL_HALF_FLOAT, data.data());
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.mip_levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
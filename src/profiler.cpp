@@ -0,0 +1,239 @@
+#include <glutils.hpp>
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> profiler_active = false;
+
+struct ProfileEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Events are stored in chunks that are never moved, so the exporter can read
+// them while the owner thread keeps appending
+const size_t EVENTS_PER_CHUNK = 16384;
+const size_t MAX_CHUNKS = 256;
+
+// Events of a thread or another timeline (like the GPU). Only one thread
+// writes it
+struct ProfileTrack {
+  std::atomic<ProfileEvent *> chunks[MAX_CHUNKS] = {};
+  // Number of events published to the readers
+  std::atomic<size_t> count = 0;
+  std::string name;
+  unsigned id;
+  // Created with `profiler_track` instead of for a thread
+  bool standalone = false;
+
+  ~ProfileTrack() {
+    for (auto &chunk : chunks) {
+      delete[] chunk.load();
+    }
+  }
+};
+
+// The tracks outlive their threads, so the trace includes finished threads
+static std::mutex buffers_mutex;
+static std::vector<std::unique_ptr<ProfileTrack>> buffers;
+static std::vector<uint64_t> frame_marks;
+static uint64_t dropped_events = 0;
+static thread_local ProfileTrack *thread_buffer = nullptr;
+
+static ProfileTrack *add_track() {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  buffers.push_back(std::make_unique<ProfileTrack>());
+  buffers.back()->id = buffers.size();
+  return buffers.back().get();
+}
+
+static ProfileTrack &get_thread_buffer() {
+  if (!thread_buffer) {
+    thread_buffer = add_track();
+  }
+  return *thread_buffer;
+}
+
+void profiler_enable(bool enabled) { profiler_active = enabled; }
+
+void profiler_record(const char *name, uint64_t start, uint64_t end) {
+  profiler_record(&get_thread_buffer(), name, start, end);
+}
+
+ProfileTrack *profiler_track(const std::string &name) {
+  ProfileTrack *track = add_track();
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  track->name = name;
+  track->standalone = true;
+  return track;
+}
+
+void profiler_record(ProfileTrack *track, const char *name, uint64_t start,
+                     uint64_t end) {
+  ProfileTrack &buffer = *track;
+  const size_t index = buffer.count.load(std::memory_order_relaxed);
+  const size_t chunk_index = index / EVENTS_PER_CHUNK;
+  if (chunk_index == MAX_CHUNKS) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    dropped_events++;
+    return;
+  }
+  ProfileEvent *chunk =
+      buffer.chunks[chunk_index].load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new ProfileEvent[EVENTS_PER_CHUNK];
+    buffer.chunks[chunk_index].store(chunk, std::memory_order_release);
+  }
+  chunk[index % EVENTS_PER_CHUNK] = {name, start, end};
+  buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void profiler_thread_name(const std::string &name) {
+  ProfileTrack &buffer = get_thread_buffer();
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  buffer.name = name;
+}
+
+void profiler_frame_mark() {
+  if (!profiler_enabled()) {
+    return;
+  }
+  const uint64_t now = profiler_now();
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  frame_marks.push_back(now);
+}
+
+// Calls `fn` with each published event of the buffer
+template <typename Fn> static void for_each_event(ProfileTrack &buffer, Fn fn) {
+  const size_t count = buffer.count.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count; i++) {
+    const ProfileEvent *chunk =
+        buffer.chunks[i / EVENTS_PER_CHUNK].load(std::memory_order_acquire);
+    fn(chunk[i % EVENTS_PER_CHUNK]);
+  }
+}
+
+bool profiler_write_chrome_trace(const std::string &filepath) {
+  std::ofstream file(filepath);
+  if (!file) {
+    std::cout << "Could not open " << filepath << " for writing" << std::endl;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+
+  // Timestamps in microseconds relative to the first event
+  uint64_t origin = frame_marks.empty() ? UINT64_MAX : frame_marks.front();
+  for (auto &buffer : buffers) {
+    for_each_event(*buffer, [&](const ProfileEvent &event) {
+      origin = std::min(origin, event.start);
+    });
+  }
+  auto microseconds = [origin](uint64_t time) {
+    return (time - origin) / 1000.0;
+  };
+
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&]() {
+    file << (first ? "\n" : ",\n");
+    first = false;
+  };
+  for (auto &buffer : buffers) {
+    if (!buffer->name.empty()) {
+      separator();
+      file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << buffer->id << ",\"args\":{\"name\":";
+      write_json_string(file, buffer->name);
+      file << "}}";
+    }
+    for_each_event(*buffer, [&](const ProfileEvent &event) {
+      separator();
+      file << "{\"name\":";
+      write_json_string(file, event.name);
+      file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+           << ",\"ts\":" << microseconds(event.start)
+           << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+    });
+  }
+  for (uint64_t mark : frame_marks) {
+    separator();
+    file << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,"
+            "\"ts\":"
+         << microseconds(mark) << "}";
+  }
+  file << "\n]}\n";
+  return file.good();
+}
+
+void profiler_print_summary() {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  if (frame_marks.size() < 2) {
+    std::cout << "Not enough frames to summarize" << std::endl;
+    return;
+  }
+  // Complete frames between consecutive marks
+  const size_t num_frames = frame_marks.size() - 1;
+
+  struct ZoneStats {
+    // Total time of the zone in each frame (in all the threads)
+    std::vector<uint64_t> frame_time;
+    uint64_t calls = 0;
+  };
+  std::map<std::string, ZoneStats> zones;
+  for (auto &buffer : buffers) {
+    for_each_event(*buffer, [&](const ProfileEvent &event) {
+      // Frame in which the zone started
+      auto next_mark = std::upper_bound(frame_marks.begin(), frame_marks.end(),
+                                        event.start);
+      if (next_mark == frame_marks.begin() || next_mark == frame_marks.end()) {
+        return;
+      }
+      const size_t frame = next_mark - frame_marks.begin() - 1;
+      // The zones of all the threads are added, but not those of other tracks
+      ZoneStats &stats = zones[buffer->standalone
+                                   ? buffer->name + ": " + event.name
+                                   : std::string(event.name)];
+      if (stats.frame_time.empty()) {
+        stats.frame_time.resize(num_frames, 0);
+      }
+      stats.frame_time[frame] += event.end - event.start;
+      stats.calls++;
+    });
+  }
+
+  uint64_t total_frame_time = frame_marks.back() - frame_marks.front();
+  uint64_t max_frame_time = 0;
+  for (size_t i = 0; i < num_frames; i++) {
+    max_frame_time =
+        std::max(max_frame_time, frame_marks[i + 1] - frame_marks[i]);
+  }
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "Profile of " << num_frames << " frames (avg / max ms per "
+            << "frame, calls per frame)" << std::endl;
+  std::cout << "  Frame: " << total_frame_time / 1e6 / num_frames << " / "
+            << max_frame_time / 1e6 << std::endl;
+  for (const auto &[name, stats] : zones) {
+    uint64_t total = 0, worst = 0;
+    for (uint64_t time : stats.frame_time) {
+      total += time;
+      worst = std::max(worst, time);
+    }
+    std::cout << "  " << name << ": " << total / 1e6 / num_frames << " / "
+              << worst / 1e6 << ", "
+              << static_cast<double>(stats.calls) / num_frames << std::endl;
+  }
+  if (dropped_events > 0) {
+    std::cout << "  (" << dropped_events << " zones dropped, buffers full)"
+              << std::endl;
+  }
+  std::cout << std::defaultfloat;
+}
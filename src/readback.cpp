@@ -0,0 +1,124 @@
+#include <readback.hpp>
+
+// Time to wait for a fence in each call before flushing again (1 ms)
+const GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+
+FrameReadback::FrameReadback(int width, int height, Consumer consumer,
+                             unsigned num_buffers)
+    : consumer(std::move(consumer)), frame_width(width), frame_height(height),
+      slots(num_buffers) {
+  for (Slot &slot : slots) {
+    glGenBuffers(1, &slot.buffer);
+  }
+  allocate_buffers();
+}
+
+FrameReadback::~FrameReadback() {
+  for (Slot &slot : slots) {
+    if (slot.fence) {
+      glDeleteSync(slot.fence);
+    }
+    glDeleteBuffers(1, &slot.buffer);
+  }
+}
+
+void FrameReadback::allocate_buffers() {
+  const GLsizeiptr size =
+      static_cast<GLsizeiptr>(frame_width) * frame_height * 4;
+  for (Slot &slot : slots) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameReadback::capture(unsigned long long frame) {
+  poll();
+  if (in_flight == slots.size()) {
+    // The consumer is too far behind the GPU: wait for the oldest copy
+    stalls++;
+    deliver_oldest();
+  }
+
+  Slot &slot = slots[next_slot];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  // With a pack buffer bound the pixels are copied to it asynchronously. RGBA
+  // rows are always 4-byte aligned, so this is the fast path of the drivers
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, frame_width, frame_height, GL_RGBA, GL_UNSIGNED_BYTE,
+               (void *)0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frame = frame;
+
+  next_slot = (next_slot + 1) % slots.size();
+  in_flight++;
+}
+
+bool FrameReadback::oldest_ready() {
+  const Slot &slot = slots[oldest_slot()];
+  const GLenum status =
+      glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void FrameReadback::poll() {
+  while (in_flight > 0 && oldest_ready()) {
+    deliver_oldest();
+  }
+}
+
+void FrameReadback::flush() {
+  while (in_flight > 0) {
+    deliver_oldest();
+  }
+}
+
+void FrameReadback::resize(int width, int height) {
+  if (width == frame_width && height == frame_height) {
+    return;
+  }
+  flush();
+  frame_width = width;
+  frame_height = height;
+  allocate_buffers();
+}
+
+void FrameReadback::deliver_oldest() {
+  Slot &slot = slots[oldest_slot()];
+  while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                          FENCE_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  in_flight--;
+
+  // The copy is done, so mapping the buffer doesn't wait for the GPU
+  const GLsizeiptr size =
+      static_cast<GLsizeiptr>(frame_width) * frame_height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const void *pixels =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  if (pixels) {
+    consumer(static_cast<const unsigned char *>(pixels), frame_width,
+             frame_height, slot.frame);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+std::vector<unsigned char> readback_to_rgb(const unsigned char *rgba, int width,
+                                           int height) {
+  std::vector<unsigned char> rgb(static_cast<size_t>(width) * height * 3);
+  for (int row = 0; row < height; row++) {
+    const unsigned char *src = rgba + static_cast<size_t>(row) * width * 4;
+    unsigned char *dst =
+        rgb.data() + static_cast<size_t>(height - 1 - row) * width * 3;
+    for (int col = 0; col < width; col++) {
+      dst[col * 3] = src[col * 4];
+      dst[col * 3 + 1] = src[col * 4 + 1];
+      dst[col * 3 + 2] = src[col * 4 + 2];
+    }
+  }
+  return rgb;
+}
@@ -0,0 +1,119 @@
+#include <rendertarget.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+RenderTarget::RenderTarget(int width, int height)
+    : target_width(width), target_height(height), region_width(width),
+      region_height(height) {
+  // Color attachment, also sampled by the passes that read the result
+  glGenTextures(1, &color);
+  glBindTexture(GL_TEXTURE_2D, color);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // Depth attachment
+  glGenTextures(1, &depth);
+  glBindTexture(GL_TEXTURE_2D, depth);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+               GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         color, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         depth, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Render target framebuffer is not complete" << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+RenderTarget::~RenderTarget() {
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &color);
+  glDeleteTextures(1, &depth);
+}
+
+void RenderTarget::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, region_width, region_height);
+}
+
+void RenderTarget::set_viewport(int width, int height) {
+  region_width = std::clamp(width, 1, target_width);
+  region_height = std::clamp(height, 1, target_height);
+}
+
+void RenderTarget::blit_to(GLuint framebuffer, int width, int height,
+                           GLenum filter) const {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glBlitFramebuffer(0, 0, region_width, region_height, 0, 0, width, height,
+                    GL_COLOR_BUFFER_BIT, filter);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+ResizableTarget::ResizableTarget(int width, int height, unsigned settle_frames)
+    : target(std::make_unique<RenderTarget>(width, height)),
+      requested_width(width), requested_height(height),
+      settle_frames(settle_frames) {}
+
+ResizableTarget::~ResizableTarget() {
+  // Deleting the objects is safe even if the GPU still uses them, the driver
+  // keeps them alive until then
+  for (Retired &old : retired) {
+    glDeleteSync(old.fence);
+  }
+}
+
+void ResizableTarget::resize(int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  if (width != requested_width || height != requested_height) {
+    requested_width = width;
+    requested_height = height;
+    stable_frames = 0;
+  }
+}
+
+RenderTarget &ResizableTarget::begin_frame() {
+  release_finished();
+  if (requested_width == target->width() &&
+      requested_height == target->height()) {
+    return *target;
+  }
+  if (++stable_frames < settle_frames) {
+    return *target;
+  }
+  // The commands of the previous frames are all submitted, so the fence
+  // signals once none of them uses the old target
+  retired.push_back(
+      {std::move(target), glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  target = std::make_unique<RenderTarget>(requested_width, requested_height);
+  allocations++;
+  stable_frames = 0;
+  return *target;
+}
+
+void ResizableTarget::release_finished() {
+  auto finished = [](Retired &old) {
+    if (glClientWaitSync(old.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    glDeleteSync(old.fence);
+    return true;
+  };
+  retired.erase(std::remove_if(retired.begin(), retired.end(), finished),
+                retired.end());
+}
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <profiler.hpp>
+#include <scene.hpp>
+
+void HouseInstances::add(const glm::vec3 &position, float turn_speed) {
+  positions.push_back(position);
+  turn_speeds.push_back(turn_speed);
+  models.push_back(glm::mat4(1.0f));
+}
+
+float house_turn_speed(size_t index) {
+  const float speed = index % HOUSE_MAX_SPEED + HOUSE_MIN_SPEED;
+  return index % 2 == 0 ? speed : -speed;
+}
+
+HouseInstances make_house_grid(size_t count, float spacing) {
+  HouseInstances houses;
+  const size_t side = std::ceil(std::sqrt(static_cast<double>(count)));
+  const float offset = (side - 1) * spacing * 0.5f;
+  for (size_t i = 0; i < count; i++) {
+    const glm::vec3 position = glm::vec3((i % side) * spacing - offset, 0.0f,
+                                         (i / side) * spacing - offset);
+    houses.add(position, house_turn_speed(i));
+  }
+  return houses;
+}
+
+HouseInstances make_house_random(size_t count, float spacing, uint32_t seed) {
+  HouseInstances houses;
+  const size_t side = std::ceil(std::sqrt(static_cast<double>(count)));
+  const float extent = side * spacing;
+  // Use the raw generator output, since the distributions of the standard
+  // library may give different values on each implementation
+  std::mt19937 random(seed);
+  auto next_coordinate = [&]() {
+    return (random() / 4294967296.0f - 0.5f) * extent;
+  };
+  for (size_t i = 0; i < count; i++) {
+    const float x = next_coordinate();
+    const float z = next_coordinate();
+    houses.add(glm::vec3(x, 0.0f, z), house_turn_speed(i));
+  }
+  return houses;
+}
+
+void update_transforms(JobSystem &jobs, HouseInstances &houses, float time,
+                       JobCounter &counter) {
+  jobs.parallel_for(
+      houses.size(), 0,
+      [&houses, time](size_t begin, size_t end) {
+        PROFILE_ZONE("Update transforms");
+        for (size_t i = begin; i < end; i++) {
+          // Same as translate(position) * rotate(angle, Y) but without the
+          // generic matrix products
+          const float angle = houses.turn_speeds[i] * time;
+          const float c = std::cos(angle);
+          const float s = std::sin(angle);
+          glm::mat4 &model = houses.models[i];
+          model[0] = glm::vec4(c, 0.0f, -s, 0.0f);
+          model[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+          model[2] = glm::vec4(s, 0.0f, c, 0.0f);
+          model[3] = glm::vec4(houses.positions[i], 1.0f);
+        }
+      },
+      counter);
+}
+
+void cull_houses(JobSystem &jobs, const HouseInstances &houses,
+                 const Frustum &frustum, VisibleSet &visible,
+                 JobCounter &counter) {
+  visible.chunk_size = jobs.default_chunk_size(houses.size());
+  const size_t num_chunks =
+      (houses.size() + visible.chunk_size - 1) / visible.chunk_size;
+  visible.flags.resize(houses.size());
+  visible.chunk_counts.assign(num_chunks, 0);
+  visible.chunk_offsets.resize(num_chunks);
+  jobs.parallel_for(
+      houses.size(), visible.chunk_size,
+      // The frustum is copied, the jobs can run after the call returns
+      [&houses, frustum, &visible](size_t begin, size_t end) {
+        PROFILE_ZONE("Cull houses");
+        uint32_t chunk_count = 0;
+        for (size_t i = begin; i < end; i++) {
+          const bool inside = frustum.intersects_sphere(houses.positions[i],
+                                                        HOUSE_BOUNDING_RADIUS);
+          visible.flags[i] = inside;
+          chunk_count += inside;
+        }
+        visible.chunk_counts[begin / visible.chunk_size] = chunk_count;
+      },
+      counter);
+}
+
+// Camera movement under which the previous front to back order is reused
+const float ORDER_REUSE_DISTANCE = 0.25f;
+// Cosine of the largest turn (2 degrees)
+const float ORDER_REUSE_COS_ANGLE = 0.9994f;
+
+// Sorts `order.sorted` by `order.keys` (both reordered), stable, one byte per
+// pass. Each pass counts the digits of every chunk in parallel, and then the
+// chunks scatter their elements in parallel after the ones of the previous
+// chunks with the same digit
+static void radix_sort(JobSystem &jobs, DrawOrder &order) {
+  const size_t count = order.keys.size();
+  const size_t chunk_size = jobs.default_chunk_size(count);
+  const size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+  order.keys_scratch.resize(count);
+  order.sorted_scratch.resize(count);
+  for (int shift = 0; shift < 16; shift += 8) {
+    std::vector<uint32_t> &histograms = order.histograms;
+    histograms.assign(num_chunks * 256, 0);
+    jobs.parallel_for(count, chunk_size, [&](size_t begin, size_t end) {
+      uint32_t *histogram = &histograms[begin / chunk_size * 256];
+      for (size_t i = begin; i < end; i++) {
+        histogram[(order.keys[i] >> shift) & 0xFF]++;
+      }
+    });
+    uint32_t offset = 0;
+    for (size_t digit = 0; digit < 256; digit++) {
+      for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        const uint32_t digit_count = histograms[chunk * 256 + digit];
+        histograms[chunk * 256 + digit] = offset;
+        offset += digit_count;
+      }
+    }
+    jobs.parallel_for(count, chunk_size, [&](size_t begin, size_t end) {
+      uint32_t *offsets = &histograms[begin / chunk_size * 256];
+      for (size_t i = begin; i < end; i++) {
+        const uint32_t out = offsets[(order.keys[i] >> shift) & 0xFF]++;
+        order.keys_scratch[out] = order.keys[i];
+        order.sorted_scratch[out] = order.sorted[i];
+      }
+    });
+    order.keys.swap(order.keys_scratch);
+    order.sorted.swap(order.sorted_scratch);
+  }
+}
+
+void sort_front_to_back(JobSystem &jobs, const HouseInstances &houses,
+                        const VisibleSet &visible, const glm::vec3 &position,
+                        const glm::vec3 &forward, float max_depth,
+                        DrawOrder &order) {
+  PROFILE_ZONE("Sort houses");
+  const size_t count = houses.size();
+  const bool reuse =
+      order.sorted.size() == count &&
+      glm::distance(position, order.position) < ORDER_REUSE_DISTANCE &&
+      glm::dot(forward, order.forward) > ORDER_REUSE_COS_ANGLE;
+  if (reuse) {
+    order.num_reused++;
+  } else {
+    // Depth along the view direction, quantized. The houses behind the
+    // camera are culled, so they all get the key 0
+    order.keys.resize(count);
+    order.sorted.resize(count);
+    const float scale = 65535.0f / max_depth;
+    jobs.parallel_for(count, 0, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const float depth = glm::dot(houses.positions[i] - position, forward);
+        order.keys[i] = std::clamp(depth * scale, 0.0f, 65535.0f);
+        order.sorted[i] = i;
+      }
+    });
+    radix_sort(jobs, order);
+    order.position = position;
+    order.forward = forward;
+    order.num_sorts++;
+  }
+
+  // Keep the visible houses, counting them per chunk of the order first so
+  // the chunks can write them in parallel
+  const size_t chunk_size = jobs.default_chunk_size(count);
+  const size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+  std::vector<uint32_t> &offsets = order.histograms;
+  offsets.assign(num_chunks, 0);
+  jobs.parallel_for(count, chunk_size, [&](size_t begin, size_t end) {
+    uint32_t chunk_count = 0;
+    for (size_t i = begin; i < end; i++) {
+      chunk_count += visible.flags[order.sorted[i]];
+    }
+    offsets[begin / chunk_size] = chunk_count;
+  });
+  uint32_t offset = 0;
+  for (uint32_t &chunk_offset : offsets) {
+    const uint32_t chunk_count = chunk_offset;
+    chunk_offset = offset;
+    offset += chunk_count;
+  }
+  order.visible.resize(offset);
+  jobs.parallel_for(count, chunk_size, [&](size_t begin, size_t end) {
+    uint32_t *out = order.visible.data() + offsets[begin / chunk_size];
+    for (size_t i = begin; i < end; i++) {
+      if (visible.flags[order.sorted[i]]) {
+        *out++ = order.sorted[i];
+      }
+    }
+  });
+}
+
+void fill_instances(JobSystem &jobs, const HouseInstances &houses,
+                    VisibleSet &visible, glm::mat4 *instances,
+                    JobCounter &counter, JobCounter &transforms) {
+  // Each chunk writes its visible houses after the ones of previous chunks
+  uint32_t offset = 0;
+  for (size_t chunk = 0; chunk < visible.chunk_counts.size(); chunk++) {
+    visible.chunk_offsets[chunk] = offset;
+    offset += visible.chunk_counts[chunk];
+  }
+  visible.count = offset;
+  jobs.parallel_for(
+      houses.size(), visible.chunk_size,
+      [&houses, &visible, instances](size_t begin, size_t end) {
+        PROFILE_ZONE("Fill instances");
+        const size_t chunk = begin / visible.chunk_size;
+        glm::mat4 *out = instances + visible.chunk_offsets[chunk];
+        for (size_t i = begin; i < end; i++) {
+          if (visible.flags[i]) {
+            *out++ = houses.models[i];
+          }
+        }
+      },
+      counter, &transforms);
+}
+
+void fill_sorted_instances(JobSystem &jobs, const HouseInstances &houses,
+                           VisibleSet &visible, const DrawOrder &order,
+                           glm::mat4 *instances, JobCounter &counter,
+                           JobCounter &transforms) {
+  visible.count = order.visible.size();
+  jobs.parallel_for(
+      order.visible.size(), 0,
+      [&houses, &order, instances](size_t begin, size_t end) {
+        PROFILE_ZONE("Fill instances");
+        for (size_t i = begin; i < end; i++) {
+          instances[i] = houses.models[order.visible[i]];
+        }
+      },
+      counter, &transforms);
+}
@@ -0,0 +1,293 @@
+#include <glutils.hpp>
+#include <shadercache.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// ARB_get_program_binary, which glad was not generated with
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                 GLsizei bufSize,
+                                                 GLsizei *length,
+                                                 GLenum *binaryFormat,
+                                                 void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program,
+                                              GLenum binaryFormat,
+                                              const void *binary,
+                                              GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program,
+                                                  GLenum pname, GLint value);
+
+static PFNGLGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+static PFNGLPROGRAMBINARYPROC programBinary = nullptr;
+static PFNGLPROGRAMPARAMETERIPROC programParameteri = nullptr;
+
+// Define of each feature, in the order of their bits
+static const char *const FEATURE_DEFINES[NUM_SHADER_FEATURES] = {
+    "VERTEX_COLOR", "LIGHTING", "INSTANCED", "LIGHTMAP"};
+
+// Start of the saved program binaries, "SHB1"
+const uint32_t BINARY_MAGIC = 0x31424853;
+
+struct BinaryHeader {
+  uint32_t magic;
+  uint32_t format;
+  // Of the sources, the defines and the driver that produced the binary
+  uint64_t source_hash;
+  uint64_t length;
+};
+
+static std::string read_source(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cout << "Shader source " << path << " can't be read" << std::endl;
+    return std::string();
+  }
+  std::stringstream source;
+  source << file.rdbuf();
+  return source.str();
+}
+
+// Adds the lines after the #version directive, which must come first
+static std::string insert_defines(const std::string &source,
+                                  const std::string &defines) {
+  std::string code = source;
+  const size_t version = code.find("#version");
+  const size_t line_end =
+      version == std::string::npos ? version : code.find('\n', version);
+  code.insert(line_end == std::string::npos ? 0 : line_end + 1, defines);
+  return code;
+}
+
+// FNV-1a, continued from `hash`
+static uint64_t hash_string(const std::string &text,
+                            uint64_t hash = 0xcbf29ce484222325ull) {
+  for (unsigned char c : text) {
+    hash = (hash ^ c) * 0x100000001b3ull;
+  }
+  // Separates the strings, so their boundaries are part of the hash
+  return (hash ^ 0xff) * 0x100000001b3ull;
+}
+
+static std::string gl_string(GLenum name) {
+  const GLubyte *value = glGetString(name);
+  return value ? reinterpret_cast<const char *>(value) : "";
+}
+
+static GLuint compile_stage(GLenum type, const std::string &code,
+                            const std::string &name) {
+  const char *source = code.c_str();
+  GLuint stage = glCreateShader(type);
+  glShaderSource(stage, 1, &source, NULL);
+  glCompileShader(stage);
+  int success;
+  glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    char errorLog[1024];
+    glGetShaderInfoLog(stage, 1024, NULL, errorLog);
+    std::cout << "Error in shader compilation of " << name << ":\n"
+              << errorLog << std::endl;
+  }
+  return stage;
+}
+
+ShaderCache::ShaderCache(const std::string &vertex_path,
+                         const std::string &fragment_path,
+                         const std::string &binary_dir)
+    : binary_dir(binary_dir) {
+  vertex_source = read_source(vertex_path);
+  fragment_source = read_source(fragment_path);
+  // Names the binaries after both sources, since they can be shared
+  const std::string vertex_name =
+      std::filesystem::path(vertex_path).stem().string();
+  const std::string fragment_name =
+      std::filesystem::path(fragment_path).stem().string();
+  name = vertex_name == fragment_name ? vertex_name
+                                      : vertex_name + "_" + fragment_name;
+
+  if (!binary_dir.empty() &&
+      (has_gl_version(4, 1) || has_gl_extension("GL_ARB_get_program_binary"))) {
+    getProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(
+        get_gl_proc("glGetProgramBinary"));
+    programBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(
+        get_gl_proc("glProgramBinary"));
+    programParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(
+        get_gl_proc("glProgramParameteri"));
+    // A driver can support the extension without any binary format
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    binaries_supported =
+        getProgramBinary && programBinary && programParameteri && formats > 0;
+  }
+}
+
+ShaderCache::~ShaderCache() {
+  for (GLuint program : programs) {
+    if (program) {
+      glDeleteProgram(program);
+    }
+  }
+}
+
+GLuint ShaderCache::program(unsigned features) {
+  if (features >= (1u << NUM_SHADER_FEATURES)) {
+    std::cout << "Unknown shader features " << features << std::endl;
+    return 0;
+  }
+  GLuint &program = programs[features];
+  if (!program) {
+    const auto start = std::chrono::steady_clock::now();
+    program = build(features);
+    build_ms += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    if (program_setup) {
+      program_setup(program, features);
+    }
+  }
+  return program;
+}
+
+GLuint ShaderCache::build(unsigned features) {
+  std::string defines;
+  for (unsigned f = 0; f < NUM_SHADER_FEATURES; f++) {
+    if (features & (1u << f)) {
+      defines += std::string("#define ") + FEATURE_DEFINES[f] + "\n";
+    }
+  }
+  if (!binaries_supported) {
+    return compile(features, defines);
+  }
+
+  // The binary is only valid for the same sources on the same driver
+  uint64_t source_hash = hash_string(vertex_source);
+  source_hash = hash_string(fragment_source, source_hash);
+  source_hash = hash_string(defines, source_hash);
+  for (GLenum string : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    source_hash = hash_string(gl_string(string), source_hash);
+  }
+  std::stringstream path;
+  path << binary_dir << "/" << name << "_" << std::hex << std::setw(2)
+       << std::setfill('0') << features << ".bin";
+
+  GLuint program = load_binary(path.str(), source_hash);
+  if (program) {
+    loaded++;
+    return program;
+  }
+  program = compile(features, defines);
+  save_binary(program, path.str(), source_hash);
+  return program;
+}
+
+GLuint ShaderCache::compile(unsigned features, const std::string &defines) {
+  std::stringstream variant;
+  variant << name << " (features " << features << ")";
+  GLuint vertex = compile_stage(
+      GL_VERTEX_SHADER, insert_defines(vertex_source, defines), variant.str());
+  GLuint fragment =
+      compile_stage(GL_FRAGMENT_SHADER,
+                    insert_defines(fragment_source, defines), variant.str());
+
+  GLuint program = glCreateProgram();
+  if (binaries_supported) {
+    programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char errorLog[1024];
+    glGetProgramInfoLog(program, 1024, NULL, errorLog);
+    std::cout << "Error in shader linking of " << variant.str() << ":\n"
+              << errorLog << std::endl;
+  }
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+  compiled++;
+  return program;
+}
+
+GLuint ShaderCache::load_binary(const std::string &path,
+                                uint64_t source_hash) {
+  std::ifstream file(path, std::ios::binary);
+  BinaryHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != BINARY_MAGIC || header.source_hash != source_hash ||
+      header.length == 0 || header.length > (1u << 30)) {
+    return 0;
+  }
+  std::vector<char> binary(header.length);
+  if (!file.read(binary.data(), binary.size())) {
+    return 0;
+  }
+  GLuint program = glCreateProgram();
+  programBinary(program, header.format, binary.data(),
+                static_cast<GLsizei>(binary.size()));
+  // The driver rejects the binaries it can't use anymore, then the variant
+  // is compiled and saved again
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void ShaderCache::save_binary(GLuint program, const std::string &path,
+                              uint64_t source_hash) {
+  // Failed variants are compiled again by the next runs, to show the errors
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    return;
+  }
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  getProgramBinary(program, length, &length, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(binary_dir, error);
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    std::cout << "Shader binary " << path << " can't be written" << std::endl;
+    return;
+  }
+  const BinaryHeader header = {BINARY_MAGIC, format, source_hash,
+                               static_cast<uint64_t>(length)};
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(binary.data(), length);
+}
+
+void ShaderCache::print_summary() const {
+  if (compiled + loaded == 0) {
+    return;
+  }
+  const std::streamsize precision = std::cout.precision();
+  std::cout << "Shaders " << name << ": " << compiled + loaded
+            << " variants built in " << std::fixed << std::setprecision(1)
+            << build_ms << " ms (" << compiled << " compiled, " << loaded
+            << " loaded from binaries";
+  if (!binary_dir.empty() && !binaries_supported) {
+    std::cout << ", not supported by the driver";
+  }
+  std::cout << ")" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  std::cout.precision(precision);
+}
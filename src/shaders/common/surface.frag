@@ -0,0 +1,126 @@
+#version 330 core
+
+// Variants selected by the defines of a ShaderCache (see shadercache.hpp).
+// The baked lighting of LIGHTMAP replaces the dynamic one of LIGHTING, and
+// without either the surface is unlit
+#if defined(LIGHTING) || defined(LIGHTMAP)
+#define UNIFORM_BLOCKS
+#endif
+#if defined(LIGHTING) && !defined(LIGHTMAP)
+#define DYNAMIC_LIGHTING
+#endif
+
+in vec2 texCoord;
+#ifdef VERTEX_COLOR
+in vec3 fragColor;
+#endif
+#ifdef LIGHTMAP
+in vec2 lightmapCoord;
+#endif
+#ifdef DYNAMIC_LIGHTING
+in vec3 viewPosition;
+#endif
+
+out vec4 screenColor;
+
+uniform sampler2D baseTexture;
+#ifdef LIGHTMAP
+// Baked lighting of the static geometry (see LightmapBaker)
+uniform sampler2D lightmap;
+#endif
+#ifdef DYNAMIC_LIGHTING
+// Lights of each cluster, built on the CPU (see LightClusters)
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+// Shadows of the sun (see ShadowMaps)
+uniform sampler2DShadow shadowAtlas;
+#endif
+
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  vec4 clusterParams;
+  vec4 sunDirection;
+  vec4 sunColor;
+  vec4 cascadeSplits;
+  mat4 shadowMatrices[4];
+};
+
+layout(std140) uniform DrawData {
+  mat4 model;
+  vec3 objectColor;
+  vec3 lightColor;
+};
+#endif
+
+#ifdef DYNAMIC_LIGHTING
+// Size of the cluster grid, matching lightclusters.hpp
+const int TILES_X = 16;
+const int TILES_Y = 9;
+const int SLICES = 24;
+
+// Depth offset of the shadow lookups, added to the offset of the casters
+const float SHADOW_BIAS = 0.0005;
+
+// Fraction of the sun light that reaches the position, 1 beyond the cascades
+float sunShadow(vec3 position) {
+  int cascades = int(sunDirection.w);
+  for (int c = 0; c < cascades; c++) {
+    if (-position.z < cascadeSplits[c]) {
+      vec4 coord = shadowMatrices[c] * vec4(position, 1.0);
+      return texture(shadowAtlas, vec3(coord.xy, coord.z - SHADOW_BIAS));
+    }
+  }
+  return 1.0;
+}
+
+// Light that reaches every surface, scaled by `lightColor`
+const float AMBIENT = 0.3;
+#endif
+
+void main() {
+  screenColor = texture(baseTexture, texCoord);
+#ifdef VERTEX_COLOR
+  screenColor *= vec4(fragColor, 1.0);
+#endif
+#ifdef LIGHTMAP
+  // The ambient and the static lights, with their occlusion, in one fetch
+  vec3 illumination = texture(lightmap, lightmapCoord).rgb;
+#elif defined(DYNAMIC_LIGHTING)
+  // Flat normal of the triangle, facing the camera
+  vec3 normal = normalize(cross(dFdx(viewPosition), dFdy(viewPosition)));
+
+  ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy),
+                   ivec2(TILES_X - 1, TILES_Y - 1));
+  int slice = clamp(int(log(-viewPosition.z) * clusterParams.z -
+                        clusterParams.w), 0, SLICES - 1);
+  uvec2 range =
+      texelFetch(clusterRanges, (slice * TILES_Y + tile.y) * TILES_X + tile.x)
+          .xy;
+
+  vec3 diffuse = vec3(0.0);
+  for (uint i = 0u; i < range.y; i++) {
+    int light = int(texelFetch(clusterIndices, int(range.x + i)).x);
+    vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+    vec3 color = texelFetch(clusterLights, 2 * light + 1).rgb;
+    vec3 toLight = positionRadius.xyz - viewPosition;
+    float lightDistance = max(length(toLight), 1e-4);
+    // Inverse square falloff, windowed to reach zero at the radius
+    float window =
+        clamp(1.0 - pow(lightDistance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+    diffuse +=
+        color * attenuation * max(dot(normal, toLight / lightDistance), 0.0);
+  }
+
+  diffuse += sunColor.rgb * max(dot(normal, sunDirection.xyz), 0.0) *
+             sunShadow(viewPosition);
+
+  vec3 illumination = lightColor * AMBIENT + diffuse;
+#endif
+#ifdef UNIFORM_BLOCKS
+  screenColor *= vec4(illumination * objectColor, 1.0);
+#endif
+}
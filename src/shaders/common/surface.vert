@@ -0,0 +1,88 @@
+#version 330 core
+
+// Variants selected by the defines of a ShaderCache (see shadercache.hpp).
+// The lit variants read the matrices from the uniform blocks of the lighting
+// app, the others from plain uniforms
+#if defined(LIGHTING) || defined(LIGHTMAP)
+#define UNIFORM_BLOCKS
+#endif
+
+layout(location = 0) in vec3 aPos;
+#ifdef VERTEX_COLOR
+layout(location = 1) in vec3 aColor;
+#endif
+layout(location = 2) in vec2 aTexCoord;
+#ifdef INSTANCED
+// Per-instance model matrix (uses the locations 3 to 6)
+layout(location = 3) in mat4 aModel;
+#endif
+#ifdef LIGHTMAP
+// Only the static geometry has lightmap coordinates (see LightmapBaker)
+layout(location = 7) in vec2 aLightmapCoord;
+#endif
+
+out vec2 texCoord;
+#ifdef VERTEX_COLOR
+out vec3 fragColor;
+#endif
+#ifdef LIGHTMAP
+out vec2 lightmapCoord;
+#endif
+#ifdef UNIFORM_BLOCKS
+out vec3 viewPosition;
+#endif
+
+#ifdef UNIFORM_BLOCKS
+// Data shared by all the draws of a frame
+layout(std140) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  // Screen tiles per pixel (xy) and the scale and bias of the depth slices
+  vec4 clusterParams;
+  // Direction towards the sun in view space (xyz) and number of shadow
+  // cascades (w), the color of the sun, and the far depth of each cascade
+  vec4 sunDirection;
+  vec4 sunColor;
+  vec4 cascadeSplits;
+  // View space to the shadow atlas coordinates of each cascade
+  mat4 shadowMatrices[4];
+};
+
+// Data of the current draw, selected with a range of the uniform buffer
+layout(std140) uniform DrawData {
+  mat4 model;
+  vec3 objectColor;
+  vec3 lightColor;
+};
+#else
+uniform mat4 view;
+uniform mat4 projection;
+#ifndef INSTANCED
+uniform mat4 model;
+#endif
+#endif
+
+#ifdef INSTANCED
+#define MODEL aModel
+// The depth must match the one of the depth pre-pass exactly
+invariant gl_Position;
+#else
+#define MODEL model
+#endif
+
+void main() {
+#ifdef UNIFORM_BLOCKS
+  vec4 position = view * MODEL * vec4(aPos, 1.0);
+  gl_Position = projection * position;
+  viewPosition = position.xyz;
+#else
+  gl_Position = projection * view * MODEL * vec4(aPos, 1.0);
+#endif
+  texCoord = aTexCoord;
+#ifdef VERTEX_COLOR
+  fragColor = aColor;
+#endif
+#ifdef LIGHTMAP
+  lightmapCoord = aLightmapCoord;
+#endif
+}
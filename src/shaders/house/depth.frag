@@ -0,0 +1,4 @@
+#version 330 core
+
+// Only the depth is written
+void main() {}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+
+layout(location = 0) in vec3 aPos;
+// Per-instance model matrix (uses the locations 3 to 6)
+layout(location = 3) in mat4 aModel;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// The depth must match the one of the main pass exactly
+invariant gl_Position;
+
+void main() {
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
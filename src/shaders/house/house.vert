@@ -1,18 +0,0 @@
-#version 330 core
-
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aColor;
-layout(location = 2) in vec2 aTexCoord;
-
-out vec3 fragColor;
-out vec2 texCoord;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main() {
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
-  fragColor = aColor;
-  texCoord = aTexCoord;
-}
\ No newline at end of file
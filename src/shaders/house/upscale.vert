@@ -0,0 +1,10 @@
+#version 330 core
+
+out vec2 texCoord;
+
+// Draws a triangle that covers the screen, from the index of its 3 vertices
+void main() {
+  vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  texCoord = position;
+  gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 screenColor;
+
+// Scene drawn at a lower resolution in the bottom-left region of the texture
+uniform sampler2D source;
+// Size of the region in texture coordinates, and of a texel
+uniform vec2 sourceScale;
+uniform vec2 texelSize;
+// Amount of the detail (color minus the neighbors average) added back
+uniform float sharpness;
+
+vec3 sample_region(vec2 uv) {
+  // Keep the bilinear taps inside the region
+  uv = clamp(uv, 0.5 * texelSize, sourceScale - 0.5 * texelSize);
+  return texture(source, uv).rgb;
+}
+
+void main() {
+  vec2 uv = texCoord * sourceScale;
+  vec3 center = sample_region(uv);
+  vec3 neighbors = sample_region(uv + vec2(texelSize.x, 0.0)) +
+                   sample_region(uv - vec2(texelSize.x, 0.0)) +
+                   sample_region(uv + vec2(0.0, texelSize.y)) +
+                   sample_region(uv - vec2(0.0, texelSize.y));
+  vec3 color = center + (center - 0.25 * neighbors) * sharpness;
+  screenColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#version 330 core
+
+out vec4 screenColor;
+
+// Surfaces written by the geometry pass (see GBuffer)
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferDepth;
+// Lights of each cluster, built on the CPU (see LightClusters)
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+// Shadows of the sun (see ShadowMaps)
+uniform sampler2DShadow shadowAtlas;
+
+layout(std140) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  // Screen tiles per pixel (xy) and the scale and bias of the depth slices
+  vec4 clusterParams;
+  // Direction towards the sun in view space (xyz) and number of shadow
+  // cascades (w), the color of the sun, and the far depth of each cascade
+  vec4 sunDirection;
+  vec4 sunColor;
+  vec4 cascadeSplits;
+  // View space to the shadow atlas coordinates of each cascade
+  mat4 shadowMatrices[4];
+};
+
+// Size of the cluster grid, matching lightclusters.hpp
+const int TILES_X = 16;
+const int TILES_Y = 9;
+const int SLICES = 24;
+
+// Depth offset of the shadow lookups, added to the offset of the casters
+const float SHADOW_BIAS = 0.0005;
+
+// Fraction of the sun light that reaches the position, 1 beyond the cascades
+float sunShadow(vec3 position) {
+  int cascades = int(sunDirection.w);
+  for (int c = 0; c < cascades; c++) {
+    if (-position.z < cascadeSplits[c]) {
+      vec4 coord = shadowMatrices[c] * vec4(position, 1.0);
+      return texture(shadowAtlas, vec3(coord.xy, coord.z - SHADOW_BIAS));
+    }
+  }
+  return 1.0;
+}
+
+// Light that reaches every surface, as in surface.frag with a white lightColor
+const float AMBIENT = 0.3;
+
+vec3 decodeNormal(vec2 encoded) {
+  vec2 folded = encoded * 2.0 - 1.0;
+  vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
+void main() {
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(gbufferDepth, pixel, 0).r;
+  // Keep the background cleared
+  if (depth == 1.0)
+    discard;
+
+  // Rebuild the view space position from the depth with the perspective
+  // projection, whose w is -z. The tiles per pixel give the viewport size
+  vec2 ndc = (gl_FragCoord.xy * clusterParams.xy) /
+                 vec2(TILES_X, TILES_Y) * 2.0 - 1.0;
+  float viewZ = -projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+  vec3 viewPosition = vec3(ndc * -viewZ / vec2(projection[0][0],
+                                               projection[1][1]), viewZ);
+  vec3 normal = decodeNormal(texelFetch(gbufferNormal, pixel, 0).rg);
+
+  // Same lights walk as surface.frag
+  ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy),
+                   ivec2(TILES_X - 1, TILES_Y - 1));
+  int slice = clamp(int(log(-viewZ) * clusterParams.z - clusterParams.w), 0,
+                    SLICES - 1);
+  uvec2 range =
+      texelFetch(clusterRanges, (slice * TILES_Y + tile.y) * TILES_X + tile.x)
+          .xy;
+
+  vec3 diffuse = vec3(0.0);
+  for (uint i = 0u; i < range.y; i++) {
+    int light = int(texelFetch(clusterIndices, int(range.x + i)).x);
+    vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+    vec3 color = texelFetch(clusterLights, 2 * light + 1).rgb;
+    vec3 toLight = positionRadius.xyz - viewPosition;
+    float lightDistance = max(length(toLight), 1e-4);
+    // Inverse square falloff, windowed to reach zero at the radius
+    float window =
+        clamp(1.0 - pow(lightDistance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+    diffuse +=
+        color * attenuation * max(dot(normal, toLight / lightDistance), 0.0);
+  }
+
+  diffuse += sunColor.rgb * max(dot(normal, sunDirection.xyz), 0.0) *
+             sunShadow(viewPosition);
+
+  vec3 albedo = texelFetch(gbufferAlbedo, pixel, 0).rgb;
+  screenColor = vec4(albedo * (AMBIENT + diffuse), 1.0);
+  // Let the forward draws that follow test against the houses
+  gl_FragDepth = depth;
+}
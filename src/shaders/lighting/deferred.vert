@@ -0,0 +1,7 @@
+#version 330 core
+
+// Draws a triangle that covers the screen, from the index of its 3 vertices
+void main() {
+  vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 texCoord;
+in vec3 viewPosition;
+
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec2 packedNormal;
+
+uniform sampler2D baseTexture;
+
+layout(std140) uniform DrawData {
+  mat4 model;
+  vec3 objectColor;
+  vec3 lightColor;
+};
+
+// Maps a unit vector to the octahedron and unfolds it in the [0, 1] square
+vec2 encodeNormal(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 folded = n.z >= 0.0 ? n.xy
+                           : (1.0 - abs(n.yx)) *
+                                 vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                      n.y >= 0.0 ? 1.0 : -1.0);
+  return folded * 0.5 + 0.5;
+}
+
+void main() {
+  // Flat normal of the triangle, facing the camera
+  vec3 normal = normalize(cross(dFdx(viewPosition), dFdy(viewPosition)));
+  albedo = texture(baseTexture, texCoord) * vec4(objectColor, 1.0);
+  packedNormal = encodeNormal(normal);
+}
@@ -2,7 +2,11 @@
 
 out vec4 screenColor;
 
-uniform vec3 objectColor;
+layout(std140) uniform DrawData {
+  mat4 model;
+  vec3 objectColor;
+  vec3 lightColor;
+};
 
 void main() {
   screenColor = vec4(objectColor, 1.0);
@@ -0,0 +1,4 @@
+#version 330 core
+
+// Only the depth of the casters is written
+void main() {}
@@ -0,0 +1,16 @@
+#version 330 core
+
+layout(location = 0) in vec3 aPos;
+
+// World space to the clip space of the shadow cascade
+uniform mat4 lightViewProjection;
+
+layout(std140) uniform DrawData {
+  mat4 model;
+  vec3 objectColor;
+  vec3 lightColor;
+};
+
+void main() {
+  gl_Position = lightViewProjection * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,222 @@
+#include <shadowmaps.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+// Weight of the logarithmic split over the uniform one
+const float SPLIT_LAMBDA = 0.6f;
+// Size of the cascade boxes over the spheres that bound their depth ranges,
+// the margin that the view can move before a cascade follows it
+const float CASCADE_MARGIN = 1.25f;
+// Distance towards the light, behind the cascade box, that the casters can be
+// and still shadow it
+const float CASTER_DISTANCE = 20.0f;
+// Slope scaled depth offset of the casters, against shadow acne
+const float OFFSET_FACTOR = 2.0f;
+const float OFFSET_UNITS = 4.0f;
+
+// Creates a depth texture that covers the whole atlas, and its framebuffer
+static void make_atlas(int width, int height, GLuint &fbo, GLuint &depth) {
+  glGenTextures(1, &depth);
+  glBindTexture(GL_TEXTURE_2D, depth);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+               GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         depth, 0);
+  // Depth only
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Shadow atlas framebuffer is not complete" << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowMaps::ShadowMaps(const ShadowSettings &settings) : settings(settings) {
+  this->settings.cascades =
+      std::clamp(settings.cascades, 1u, MAX_SHADOW_CASCADES);
+  columns = this->settings.cascades > 1 ? 2 : 1;
+  rows = this->settings.cascades > 2 ? 2 : 1;
+  const int width = columns * settings.resolution;
+  const int height = rows * settings.resolution;
+  make_atlas(width, height, static_fbo, static_depth);
+  make_atlas(width, height, dynamic_fbo, dynamic_depth);
+  // The shaders compare the depth while sampling, which also filters the
+  // results of 2x2 texels
+  glBindTexture(GL_TEXTURE_2D, dynamic_depth);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+ShadowMaps::~ShadowMaps() {
+  const GLuint framebuffers[] = {static_fbo, dynamic_fbo};
+  const GLuint textures[] = {static_depth, dynamic_depth};
+  glDeleteFramebuffers(2, framebuffers);
+  glDeleteTextures(2, textures);
+}
+
+void ShadowMaps::update(const glm::mat4 &view, const glm::mat4 &projection,
+                        const glm::vec3 &light_direction,
+                        unsigned long long static_version) {
+  updates++;
+  this->static_version = static_version;
+  const glm::vec3 light_forward = glm::normalize(light_direction);
+  if (light_forward != direction) {
+    // The light space changed, so the cascades are placed again
+    direction = light_forward;
+    for (Cascade &cascade : cascades) {
+      cascade.placed = false;
+    }
+  }
+  // Rotation to the light space, looking along the light
+  const glm::vec3 up = std::abs(direction.y) > 0.99f
+                           ? glm::vec3(1.0f, 0.0f, 0.0f)
+                           : glm::vec3(0.0f, 1.0f, 0.0f);
+  const glm::mat4 light_view =
+      glm::lookAt(glm::vec3(0.0f), direction, up);
+
+  // Depth ranges of the cascades, between a logarithmic and a uniform split
+  const float near_depth = projection[3][2] / (projection[2][2] - 1.0f);
+  const float far_depth = std::min(
+      projection[3][2] / (projection[2][2] + 1.0f), settings.max_distance);
+  // Squared slope of the corners of the view frustum
+  const float tan_x = 1.0f / projection[0][0];
+  const float tan_y = 1.0f / projection[1][1];
+  const float corner_slope2 = tan_x * tan_x + tan_y * tan_y;
+  const glm::mat4 inverse_view = glm::inverse(view);
+
+  float begin_depth = near_depth;
+  for (unsigned c = 0; c < settings.cascades; c++) {
+    const float fraction = static_cast<float>(c + 1) / settings.cascades;
+    const float end_depth =
+        SPLIT_LAMBDA * near_depth * std::pow(far_depth / near_depth, fraction) +
+        (1.0f - SPLIT_LAMBDA) *
+            (near_depth + (far_depth - near_depth) * fraction);
+    splits[c] = end_depth;
+
+    // Smallest sphere around the depth range, centered on the view axis. Its
+    // size only depends on the projection, so the texels keep their size
+    const float center_depth =
+        std::min((begin_depth + end_depth) * (1.0f + corner_slope2) / 2.0f,
+                 end_depth);
+    const float radius = std::sqrt(
+        (end_depth - center_depth) * (end_depth - center_depth) +
+        end_depth * end_depth * corner_slope2);
+    const glm::vec3 center = glm::vec3(
+        light_view * inverse_view * glm::vec4(0.0f, 0.0f, -center_depth, 1.0f));
+    begin_depth = end_depth;
+
+    // Keep the box while the sphere is inside it
+    Cascade &cascade = cascades[c];
+    const float extent = radius * CASCADE_MARGIN;
+    const glm::vec3 offset = glm::abs(center - cascade.center);
+    const bool inside = cascade.placed && extent == cascade.extent &&
+                        std::max({offset.x, offset.y, offset.z}) + radius <=
+                            extent;
+    if (!inside) {
+      // Move whole texels, so the static geometry keeps its rasterization
+      const float texel = 2.0f * extent / settings.resolution;
+      cascade.center = glm::vec3(std::round(center.x / texel) * texel,
+                                 std::round(center.y / texel) * texel,
+                                 center.z);
+      cascade.extent = extent;
+      cascade.placed = true;
+      moves++;
+    }
+
+    const glm::vec3 &box = cascade.center;
+    const glm::mat4 light_projection =
+        glm::ortho(box.x - extent, box.x + extent, box.y - extent,
+                   box.y + extent, -(box.z + extent + CASTER_DISTANCE),
+                   -(box.z - extent));
+    cascade.light_matrix = light_projection * light_view;
+
+    // From clip space to the region of the cascade in the atlas
+    glm::mat4 atlas(1.0f);
+    atlas[0][0] = 0.5f / columns;
+    atlas[1][1] = 0.5f / rows;
+    atlas[2][2] = 0.5f;
+    atlas[3][0] = (0.5f + c % 2) / columns;
+    atlas[3][1] = (0.5f + c / 2) / rows;
+    atlas[3][2] = 0.5f;
+    cascade.shadow_matrix = atlas * cascade.light_matrix * inverse_view;
+  }
+}
+
+void ShadowMaps::select_region(unsigned cascade) const {
+  const int x = (cascade % 2) * settings.resolution;
+  const int y = (cascade / 2) * settings.resolution;
+  glViewport(x, y, settings.resolution, settings.resolution);
+  glScissor(x, y, settings.resolution, settings.resolution);
+}
+
+bool ShadowMaps::begin_static(unsigned cascade) {
+  Cascade &data = cascades[cascade];
+  if (data.static_valid && data.static_matrix == data.light_matrix &&
+      data.static_version == static_version) {
+    return false;
+  }
+  data.static_matrix = data.light_matrix;
+  data.static_version = static_version;
+  data.static_valid = true;
+  static_draws++;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, static_fbo);
+  select_region(cascade);
+  // Only clear the region of the cascade
+  glEnable(GL_SCISSOR_TEST);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(OFFSET_FACTOR, OFFSET_UNITS);
+  return true;
+}
+
+void ShadowMaps::begin_dynamic(unsigned cascade) {
+  const int x = (cascade % 2) * settings.resolution;
+  const int y = (cascade / 2) * settings.resolution;
+  const int size = settings.resolution;
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, static_fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dynamic_fbo);
+  // The scissor of the previous region would clip the copy
+  glDisable(GL_SCISSOR_TEST);
+  glBlitFramebuffer(x, y, x + size, y + size, x, y, x + size, y + size,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, dynamic_fbo);
+  select_region(cascade);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(OFFSET_FACTOR, OFFSET_UNITS);
+}
+
+void ShadowMaps::end() {
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glDisable(GL_SCISSOR_TEST);
+}
+
+void ShadowMaps::bind(GLuint unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, dynamic_depth);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void ShadowMaps::print_summary() const {
+  if (updates == 0) {
+    return;
+  }
+  std::cout << "Shadows: " << settings.cascades << " cascades of "
+            << settings.resolution << "x" << settings.resolution
+            << ", static shadows drawn " << static_draws << " times in "
+            << updates << " frames (" << moves << " cascade moves)"
+            << std::endl;
+}
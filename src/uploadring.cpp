@@ -0,0 +1,115 @@
+#include <glutils.hpp>
+#include <uploadring.hpp>
+
+#include <algorithm>
+
+typedef void(APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size,
+                                              const void *data,
+                                              GLbitfield flags);
+
+// Time to wait for a fence in each call before flushing again (1 ms)
+const GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+
+UploadRing::UploadRing(GLenum target, size_t frame_size, unsigned num_frames)
+    : buffer_target(target), region_size(std::max<size_t>(frame_size, 1)),
+      num_regions(std::max(num_frames, 1u)), fences(num_regions, nullptr) {
+  const GLsizeiptr total_size = region_size * num_regions;
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(buffer_target, buffer_id);
+
+  PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+  if (has_gl_version(4, 4) || has_gl_extension("GL_ARB_buffer_storage")) {
+    bufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(
+        get_gl_proc("glBufferStorage"));
+  }
+  if (bufferStorage) {
+    // Immutable storage mapped once for the whole lifetime of the buffer
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    bufferStorage(buffer_target, total_size, NULL, flags);
+    persistent_map = static_cast<char *>(
+        glMapBufferRange(buffer_target, 0, total_size, flags));
+  } else {
+    glBufferData(buffer_target, total_size, NULL, GL_STREAM_DRAW);
+  }
+}
+
+UploadRing::~UploadRing() {
+  for (GLsync fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (persistent_map || region_map) {
+    glBindBuffer(buffer_target, buffer_id);
+    glUnmapBuffer(buffer_target);
+  }
+  glDeleteBuffers(1, &buffer_id);
+}
+
+void UploadRing::begin_frame() {
+  if (!first_frame) {
+    current_region = (current_region + 1) % num_regions;
+  }
+  first_frame = false;
+  region_used = 0;
+
+  if (persistent_map) {
+    // Wait until the GPU finished reading the region in a previous frame
+    GLsync &fence = fences[current_region];
+    if (fence) {
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              FENCE_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED) {
+      }
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+    return;
+  }
+
+  glBindBuffer(buffer_target, buffer_id);
+  if (current_region == 0) {
+    // Orphan the buffer: the regions still in use keep the old storage
+    glBufferData(buffer_target, region_size * num_regions, NULL,
+                 GL_STREAM_DRAW);
+  }
+  // This region of the current storage was never used by the GPU, so there
+  // is no need to synchronize
+  region_map = static_cast<char *>(glMapBufferRange(
+      buffer_target, current_region * region_size, region_size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT));
+}
+
+UploadRing::Allocation UploadRing::allocate(size_t size, size_t alignment) {
+  const size_t start = (region_used + alignment - 1) / alignment * alignment;
+  if (start + size > region_size) {
+    return {nullptr, 0};
+  }
+  char *region =
+      persistent_map ? persistent_map + current_region * region_size
+                     : region_map;
+  if (!region) {
+    return {nullptr, 0};
+  }
+  region_used = start + size;
+  return {region + start,
+          static_cast<GLintptr>(current_region * region_size + start)};
+}
+
+void UploadRing::commit() {
+  // With the coherent mapping the writes are visible without flushing
+  if (region_map) {
+    glBindBuffer(buffer_target, buffer_id);
+    glUnmapBuffer(buffer_target);
+    region_map = nullptr;
+  }
+}
+
+void UploadRing::end_frame() {
+  // The fence tells when the GPU is done with the commands using the region.
+  // The fallback path doesn't need it thanks to the orphaning
+  if (persistent_map) {
+    fences[current_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}